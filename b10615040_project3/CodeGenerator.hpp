@@ -8,6 +8,15 @@
 
 using namespace std;
 
+// a LocalVariableTable entry: the variable is live from label start to label end
+struct LocalVarRange{
+    string start;
+    string end;
+    string type;
+    Atom name;
+    int slot;
+};
+
 class CodeGenerator{
 private:
     ofstream output;
@@ -17,15 +26,126 @@ private:
     int label_counter;
     vector<vector<string>> labels_list;
 
+    // -g: LineNumberTable and LocalVariableTable for the current method
+    bool debug_info;
+    int line;
+    int last_line;
+    int debug_label_counter;
+    string next_label;          // the label on the next instruction, if any
+    bool next_label_written;
+    vector<pair<string, int>> line_numbers;
+    vector<LocalVarRange> local_vars;
+    vector<vector<int>> scopes; // indices into local_vars, one list per open block
+
+    // where every instruction goes, so that with -g each one can be labeled
+    // for the tables at the end of the method
+    ofstream& emit(){
+        if(debug_info){
+            if(line != last_line){
+                line_numbers.push_back(pair<string, int>(here(), line));
+                last_line = line;
+            }
+            if(next_label != "" && !next_label_written){
+                output << next_label << ": ";
+            }
+            next_label = "";
+        }
+        return output;
+    }
+    // the label the next instruction will have
+    string here(){
+        if(next_label == ""){
+            next_label = "D" + to_string(debug_label_counter++);
+            next_label_written = false;
+        }
+        return next_label;
+    }
+    void put_label(string label){
+        if(debug_info && next_label != "" && !next_label_written){
+            // the tables can use this label instead of one of our own
+            for(auto& l : line_numbers) if(l.first == next_label) l.first = label;
+            for(auto& v : local_vars){
+                if(v.start == next_label) v.start = label;
+                if(v.end == next_label) v.end = label;
+            }
+        }
+        next_label = label;
+        next_label_written = true;
+        output << label << ":" << endl;
+    }
+    void debug_method_start(){
+        last_line = 0;
+        next_label = "";
+        line_numbers.clear();
+        local_vars.clear();
+        scopes.clear();
+        scopes.push_back(vector<int>());
+    }
+    void debug_tables(){
+        if(!debug_info) return;
+        if(line_numbers.size() > 0){
+            output << "linenumbertable" << endl << "{" << endl;
+            for(auto& l : line_numbers) output << l.first << " " << l.second << endl;
+            output << "}" << endl;
+        }
+        if(local_vars.size() > 0){
+            output << "localvariabletable" << endl << "{" << endl;
+            for(auto& v : local_vars){
+                output << v.start << " " << v.end << " " << v.type << " " << Atoms.name(v.name) << " " << v.slot << endl;
+            }
+            output << "}" << endl;
+        }
+    }
+
 public:
     CodeGenerator(){
         file_name = "";
         label_counter = 0;
+        debug_info = false;
     }
-    CodeGenerator(string f){
+    CodeGenerator(string f, bool debug = false){
         file_name = f;
         output.open(file_name + ".jasm");
         label_counter = 0;
+        debug_info = debug;
+        line = 0;
+        debug_label_counter = 0;
+        debug_method_start();
+    }
+
+    string get_file_name(){
+        return file_name;
+    }
+    // the class a global variable or function is in: ours, unless it came
+    // from another object's .sym file
+    string class_of(Symbol* s){
+        return (s->get_owner() == -1) ? file_name : Atoms.name(s->get_owner());
+    }
+
+    // the source line of the code being generated from here on
+    void set_line(int l){
+        line = l;
+    }
+    // a local variable comes into scope at the next instruction
+    void local_var(Atom id, VarType type, int slot){
+        if(!debug_info) return;
+        LocalVarRange v;
+        v.start = here();
+        v.type = type == Boolean? "boolean" : "int";
+        v.name = id;
+        v.slot = slot;
+        scopes.back().push_back(local_vars.size());
+        local_vars.push_back(v);
+    }
+    void scope_start(){
+        scopes.push_back(vector<int>());
+    }
+    // the variables of the innermost block go out of scope at the next instruction
+    void scope_end(){
+        if(debug_info){
+            for(int i : scopes.back()) local_vars[i].end = here();
+        }
+        scopes.pop_back();
     }
 
     void push_labels(int num){
@@ -48,86 +168,90 @@ public:
         output << "{" << endl;
     }
     void program_end(){
+        // so that stack traces put the LineNumberTable's lines in our file
+        if(debug_info) output << "sourcefile \"" << file_name << ".scala\"" << endl;
         output << "}" << endl;
     }
-    void dec_global_var(string id){
-        output << "field static int " << id << endl;
+    void dec_global_var(Atom id){
+        output << "field static int " << Atoms.name(id) << endl;
     }
-    void dec_global_var_with_value(string id, int value){
-        output << "field static int " << id << " = " << value << endl;
+    void dec_global_var_with_value(Atom id, int value){
+        output << "field static int " << Atoms.name(id) << " = " << value << endl;
     }
-    void assign_global_var(string id){
-        output << "putstatic int " << file_name << "." << id << endl;
+    void assign_global_var(Symbol* s){
+        emit() << "putstatic int " << class_of(s) << "." << s->get_id_name() << endl;
     }
-    void load_global_var(string id){
-        output << "getstatic int " << file_name << "." << id << endl;
+    void load_global_var(Symbol* s){
+        emit() << "getstatic int " << class_of(s) << "." << s->get_id_name() << endl;
     }
     void assign_local_var(int id){
-        output << "istore " << id << endl;
+        emit() << "istore " << id << endl;
     }
     void load_const_int(int value){
-        output << "sipush " << value << endl;
+        emit() << "sipush " << value << endl;
     }
     void load_const_str(string s){
-        output << "ldc \"" << s << "\"" << endl;
+        emit() << "ldc \"" << s << "\"" << endl;
     }
     void load_local_var(int id){
-        output << "iload " << id << endl; 
+        emit() << "iload " << id << endl; 
     }
     void operation(char op){
         switch(op){
-            case '+': output << "iadd" << endl; break;
-            case '-': output << "isub" << endl; break;
-            case '*': output << "imul" << endl; break;
-            case '/': output << "idiv" << endl; break;
-            case '%': output << "irem" << endl; break;
-            case 'n': output << "ineg" << endl; break;
-            case '&': output << "iand" << endl; break;
-            case '|': output << "ior" << endl; break;
-            case '!': output << "ixor" << endl; break;
+            case '+': emit() << "iadd" << endl; break;
+            case '-': emit() << "isub" << endl; break;
+            case '*': emit() << "imul" << endl; break;
+            case '/': emit() << "idiv" << endl; break;
+            case '%': emit() << "irem" << endl; break;
+            case 'n': emit() << "ineg" << endl; break;
+            case '&': emit() << "iand" << endl; break;
+            case '|': emit() << "ior" << endl; break;
+            case '!': emit() << "ixor" << endl; break;
         };
     }
     void dec_func_start(Symbol* s){
-        vector<VarType> input_types = s->get_input_types();
+        int inputs = s->get_input_count();
         VarType return_type = s->get_return_type();
-        string id = s->get_id_name();
+        const string& id = s->get_id_name();
 
         string stream_return_type = return_type == None? "void" : "int";
         
         output << "method public static " << stream_return_type << " " << id << "(";
-        for(int i = 0; i < input_types.size(); ++i)
+        for(int i = 0; i < inputs; ++i)
         {
             if(i >= 1) output << ", ";
             output << "int";
         }
         output << ")" << endl;
-        output << "max_stack 15" << endl;
         output << "max_locals 15" << endl;
         output << "{" << endl; 
+        debug_method_start();
     }
     void def_func_end(VarType type){
-        if(type == None) output << "return" << endl;
-        else output << "ireturn" << endl; 
+        scope_end();
+        if(type == None) emit() << "return" << endl;
+        else emit() << "ireturn" << endl; 
+        debug_tables();
         output << "}" << endl;
     }
     void def_main_start(){
         output << "method public static void main(java.lang.String[])" << endl; 
-        output << "max_stack 15" << endl; 
         output << "max_locals 15" << endl; 
         output << "{" << endl; 
+        debug_method_start();
     }
     void def_main_end(){
-        output << "return" << endl;
+        emit() << "return" << endl;
         output << ")" << endl;
     }
     void func_call(Symbol* s){
-        vector<VarType> input_types = s->get_input_types();
+        int inputs = s->get_input_count();
         VarType return_type = s->get_return_type();
-        string id = s->get_id_name();
+        const string& id = s->get_id_name();
         string stream_return_type = return_type == None? "void" : "int";
 
-        output << "invokestatic " << stream_return_type << " " << file_name << "." << id << "(";
-        for(int i = 0; i < input_types.size(); ++i)
+        emit() << "invokestatic " << stream_return_type << " " << class_of(s) << "." << id << "(";
+        for(int i = 0; i < inputs; ++i)
         {
             if(i >= 1) output << ", ";
             output << "int";
@@ -135,41 +259,41 @@ public:
         output << ")" << endl;
     }
     void print_start(){
-        output << "getstatic java.io.PrintStream java.lang.System.out" << endl;
+        emit() << "getstatic java.io.PrintStream java.lang.System.out" << endl;
     }
     void print_int_end(){
-        output << "invokevirtual void java.io.PrintStream.print(int)" << endl;
+        emit() << "invokevirtual void java.io.PrintStream.print(int)" << endl;
     }
     void print_str_end(){
-        output << "invokevirtual void java.io.PrintStream.print(java.lang.String)" << endl;
+        emit() << "invokevirtual void java.io.PrintStream.print(java.lang.String)" << endl;
     }
     void println_int_end(){
-        output << "invokevirtual void java.io.PrintStream.println(int)" << endl;
+        emit() << "invokevirtual void java.io.PrintStream.println(int)" << endl;
     }
     void println_str_end(){
-        output << "invokevirtual void java.io.PrintStream.println(java.lang.String)" << endl;
+        emit() << "invokevirtual void java.io.PrintStream.println(java.lang.String)" << endl;
     }
     void relation(string op){
         push_labels(2);
         vector<string>labels = get_labels(0);
 
-        output << "isub" << endl;
-        if(op == "<") {output << "iflt " << labels[0] << endl;}
-        else if (op == ">") {output << "ifgt " << labels[0] << endl;}
-        else if (op == "==") {output << "ifeq " << labels[0] << endl;}
-        else if (op == "<=") {output << "ifle " << labels[0] << endl;}
-        else if (op == ">=") {output << "ifge " << labels[0] << endl;}
-        else if (op == "!=") {output << "ifne " << labels[0] << endl;}
+        emit() << "isub" << endl;
+        if(op == "<") {emit() << "iflt " << labels[0] << endl;}
+        else if (op == ">") {emit() << "ifgt " << labels[0] << endl;}
+        else if (op == "==") {emit() << "ifeq " << labels[0] << endl;}
+        else if (op == "<=") {emit() << "ifle " << labels[0] << endl;}
+        else if (op == ">=") {emit() << "ifge " << labels[0] << endl;}
+        else if (op == "!=") {emit() << "ifne " << labels[0] << endl;}
 
-        output << "iconst_0" << endl;
-        output << "goto " << labels[1] << endl;
+        emit() << "iconst_0" << endl;
+        emit() << "goto " << labels[1] << endl;
 
-        output << labels[0] << ":" << endl;
-        output << "nop" << endl;
+        put_label(labels[0]);
+        emit() << "nop" << endl;
 
-        output << "iconst_1" << endl;
-        output << labels[1] << ":" << endl;
-        output << "nop" << endl;
+        emit() << "iconst_1" << endl;
+        put_label(labels[1]);
+        emit() << "nop" << endl;
 
         pop_labels();
     }
@@ -177,12 +301,12 @@ public:
         else_flag = false;
         push_labels(1);
         vector<string> labels = get_labels(0);
-        output << "ifeq " << labels[0] << endl;
+        emit() << "ifeq " << labels[0] << endl;
     }
     void if_end(){
         vector<string> labels = get_labels(0);
-        output << labels[0] << ":" << endl;
-        output << "nop" << endl;
+        put_label(labels[0]);
+        emit() << "nop" << endl;
         pop_labels();
 
         if(else_flag == true)
@@ -195,16 +319,16 @@ public:
         vector<string> labels0 = get_labels(0);
         push_labels(1);
         vector<string> labels1 = get_labels(0);
-        output << "goto " << labels1[0] << endl;
-        output << labels0[0] << ":" << endl;
-        output << "nop" << endl;
+        emit() << "goto " << labels1[0] << endl;
+        put_label(labels0[0]);
+        emit() << "nop" << endl;
     }
 
     void while_start(){
         push_labels(1);
         vector<string> labels = get_labels(0);
-        output << labels[0] << ":" << endl;
-        output << "nop" << endl;
+        put_label(labels[0]);
+        emit() << "nop" << endl;
     }
     void while_end(){
         string exit = get_labels(0)[0];
@@ -212,9 +336,9 @@ public:
         string begin = get_labels(0)[0];
         pop_labels();
 
-        output << "goto " << begin << endl;
-        output << exit << ":" << endl;
-        output << "nop" << endl;
+        emit() << "goto " << begin << endl;
+        put_label(exit);
+        emit() << "nop" << endl;
     }
 
 };
@@ -1,11 +1,47 @@
+#pragma once
+
 /*
 This file defines the basic value unit "SingleValue" and its function.
 */
 
 #include <string>
+#include <vector>
+#include <unordered_map>
 #include <iostream>
+#include <climits>
+#include <cstdint>
 using namespace std;
-enum VarType{
+
+// The scanner turns each identifier, and the text of each string
+// constant, into an Atom, a small integer, the first time it sees it, and
+// the same text always comes back as the same Atom.  After that they are
+// compared as ints, and each is kept once.
+typedef int Atom;
+
+class AtomTable{
+private:
+	unordered_map<string, Atom> atoms;
+	vector<const string*> names;    // by Atom, the keys of atoms
+	string key;                     // reused, so a lookup doesn't allocate
+public:
+	Atom intern(const char* text, int length){
+		key.assign(text, length);
+		unordered_map<string, Atom>::iterator entry = atoms.find(key);
+		if (entry != atoms.end()) {
+			return entry->second;
+		}
+		entry = atoms.insert(make_pair(key, (Atom) names.size())).first;
+		names.push_back(&entry->first);
+		return entry->second;
+	}
+	const string& name(Atom a){ return *names[a]; }
+	int size(){ return names.size(); }
+};
+
+extern AtomTable Atoms;      // identifiers
+extern AtomTable Strings;    // the text of string constants
+
+enum VarType : unsigned char{
 	Integer,
 	Float,
 	Char,
@@ -14,11 +50,6 @@ enum VarType{
 	None
 };
 
-enum Dec{
-	Const,
-	Var
-};
-
 string VarTypePrint(VarType type){
 	string print_type;
 	switch(type){
@@ -32,6 +63,8 @@ string VarTypePrint(VarType type){
 	return print_type;
 }
 
+// A value is 8 bytes, small enough to pass around by value: strings are
+// kept once each in Strings, and the value holds the Atom for one.
 class SingleValue{
 public:
 	union{
@@ -39,23 +72,29 @@ public:
 		float	fval;
 		bool	bval;
 		char	cval;
-		string*	sval;
+		Atom	sval;
 	};
 	VarType type;
-	bool dirty = true;
-	Dec dec;
+	bool dirty;     // the value is known at compile time
 	VarType get_type(){return type;}
 
-	SingleValue(): type(Integer){dirty = false;}
-	SingleValue(VarType t): type(t){dirty = false;}
+	// defaulted, so that the parser can keep values in its %union.  That
+	// leaves the fields of "SingleValue s;" undefined, like an int's, so
+	// a value is always made with its type, or as SingleValue(), which
+	// zeroes it.
+	SingleValue() = default;
+	SingleValue(VarType t): ival(0), type(t), dirty(false){}
 
-	void set_string(string* s){sval = s; dirty = true;}
+	void set_string(Atom s){sval = s; dirty = true;}
 	void set_int(int s){ival = s; dirty = true;}
-	void set_boolean(bool s){bval = s; dirty = true;}
-	void set_char(char s){cval = s; dirty = true;}
+	// ival = 0 first, so that code reading ival gets the whole value
+	void set_boolean(bool s){ival = 0; bval = s; dirty = true;}
+	void set_char(char s){ival = 0; cval = s; dirty = true;}
 	void set_float(float s){fval = s; dirty = true;}
 };
 
+static_assert(sizeof(SingleValue) <= 8, "SingleValue should fit in a register");
+
 // operator overloading
 
 ostream& operator<<(ostream& os, const SingleValue& dt)
@@ -63,176 +102,201 @@ ostream& operator<<(ostream& os, const SingleValue& dt)
 	switch(dt.type){
 		case Integer: os << dt.ival; break;
 		case Float: os << dt.fval; break;
-		case String: os << *(dt.sval); break;
+		case String: os << Strings.name(dt.sval); break;
 		case Boolean: os << dt.bval; break;
 		case Char: os << dt.cval; break;
+		case None: break;
 	}
     return os;
 }
 
 
-SingleValue operator + (SingleValue lhs, const SingleValue& rhs)
-{
-	SingleValue s = SingleValue(lhs.get_type());
-	if(lhs.dirty == false || rhs.dirty == false)
-		return s;
-
-	switch(s.get_type())
-	{
-		case Integer: s.set_int(lhs.ival + rhs.ival); break;
-		case Float: s.set_float(lhs.fval + rhs.fval); break;
-	}
-	return s;
-}
+// The operators, and what each one does with each type, are one table,
+// Operators[operator].types[type], worked out by the templates below when
+// the compiler is built.  The parser checks types against it and folds
+// constants with it, so the rules for an operator are only written here.
+enum Operator : unsigned char{
+	Add,
+	Subtract,
+	Multiply,
+	Divide,
+	Less,
+	Greater,
+	LessEqual,
+	Equal,
+	GreaterEqual,
+	NotEqual,
+	And,
+	Or,
+	Negate,
+	Not,
+	OperatorCount
+};
 
-SingleValue operator - (SingleValue lhs, const SingleValue& rhs)
-{
-	SingleValue s = SingleValue(lhs.get_type());
-	if(lhs.dirty == false || rhs.dirty == false)
-		return s;
-
-	switch(s.get_type())
-	{
-		case Integer: s.set_int(lhs.ival - rhs.ival); break;
-		case Float: s.set_float(lhs.fval - rhs.fval); break;
-	}
-	return s;
-}
+// the member of SingleValue each type is kept in
+template<VarType t> struct Field;
+template<> struct Field<Integer>{
+	static int get(const SingleValue& v){ return v.ival; }
+	static void set(SingleValue& v, int x){ v.set_int(x); }
+};
+template<> struct Field<Float>{
+	static float get(const SingleValue& v){ return v.fval; }
+	static void set(SingleValue& v, float x){ v.set_float(x); }
+};
+template<> struct Field<Char>{
+	static char get(const SingleValue& v){ return v.cval; }
+	static void set(SingleValue& v, char x){ v.set_char(x); }
+};
+template<> struct Field<String>{
+	static Atom get(const SingleValue& v){ return v.sval; }
+	static void set(SingleValue& v, Atom x){ v.set_string(x); }
+};
+template<> struct Field<Boolean>{
+	static bool get(const SingleValue& v){ return v.bval; }
+	static void set(SingleValue& v, bool x){ v.set_boolean(x); }
+};
 
-SingleValue operator * (SingleValue lhs, const SingleValue& rhs)
-{
-	SingleValue s = SingleValue(lhs.get_type());
-	if(lhs.dirty == false || rhs.dirty == false)
-		return s;
-
-	switch(s.get_type())
-	{
-		case Integer: s.set_int(lhs.ival * rhs.ival); break;
-		case Float: s.set_float(lhs.fval * rhs.fval); break;
-	}
-	return s;
-}
+// the types an operator takes, one bit for each
+const int Numbers = 1 << Integer | 1 << Float;
+const int Ordered = Numbers | 1 << Boolean;
+const int Anything = Ordered | 1 << Char | 1 << String;
+const int Truth = 1 << Boolean;
 
-SingleValue operator / (SingleValue lhs, const SingleValue& rhs)
-{
-	SingleValue s = SingleValue(lhs.get_type());
-	if(lhs.dirty == false || rhs.dirty == false)
-		return s;
-
-	switch(s.get_type())
-	{
-		case Integer: s.set_int(lhs.ival / rhs.ival); break;
-		case Float: s.set_float(lhs.fval / rhs.fval); break;
-	}
-	return s;
-}
+// what is the same for every operator of a kind: the types it takes,
+// whether it answers with a Boolean, and whether it has one operand
+template<int takes, bool compares, bool unary = false>
+struct OperatorKind{
+	static constexpr bool accepts(VarType t){ return (takes >> t) & 1; }
+	static constexpr VarType result(VarType t){ return compares ? Boolean : t; }
+	static constexpr bool is_unary(){ return unary; }
+	// false for operands the compiler shouldn't work out itself
+	template<class T> static bool folds(T, T){ return true; }
+};
 
-SingleValue operator < (SingleValue lhs, const SingleValue& rhs)
-{
-	SingleValue s = SingleValue(Boolean);
-	if(lhs.dirty == false || rhs.dirty == false)
-		return s;
-
-	switch(lhs.get_type())
-	{
-		case Integer: s.set_boolean(lhs.ival < rhs.ival); break;
-		case Float: s.set_boolean(lhs.fval < rhs.fval); break;
-		case Boolean: s.set_boolean(lhs.bval < rhs.bval); break;
-	}
-	
-	return s;
-}
+// the type T's arithmetic is done in.  An int overflowing is undefined
+// in C++, but wraps around on the JVM, so ints are added, subtracted,
+// multiplied and negated as uint32_t, which wraps, and cast back.
+template<class T> struct Arithmetic{ typedef T type; };
+template<> struct Arithmetic<int>{ typedef uint32_t type; };
 
-SingleValue operator > (SingleValue lhs, const SingleValue& rhs)
-{
-	SingleValue s = SingleValue(Boolean);
-	if(lhs.dirty == false || rhs.dirty == false)
-		return s;
-
-	switch(lhs.get_type())
-	{
-		case Integer: s.set_boolean(lhs.ival > rhs.ival); break;
-		case Float: s.set_boolean(lhs.fval > rhs.fval); break;
-		case Boolean: s.set_boolean(lhs.bval > rhs.bval); break;
+template<Operator op> struct Rule;
+template<> struct Rule<Add>: OperatorKind<Numbers, false>{
+	template<class T> static T apply(T a, T b){
+		typedef typename Arithmetic<T>::type U;
+		return (T) ((U) a + (U) b);
 	}
-	return s;
-}
-
-SingleValue operator <= (SingleValue lhs, const SingleValue& rhs)
-{
-	SingleValue s = SingleValue(Boolean);
-	if(lhs.dirty == false || rhs.dirty == false)
-		return s;
-
-	switch(lhs.get_type())
-	{
-		case Integer: s.set_boolean(lhs.ival <= rhs.ival); break;
-		case Float: s.set_boolean(lhs.fval <= rhs.fval); break;
-		case Boolean: s.set_boolean(lhs.bval <= rhs.bval); break;
+};
+template<> struct Rule<Subtract>: OperatorKind<Numbers, false>{
+	template<class T> static T apply(T a, T b){
+		typedef typename Arithmetic<T>::type U;
+		return (T) ((U) a - (U) b);
 	}
-	return s;
-}
-
-SingleValue operator == (SingleValue lhs, const SingleValue& rhs)
-{
-	SingleValue s = SingleValue(Boolean);
-	if(lhs.dirty == false || rhs.dirty == false)
-		return s;
-
-	switch(lhs.get_type())
-	{
-		case Integer: s.set_boolean(lhs.ival == rhs.ival); break;
-		case Float: s.set_boolean(lhs.fval == rhs.fval); break;
-		case Boolean: s.set_boolean(lhs.bval == rhs.bval); break;
-		case String: s.set_boolean(*(lhs.sval) == *(rhs.sval)); break;
-		case Char: s.set_boolean(lhs.cval == rhs.cval); break;
+};
+template<> struct Rule<Multiply>: OperatorKind<Numbers, false>{
+	template<class T> static T apply(T a, T b){
+		typedef typename Arithmetic<T>::type U;
+		return (T) ((U) a * (U) b);
 	}
-	return s;
-}
+};
+template<> struct Rule<Divide>: OperatorKind<Numbers, false>{
+	template<class T> static T apply(T a, T b){ return a / b; }
+	// left for idiv, which throws, or wraps around
+	static bool folds(int a, int b){ return b != 0 && !(b == -1 && a == INT_MIN); }
+	static bool folds(float, float){ return true; }
+};
+template<> struct Rule<Less>: OperatorKind<Ordered, true>{
+	template<class T> static bool apply(T a, T b){ return a < b; }
+};
+template<> struct Rule<Greater>: OperatorKind<Ordered, true>{
+	template<class T> static bool apply(T a, T b){ return a > b; }
+};
+template<> struct Rule<LessEqual>: OperatorKind<Ordered, true>{
+	template<class T> static bool apply(T a, T b){ return a <= b; }
+};
+template<> struct Rule<Equal>: OperatorKind<Anything, true>{
+	template<class T> static bool apply(T a, T b){ return a == b; }
+};
+template<> struct Rule<GreaterEqual>: OperatorKind<Ordered, true>{
+	template<class T> static bool apply(T a, T b){ return a >= b; }
+};
+template<> struct Rule<NotEqual>: OperatorKind<Anything, true>{
+	template<class T> static bool apply(T a, T b){ return a != b; }
+};
+template<> struct Rule<And>: OperatorKind<Truth, true>{
+	template<class T> static bool apply(T a, T b){ return a && b; }
+};
+template<> struct Rule<Or>: OperatorKind<Truth, true>{
+	template<class T> static bool apply(T a, T b){ return a || b; }
+};
+template<> struct Rule<Negate>: OperatorKind<Numbers, false, true>{
+	template<class T> static T apply(T a, T){
+		typedef typename Arithmetic<T>::type U;
+		return (T) -(U) a;
+	}
+};
+template<> struct Rule<Not>: OperatorKind<Truth, false, true>{
+	template<class T> static bool apply(T a, T){ return !a; }
+};
 
-SingleValue operator >= (SingleValue lhs, const SingleValue& rhs)
-{
-	SingleValue s = SingleValue(Boolean);
-	if(lhs.dirty == false || rhs.dirty == false)
-		return s;
-
-	switch(lhs.get_type())
-	{
-		case Integer: s.set_boolean(lhs.ival >= rhs.ival); break;
-		case Float: s.set_boolean(lhs.fval >= rhs.fval); break;
-		case Boolean: s.set_boolean(lhs.bval >= rhs.bval); break;
+// a value of the result's type, worked out when both operands are known
+template<Operator op, VarType t>
+SingleValue Fold(SingleValue lhs, SingleValue rhs){
+	SingleValue s(Rule<op>::result(t));
+	if(lhs.dirty && rhs.dirty && Rule<op>::folds(Field<t>::get(lhs), Field<t>::get(rhs))){
+		Field<Rule<op>::result(t)>::set(s, Rule<op>::apply(Field<t>::get(lhs), Field<t>::get(rhs)));
 	}
 	return s;
 }
 
-SingleValue operator != (SingleValue lhs, const SingleValue& rhs)
-{
-	SingleValue s = SingleValue(Boolean);
-	if(lhs.dirty == false || rhs.dirty == false)
-		return s;
-
-	switch(lhs.get_type())
-	{
-		case Integer: s.set_boolean(lhs.ival != rhs.ival); break;
-		case Float: s.set_boolean(lhs.fval != rhs.fval); break;
-		case Boolean: s.set_boolean(lhs.bval != rhs.bval); break;
-		case String: s.set_boolean(*(lhs.sval) != *(rhs.sval)); break;
-		case Char: s.set_boolean(lhs.cval != rhs.cval); break;
-	}
-	return s;
+// One cell of the table.  fold is NULL where the operator doesn't take
+// the type; a unary operator is folded with its operand as both sides.
+struct OperatorEntry{
+	VarType result;
+	SingleValue (*fold)(SingleValue, SingleValue);
+};
+
+struct OperatorRow{
+	const char* symbol;
+	bool unary;
+	OperatorEntry types[None + 1];
+};
+
+template<Operator op, VarType t, bool takes = Rule<op>::accepts(t)>
+struct Entry{
+	static constexpr OperatorEntry get(){ return OperatorEntry{Rule<op>::result(t), Fold<op, t>}; }
+};
+template<Operator op, VarType t>
+struct Entry<op, t, false>{
+	static constexpr OperatorEntry get(){ return OperatorEntry{None, NULL}; }
+};
+
+template<Operator op>
+constexpr OperatorRow Row(const char* symbol){
+	return OperatorRow{symbol, Rule<op>::is_unary(), {
+		Entry<op, Integer>::get(), Entry<op, Float>::get(), Entry<op, Char>::get(),
+		Entry<op, String>::get(), Entry<op, Boolean>::get(), Entry<op, None>::get()
+	}};
 }
 
-SingleValue operator && (SingleValue lhs, const SingleValue& rhs)
-{
-	SingleValue s = SingleValue(Boolean);
-	if(lhs.dirty == false || rhs.dirty == false)
-		return s;
-
-	switch(lhs.get_type())
-	{
-		case Integer: s.set_boolean(lhs.ival != rhs.ival); break;
-		case Float: s.set_boolean(lhs.fval != rhs.fval); break;
-		case Boolean: s.set_boolean(lhs.bval != rhs.bval); break;
+// in the order of Operator
+constexpr OperatorRow Operators[OperatorCount] = {
+	Row<Add>("+"), Row<Subtract>("-"), Row<Multiply>("*"), Row<Divide>("/"),
+	Row<Less>("<"), Row<Greater>(">"), Row<LessEqual>("<="), Row<Equal>("=="),
+	Row<GreaterEqual>(">="), Row<NotEqual>("!="), Row<And>("&&"), Row<Or>("||"),
+	Row<Negate>("-"), Row<Not>("!")
+};
+
+// "Integer, Float, or Boolean": the types op takes, for error messages
+string OperatorTypes(Operator op){
+	vector<string> names;
+	for(int t = Integer; t < None; ++t){
+		if(Operators[op].types[t].fold != NULL) names.push_back(VarTypePrint((VarType) t));
 	}
-	return s;
+	string list = names.empty() ? "" : names[0];
+	for(size_t i = 1; i < names.size(); ++i){
+		list += (names.size() > 2 ? ", " : " ");
+		if(i + 1 == names.size()) list += "or ";
+		list += names[i];
+	}
+	return list;
 }
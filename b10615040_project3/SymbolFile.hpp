@@ -0,0 +1,203 @@
+#pragma once
+
+/*
+An object's .sym file is its global symbols, written out at the end of a
+compile so that another object can use them (compiler -i Other.sym)
+without Other being parsed again.  It is only a cache for the compiler on
+this machine, so numbers are written the way the machine keeps them.
+
+    "SYM1"
+    the class name: u16 length, then the bytes
+    u32 number of symbols, then for each one
+        u8 declaration, u8 type, u8 1 if a value follows
+        the name: u16 length, then the bytes
+        Array: u32 length
+        Function: u16 number of arguments, then a u8 type for each
+        the value of a Constant: i32, f32, or u32 length and the bytes
+            of a string
+
+The type is a Function's return type and the type of an Array's
+elements.  Constants are the only values written, since the value a
+variable has when the compile ends means nothing to anyone else.
+*/
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "SymbolTable.hpp"
+
+using namespace std;
+
+class SymbolFileWriter{
+private:
+	string bytes;
+public:
+	void put(const void* p, size_t n){ bytes.append((const char*) p, n); }
+	void u8(int v){ unsigned char c = v; put(&c, 1); }
+	void u16(int v){ unsigned short s = v; put(&s, 2); }
+	void u32(int v){ unsigned int i = v; put(&i, 4); }
+	void text(const string& s){ u16(s.size()); put(s.data(), s.size()); }
+	bool write(const string& path){
+		FILE* f = fopen(path.c_str(), "wb");
+		if(f == NULL) return false;
+		bool ok = fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+		return (fclose(f) == 0) && ok;
+	}
+};
+
+// takes a .sym file apart where it lies in memory; ok goes false, and
+// stays false, the first time anything runs past the end
+class SymbolFileReader{
+private:
+	const char* p;
+	const char* end;
+public:
+	bool ok;
+	SymbolFileReader(const char* start, size_t length): p(start), end(start + length), ok(true){}
+	const char* get(size_t n){
+		if(!ok || (size_t) (end - p) < n){ ok = false; return NULL; }
+		const char* at = p;
+		p += n;
+		return at;
+	}
+	int u8(){ const char* at = get(1); return at ? (unsigned char) *at : 0; }
+	int u16(){ unsigned short s = 0; const char* at = get(2); if(at) memcpy(&s, at, 2); return s; }
+	unsigned int u32(){ unsigned int i = 0; const char* at = get(4); if(at) memcpy(&i, at, 4); return i; }
+	float f32(){ float f = 0; const char* at = get(4); if(at) memcpy(&f, at, 4); return f; }
+	// the bytes of a name stay in the file; only the Atom is kept
+	Atom name(){
+		int length = u16();
+		const char* at = get(length);
+		return at ? Atoms.intern(at, length) : -1;
+	}
+	bool done(){ return ok && p == end; }
+};
+
+// writes class_name.sym, with every global of ours but the object itself
+bool WriteSymbolFile(const string& class_name, SymbolTableList& table){
+	vector<Symbol*> globals = table.globals();
+	vector<Symbol*> exports;
+	for(size_t i = 0; i < globals.size(); ++i){
+		if(globals[i]->get_owner() == -1 && globals[i]->get_declaration() != Object){
+			exports.push_back(globals[i]);
+		}
+	}
+
+	SymbolFileWriter out;
+	out.put("SYM1", 4);
+	out.text(class_name);
+	out.u32(exports.size());
+	for(size_t i = 0; i < exports.size(); ++i){
+		Symbol* s = exports[i];
+		SymbolDeclaration declaration = s->get_declaration();
+		SingleValue* value = s->get_value();
+		bool has_value = declaration == Constant && value->dirty;
+		out.u8(declaration);
+		out.u8(declaration == Function ? s->get_return_type() : s->get_type());
+		out.u8(has_value);
+		out.text(s->get_id_name());
+		if(declaration == Array){
+			out.u32(s->get_length());
+		}
+		if(declaration == Function){
+			out.u16(s->get_input_count());
+			for(int j = 0; j < s->get_input_count(); ++j) out.u8(s->get_input_type(j));
+		}
+		if(has_value){
+			switch(value->get_type()){
+				case Float: out.put(&value->fval, 4); break;
+				case String: {
+					const string& text = Strings.name(value->sval);
+					out.u32(text.size());
+					out.put(text.data(), text.size());
+					break;
+				}
+				case Boolean: out.u32(value->bval); break;
+				case Char: out.u32(value->cval); break;
+				default: out.u32(value->ival); break;
+			}
+		}
+	}
+	return out.write(class_name + ".sym");
+}
+
+// puts the symbols of a .sym file into the outermost scope.  Returns
+// what was wrong with it, or "" if nothing was.
+string ReadSymbolFile(const string& path, SymbolTableList& table){
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0) return "can't open " + path;
+	struct stat info;
+	if(fstat(fd, &info) != 0 || info.st_size == 0){
+		close(fd);
+		return path + " is empty";
+	}
+	void* map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) return "can't read " + path;
+
+	string problem = "";
+	SymbolFileReader in((const char*) map, info.st_size);
+	const char* magic = in.get(4);
+	if(magic == NULL || memcmp(magic, "SYM1", 4) != 0){
+		problem = path + " is not a .sym file";
+	}
+	Atom owner = in.name();
+	unsigned int count = in.u32();
+	for(unsigned int i = 0; problem == "" && i < count && in.ok; ++i){
+		int declaration = in.u8();
+		VarType type = (VarType) in.u8();
+		bool has_value = in.u8();
+		Atom id = in.name();
+		if(!in.ok || declaration < Constant || declaration > Array || type < Integer || type > None){
+			problem = path + " is damaged";
+			break;
+		}
+
+		Symbol* s;
+		if(declaration == Array){
+			unsigned int length = in.u32();
+			if(!in.ok || length < 1 || length > (unsigned int) MaxArrayLength){
+				problem = path + " is damaged";
+				break;
+			}
+			s = Symbols.array(id, type, length);
+		}
+		else if(declaration == Function){
+			int arguments = in.u16();
+			s = Symbols.function(id, arguments);
+			for(int j = 0; j < arguments; ++j) s->set_input_type(j, (VarType) in.u8());
+			s->set_return_type(type);
+		}
+		else if(has_value){
+			SingleValue value(type);
+			switch(type){
+				case Float: value.set_float(in.f32()); break;
+				case String: {
+					unsigned int length = in.u32();
+					const char* text = in.get(length);
+					value.set_string(Strings.intern(text ? text : "", text ? length : 0));
+					break;
+				}
+				case Boolean: value.set_boolean(in.u32()); break;
+				case Char: value.set_char(in.u32()); break;
+				default: value.set_int(in.u32()); break;
+			}
+			s = Symbols.variable(id, (SymbolDeclaration) declaration, value);
+		}
+		else{
+			s = Symbols.variable(id, (SymbolDeclaration) declaration, type);
+		}
+		s->set_owner(owner);
+		if(in.ok && table.insert(s) == -1){
+			problem = "ID: " + Atoms.name(id) + " from " + path + " is already in SymbolTables";
+		}
+	}
+	if(problem == "" && !in.done()) problem = path + " is damaged";
+	munmap(map, info.st_size);
+	return problem;
+}
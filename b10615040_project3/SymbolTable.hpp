@@ -9,6 +9,9 @@ This file defines the class and function of each symbols and symboltable.
 #include <utility>
 #include <vector>
 #include <iostream>
+#include <new>
+#include <chrono>
+#include <cassert>
 #include "SingleValue.hpp"
 
 using namespace std;
@@ -21,254 +24,393 @@ enum SymbolDeclaration{
 	Object
 };
 
+// Every kind of symbol is the same struct, and declaration says which of
+// its fields mean anything.  They all come from the SymbolArena.
 class Symbol{
 private:
-    string id_name;
+    Atom id;
     SymbolDeclaration declaration;
-    
+    VarType type;               // Array: of the elements; Function: what it returns
+    int count;                  // Array: its length; Function: how many arguments
+    Atom owner;                 // the class it was imported from, -1 for ours
+    union{
+        SingleValue* elements;  // Array
+        VarType* input_types;   // Function
+    };
+    SingleValue content;        // Constant, Variable
+
+    Symbol(Atom id, SymbolDeclaration declaration, VarType type)
+        : id(id), declaration(declaration), type(type), count(0), owner(-1), elements(NULL), content(type){}
+    friend class SymbolArena;
+
 public:
-    Symbol(string id, SymbolDeclaration declaration):id_name(id), declaration(declaration){}
-    
-    string get_id_name(){ return id_name; }
+    Atom get_id(){ return id; }
+    Atom get_owner(){ return owner; }
+    void set_owner(Atom a){ owner = a; }
+    const string& get_id_name(){ return Atoms.name(id); }
 	SymbolDeclaration get_declaration(){return declaration;}
-    
-	// for VarSymbol
-	virtual bool is_dirty(){return false;}
-	virtual VarType get_type(){return None;}
-	virtual void set_value(SingleValue t) {}
-	virtual SingleValue* get_value(){return NULL;}
+	bool is_value(){ return declaration == Constant || declaration == Variable; }
 
-	// for ArraySymbol
-	virtual void assign_value(SingleValue value, int index){}
-	virtual void assign_array(SingleValue* value){}
-	virtual SingleValue* get_value(int index){return NULL;}
+	// for Constant and Variable
+	bool is_dirty(){ return is_value() && content.dirty; }
+	VarType get_type(){
+		if(is_value()) return content.get_type();
+		if(declaration == Array) return type;
+		return None;
+	}
+	void set_value(SingleValue t){ if(is_value()) content = t; }
+	SingleValue* get_value(){ return is_value() ? &content : NULL; }
+
+	// for Array; the parser checks that an index is in range
+	int get_length(){ return (declaration == Array) ? count : 0; }
+	void assign_value(SingleValue value, int index){
+		if(declaration != Array) return;
+		assert(index >= 0 && index < count);
+		elements[index] = value;
+	}
+	SingleValue* get_value(int index){
+		if(declaration != Array) return NULL;
+		assert(index >= 0 && index < count);
+		return &elements[index];
+	}
 
+	// for Function
+	void set_input_type(int i, VarType vt){ input_types[i] = vt; }
+	void set_return_type(VarType vt){ type = vt; }
+	VarType get_return_type(){ return (declaration == Function) ? type : None; }
+	int get_input_count(){ return (declaration == Function) ? count : 0; }
+	VarType get_input_type(int i){ return input_types[i]; }
 
-	// for FuncSymbol
-	virtual bool check_input_types(vector<SingleValue*>* input){return false;}
-	virtual VarType get_return_type(){return None;}
-	virtual vector<VarType> get_input_types() { return vector<VarType>();}
+	bool check_input_types(SingleValue* input, int n){
+		if(declaration != Function) return false;
+		if(n != count) return false;
+		for(int i = 0; i < n; ++i){
+			if(input[i].get_type() != input_types[i]) return false;
+		}
+		return true;
+	}
 
 	// for all
-    virtual void print_info(){
-		string print_declaration = "Constant";
+	const char* declaration_name(){
 		switch(declaration){
-			case Variable: print_declaration = "Variable"; break;
-			case Function: print_declaration = "Function"; break;
-			case Object: print_declaration = "Object"; break;
-			case Array: print_declaration = "Array"; break;
+			case Constant: return "Constant";
+			case Variable: return "Variable";
+			case Function: return "Function";
+			case Object: return "Object";
+			case Array: return "Array";
 		}
-		cout << "id: " << id_name << ", declaration: " << print_declaration;
+		return "";
 	}
-};
-
-class VarSymbol: public Symbol{
-private:
-    SingleValue content;
-public:
-	VarSymbol(string id, SymbolDeclaration declaration, VarType type): Symbol(id, declaration), content(type)
-	{}
-	VarSymbol(string id, SymbolDeclaration declaration, SingleValue s): Symbol(id, declaration), content(s)
-	{}
-
-	bool is_dirty(){return content.dirty;}
-	VarType get_type(){return content.get_type();}
-	void set_value(SingleValue t) {content = t;}
-	SingleValue* get_value(){ return &content; }
 
     void print_info(){
-        Symbol::print_info();
-        cout << ", type: " << VarTypePrint(content.type);
-		if(is_dirty()) cout << ", value: " << content; 
-    }
-};
-
-class ArraySymbol: public Symbol{
-private:
-    SingleValue* content;
-	VarType type;
-	int length;
-public:
-	ArraySymbol(string id, VarType type, int length): Symbol(id, Array), type(type), length(length){
-		content = new SingleValue[length];
+		cout << "id: " << get_id_name() << ", declaration: " << declaration_name();
+		switch(declaration){
+			case Constant:
+			case Variable:
+				cout << ", type: " << VarTypePrint(content.type);
+				if(is_dirty()) cout << ", value: " << content;
+				break;
+			case Array:
+				cout << ", type: " << VarTypePrint(type);
+				cout << ", length: " << count;
+				cout << ", value: {";
+				for(int i = 1; i < count; ++i){
+					if(elements[i].dirty){
+						cout << " " << i << ":" << elements[i] << ",";
+					}
+				}
+				cout << "}";
+				break;
+			case Function:
+				cout << ", input_types: {";
+				for(int i = 0; i < count; ++i){
+					if(i > 0) cout << ", ";
+					cout << VarTypePrint(input_types[i]);
+				}
+				cout << "}" << ", return_type: " << VarTypePrint(type);
+				break;
+			case Object:
+				break;
+		}
 	}
 
-	void assign_value(SingleValue value, int index){
-		content[index] = value;
+	// the same as a JSON object, without the closing brace, so that the
+	// caller can add what the table knows about it (see dump_scope)
+	void print_json(ostream& os){
+		os << "{\"name\":";
+		print_json_string(os, get_id_name());
+		os << ",\"declaration\":\"" << declaration_name() << "\"";
+		switch(declaration){
+			case Constant:
+			case Variable:
+				os << ",\"type\":\"" << VarTypePrint(content.type) << "\"";
+				if(is_dirty()){
+					os << ",\"value\":";
+					switch(content.type){
+						case Integer: os << content.ival; break;
+						case Float: os << content.fval; break;
+						case Boolean: os << (content.bval ? "true" : "false"); break;
+						case Char: print_json_string(os, string(1, content.cval)); break;
+						case String: print_json_string(os, Strings.name(content.sval)); break;
+						default: os << "null"; break;
+					}
+				}
+				break;
+			case Array:
+				os << ",\"type\":\"" << VarTypePrint(type) << "\",\"length\":" << count;
+				break;
+			case Function:
+				os << ",\"inputs\":[";
+				for(int i = 0; i < count; ++i){
+					if(i > 0) os << ",";
+					os << "\"" << VarTypePrint(input_types[i]) << "\"";
+				}
+				os << "],\"returns\":\"" << VarTypePrint(type) << "\"";
+				break;
+			default:
+				break;
+		}
 	}
-
-	void assign_array(SingleValue* value){
-		content = value;
+	static void print_json_string(ostream& os, const string& s){
+		os << "\"";
+		for(size_t i = 0; i < s.size(); ++i){
+			if(s[i] == '"' || s[i] == '\\') os << '\\' << s[i];
+			else if((unsigned char) s[i] < ' ') os << "\\u00" << "0123456789abcdef"[s[i] >> 4] << "0123456789abcdef"[s[i] & 15];
+			else os << s[i];
+		}
+		os << "\"";
 	}
+};
 
-	SingleValue* get_value(int index){
-		return &content[index];
-	}
+// Symbols, and the arrays of elements and argument types that go with
+// them, are carved one after another out of big blocks, and the blocks
+// are all given back at once when the compile is over.
+class SymbolArena{
+private:
+	static const size_t BlockSize = 64 * 1024;
+	vector<char*> blocks;
+	size_t used;            // of the last block
+	size_t size;
 
-	VarType get_type(){return type;}
-	
-	void print_info(){
-        Symbol::print_info();
-        cout << ", type: " << VarTypePrint(type);
-		cout << ", length: " << length;
-		cout << ", value: {";
-		for(int i = 1; i < length; ++i){
-			if(content[i].dirty){
-				cout << " " << i << ":" << content[i] << ",";
-			}
+	void* allocate(size_t bytes){
+		bytes = (bytes + 15) & ~(size_t) 15;
+		if(blocks.empty() || used + bytes > size){
+			size = (bytes > BlockSize) ? bytes : BlockSize;
+			blocks.push_back(new char[size]);
+			used = 0;
 		}
-		cout << "}";
+		void* p = blocks.back() + used;
+		used += bytes;
+		return p;
+	}
+	Symbol* make(Atom id, SymbolDeclaration declaration, VarType type){
+		return new (allocate(sizeof(Symbol))) Symbol(id, declaration, type);
 	}
-};
 
-class FuncSymbol: public Symbol{
-private:
-    vector<VarType> input_types; 
-	VarType return_type;
 public:
-	FuncSymbol(string id, SymbolDeclaration declaration): Symbol(id, declaration){ return_type = None;}
+	SymbolArena(): used(0), size(0){}
+	~SymbolArena(){ release(); }
 
-	void add_input_type(VarType vt){
-		input_types.push_back(vt);
+	Symbol* object(Atom id){
+		return make(id, Object, None);
+	}
+	Symbol* variable(Atom id, SymbolDeclaration declaration, VarType type){
+		return make(id, declaration, type);
+	}
+	Symbol* variable(Atom id, SymbolDeclaration declaration, SingleValue s){
+		Symbol* symbol = make(id, declaration, s.get_type());
+		symbol->content = s;
+		return symbol;
+	}
+	Symbol* array(Atom id, VarType type, int length){
+		Symbol* symbol = make(id, Array, type);
+		symbol->count = length;
+		symbol->elements = (SingleValue*) allocate(length * sizeof(SingleValue));
+		for(int i = 0; i < length; ++i) new (&symbol->elements[i]) SingleValue(type);
+		return symbol;
+	}
+	// the argument types are filled in with set_input_type
+	Symbol* function(Atom id, int arguments){
+		Symbol* symbol = make(id, Function, None);
+		symbol->count = arguments;
+		symbol->input_types = (VarType*) allocate(arguments * sizeof(VarType));
+		return symbol;
 	}
 
-	void set_return_type(VarType vt){
-		return_type = vt;
+	// every symbol made so far goes
+	void release(){
+		for(size_t i = 0; i < blocks.size(); ++i) delete[] blocks[i];
+		blocks.clear();
+		used = size = 0;
 	}
+};
 
-	VarType get_return_type(){return return_type;}
-	vector<VarType> get_input_types() { return input_types; }
+extern SymbolArena Symbols;
 
-	bool check_input_types(vector<SingleValue*>* input){
-		if(input->size() != input_types.size()) return false;
-		for(int i = 0; i < input->size(); ++i){
-			if((*input)[i]->get_type() != input_types[i]){
-				cout << i << ":"<< (*input)[i]->get_type() << " " << input_types[i] << endl;
-				return false;
-			}
-		}
-		return true;
-	}
+// the longest array a program may declare, or a .sym file may hold; its
+// elements are all kept in the table
+const int MaxArrayLength = 1 << 24;
 
-    void print_info(){
-        Symbol::print_info();
-        cout << ", input_types: {";
-		for(int i = 0; i < input_types.size(); ++i){
-			if(i > 0) cout << ", ";
-			cout << VarTypePrint(input_types[i]);
-		}
-		cout << "}" << ", return_type: " << VarTypePrint(return_type);
-    }
+// one name declared in one scope
+struct Binding{
+	Atom name;
+	Symbol* symbol;
+	int depth;      // 0 for the globals
+	int slot;       // the local variable it is kept in, -1 if it isn't one
+	int shadowed;   // the binding of the same name further out, -1 if none
 };
 
-class SymbolTable{
+// A scope is the bindings made since it was pushed.  Every binding, from
+// every open scope, is kept in one vector, in the order they were made,
+// and current[name] is the innermost binding of each name.  Going out of
+// a scope takes its bindings back off the end of the vector, putting back
+// the ones they shadowed, so a name is found in one step however deeply
+// the scopes are nested.
+//
+// With --stats the table counts what it does, so that it can be sized
+// from real programs, and with --dump each scope is written out as JSON
+// as it is closed.
+class SymbolTableList{
 private:
-	map<string, pair<int, Symbol*>> table;
-public:
-	int last_index;
-	SymbolTable(){ last_index = 0;}
-	SymbolTable(int index){ last_index = index;}
+	struct Scope{
+		int first;      // its first binding
+		int last_index; // the slot its next local variable gets
+	};
+	vector<Binding> bindings;
+	vector<int> current;    // by Atom, the innermost binding, -1 if none
+	vector<Scope> scopes;
+	int top;
 
-    Symbol* lookup(string s){
-		if (table.find(s) != table.end()) {
-		    return table[s].second;
-		}
-		else {
-		    return NULL;
-		}
-    }
+	bool counting;
+	bool dumping;
+	long lookups;
+	long misses;
+	long inserts;           // that made a binding
+	long scopes_closed;
+	long entries;           // in all the scopes closed
+	int max_entries;        // in any one scope
+	int max_depth;
+	chrono::steady_clock::duration resolving;
 
-	int get_index(string s){
-		if (table.find(s) != table.end()) {
-		    return table[s].first;
-		}
-		else {
-		    return -1;
-		}
+	const Binding* find(Atom s){
+		if(s >= (int) current.size() || current[s] == -1) return NULL;
+		return &bindings[current[s]];
 	}
-
-    int insert(Symbol* s){
-		if (table.find(s->get_id_name()) != table.end()) {
-			return -1;
-		}
-		else {
-			if(s->get_declaration() == Variable){
-				table[s->get_id_name()] = pair<int, Symbol*>(last_index, s);
-				++last_index;
-			}
-			else{
-				table[s->get_id_name()] = pair<int, Symbol*>(-1, s);
-			}
-			return 1;
+	void open(int last_index){
+		Scope scope;
+		scope.first = bindings.size();
+		scope.last_index = last_index;
+		scopes.push_back(scope);
+		++top;
+		if(top > max_depth) max_depth = top;
+	}
+	const Binding* counted_resolve(Atom s){
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		const Binding* b = find(s);
+		resolving += chrono::steady_clock::now() - start;
+		++lookups;
+		if(b == NULL) ++misses;
+		return b;
+	}
+	void dump_scope(ostream& os){
+		os << "{\"depth\":" << top << ",\"symbols\":[";
+		for(int i = scopes[top].first; i < (int) bindings.size(); ++i){
+			if(i > scopes[top].first) os << ",";
+			bindings[i].symbol->print_json(os);
+			if(bindings[i].slot != -1) os << ",\"slot\":" << bindings[i].slot;
+			os << "}";
 		}
-    }
-	int get_last_index(){
-		return last_index;
+		os << "]}" << endl;
 	}
-
-    // void dump(){
-    // 	for(auto p : table){
-    // 		p.second->print_info();
-    // 		cout << endl;
-    // 	}
-    // }
-};
-
-class SymbolTableList{
-private:
-	vector<SymbolTable> tables;
-	int top;
 public:
 	SymbolTableList(){ 
 		top = -1; 
+		counting = dumping = false;
+		lookups = misses = inserts = scopes_closed = entries = 0;
+		max_entries = max_depth = 0;
+		resolving = chrono::steady_clock::duration::zero();
 		push(); 
 	}
+	void set_stats(bool on){ counting = on; }
+	void set_dump(bool on){ dumping = on; }
 	int get_top(){
 		return top;
 	}
 	void push(){
-		++top;
-		tables.push_back(SymbolTable());
+		open(0);
 	}
 	void push_block(){
-		int last_index = tables[top].get_last_index();
-		++top;
-		tables.push_back(SymbolTable(last_index + 1));
+		open(scopes[top].last_index + 1);
 	}
 	void pop(){
+		int closing = bindings.size() - scopes[top].first;
+		if(dumping) dump_scope(cerr);
+		++scopes_closed;
+		entries += closing;
+		if(closing > max_entries) max_entries = closing;
+		while((int) bindings.size() > scopes[top].first){
+			current[bindings.back().name] = bindings.back().shadowed;
+			bindings.pop_back();
+		}
+		scopes.pop_back();
 		--top;
-		tables.pop_back();
 	}
 	int insert(Symbol* s){
-		return tables[top].insert(s);
-	}
-	int get_index(string s){
-		for(int i = top; top >= 0; --i){
-			int index = tables[i].get_index(s);
-			if(index != -1){
-				if(i == 0) return -2;
-				else return index;
-			}
+		Atom name = s->get_id();
+		if(name >= (int) current.size()) current.resize(name + 1, -1);
+		if(current[name] != -1 && bindings[current[name]].depth == top){
+			return -1;
 		}
-		return -1;
+		++inserts;
+		Binding b;
+		b.name = name;
+		b.symbol = s;
+		b.depth = top;
+		b.slot = (s->get_declaration() == Variable) ? scopes[top].last_index++ : -1;
+		b.shadowed = current[name];
+		current[name] = bindings.size();
+		bindings.push_back(b);
+		return 1;
 	}
 
-	Symbol* lookup(string s){
-		for(int i = top; top >= 0; --i){
-			Symbol* t = tables[i].lookup(s);
-			if(t != NULL){
-				return t;
-			}
-		}
-		return NULL;
+	// the innermost binding of the name, or NULL.  It is only good until
+	// the next insert.
+	const Binding* resolve(Atom s){
+		return counting ? counted_resolve(s) : find(s);
 	}
-	// void dump(){
-	// 	cout << "================= Start of SymbolTable List ================ " << endl;
-	// 	for(int i = top; i >= 0; --i){
-	// 		cout << "**********"<< "SymbolTable Index: " << i << " ************" << endl;
-	// 		tables[i].dump();
-	// 		cout << "*************************************" << endl;
-	// 	}
-	// 	cout << "=================  End of SymbolTableList   ================= " << endl;
-	// }
-};
\ No newline at end of file
+
+	// the slot of a local variable, -2 for a global one, or -1
+	int get_index(Atom s){
+		const Binding* b = resolve(s);
+		if(b == NULL || b->slot == -1) return -1;
+		if(b->depth == 0) return -2;
+		return b->slot;
+	}
+
+	Symbol* lookup(Atom s){
+		const Binding* b = resolve(s);
+		return (b == NULL) ? NULL : b->symbol;
+	}
+
+	// the symbols of the outermost scope, in the order they were declared
+	vector<Symbol*> globals(){
+		vector<Symbol*> symbols;
+		int end = (top > 0) ? scopes[1].first : bindings.size();
+		for(int i = 0; i < end; ++i) symbols.push_back(bindings[i].symbol);
+		return symbols;
+	}
+
+	// one line of JSON on what the table did (--stats)
+	void print_stats(ostream& os){
+		os << "{\"names\":" << Atoms.size()
+		   << ",\"symbols\":" << inserts
+		   << ",\"scopes\":" << scopes_closed
+		   << ",\"max_depth\":" << max_depth
+		   << ",\"entries_per_scope\":" << (scopes_closed ? (double) entries / scopes_closed : 0)
+		   << ",\"max_entries\":" << max_entries
+		   << ",\"lookups\":" << lookups
+		   << ",\"misses\":" << misses
+		   << ",\"resolve_ns\":" << chrono::duration_cast<chrono::nanoseconds>(resolving).count()
+		   << "}" << endl;
+	}
+};
@@ -0,0 +1,89 @@
+/* A bump allocator for the strings and list nodes the assembler makes
+   while it works on a file.  They used to be malloc'ed one at a time and
+   mostly never freed, which was fine for one file per run but not for a
+   batch.  Now each assembly carves them out of a few big blocks, and
+   the whole lot goes back with one FreeArena when the file is done.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "types.h"
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGN 16
+
+/* the usable space in a block starts after its header */
+#define HEADER_SIZE \
+  ((long) ((sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1)))
+#define BLOCK_DATA(b) ((char*) (b) + HEADER_SIZE)
+
+void InitArena(Arena* a)
+{
+  a->blocks = NULL;
+  a->allocations = 0;
+  a->bytes = 0;
+  a->reserved = 0;
+}
+
+static ArenaBlock* NewBlock(Arena* a, long size)
+{
+  ArenaBlock* b;
+  long total = HEADER_SIZE + size;
+  if ((b = (ArenaBlock*) malloc(total)) == NULL) return NULL;
+  b->size = size;
+  b->used = 0;
+  a->reserved += total;
+  return b;
+}
+
+/* size bytes that stay put until FreeArena, or NULL if there's no
+   storage left.  Anything bigger than a quarter block gets a block of
+   its own, so that it doesn't waste the rest of the current one. */
+void* ArenaAlloc(Arena* a, long size)
+{
+  ArenaBlock* b;
+  char* p;
+  size = (size + ARENA_ALIGN - 1) & ~(long) (ARENA_ALIGN - 1);
+  if (size == 0) size = ARENA_ALIGN;
+  a->allocations++;
+  a->bytes += size;
+  if (size > ARENA_BLOCK_SIZE / 4)
+  {
+    if ((b = NewBlock(a, size)) == NULL) return NULL;
+    b->used = size;
+    if (a->blocks == NULL)
+    {
+      b->next = NULL;
+      a->blocks = b;
+    }
+    else  /* behind the one we're carving up */
+    {
+      b->next = a->blocks->next;
+      a->blocks->next = b;
+    }
+    return BLOCK_DATA(b);
+  }
+  b = a->blocks;
+  if ((b == NULL) || (b->used + size > b->size))
+  {
+    if ((b = NewBlock(a, ARENA_BLOCK_SIZE)) == NULL) return NULL;
+    b->next = a->blocks;
+    a->blocks = b;
+  }
+  p = BLOCK_DATA(b) + b->used;
+  b->used += size;
+  return p;
+}
+
+/* gives back everything that came from a */
+void FreeArena(Arena* a)
+{
+  ArenaBlock* b;
+  ArenaBlock* nextb;
+  for (b = a->blocks; b != NULL; b = nextb)
+  {
+    nextb = b->next;
+    free(b);
+  }
+  InitArena(a);
+}
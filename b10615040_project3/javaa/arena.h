@@ -0,0 +1,4 @@
+/* Bump allocation for the small blocks of one assembly.  See arena.c */
+void InitArena(Arena*);
+void* ArenaAlloc(Arena*, long);
+void FreeArena(Arena*);
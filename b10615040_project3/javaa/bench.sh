@@ -0,0 +1,36 @@
+#!/bin/sh
+# times javaa on classes from jasmgen, growing one dimension at a time
+# from a small base class, and prints instructions assembled per second.
+# "make bench" runs it; REPS is how many times each class is assembled.
+REPS=${REPS:-20}
+JAVAA=${JAVAA:-./javaa}
+DIR=${TMPDIR:-/tmp}/javaa-bench.$$
+mkdir -p $DIR || exit 1
+trap '/bin/rm -rf $DIR' 0
+
+printf "%-8s %6s %12s %10s %14s\n" dimension n instructions seconds "instr/second"
+for run in "methods 10 50 100 200 400" \
+	   "labels 10 25 50 90" \
+	   "consts 50 100 200 400 800" \
+	   "fields 5 10 20 40" \
+	   "switch 10 100 1000 5000"
+do
+  set -- $run
+  dimension=$1
+  shift
+  for n in "$@"
+  do
+    ./jasmgen -$dimension $n > $DIR/Bench.jasm || exit 1
+    count=`sed -n '1s/[^0-9]*\([0-9]*\).*/\1/p' $DIR/Bench.jasm`
+    files=""
+    i=0
+    while [ $i -lt $REPS ]; do files="$files $DIR/Bench.jasm"; i=`expr $i + 1`; done
+    start=`date +%s.%N`
+    (cd $DIR && $JAVAA -q -j 1 $files > /dev/null) || exit 1
+    end=`date +%s.%N`
+    echo "$dimension $n $count $start $end $REPS" | awk '{
+      t = $5 - $4
+      printf "%-8s %6d %12d %10.3f %14.0f\n", $1, $2, $3 * $6, t,
+	     (t > 0) ? $3 * $6 / t : 0 }'
+  done
+done
@@ -8,6 +8,7 @@ void         PrintSymbol(Symbol *);
 void         ForEachSymbol(void (*Apply)(Symbol *, int));
 void         ShowSymbol(Symbol *, int);
 Symbol      *ExistsSymbol(char *);
+char        *InternName(char *);
 void	     FormatSymbol(char *, Symbol *);
 void         FormatType(char *, MimeType);
 void	     DecrNestLevel(void);
@@ -47,8 +48,9 @@ void GenINVOKEINTERFACECode(int, char*, char*, char*, int);
 void GenIINCCode(int, int, int);
 void GenMULTIANEWARRAYCode(int, char*, int);
 void GenNEWARRAYCode(int, int);
-void GenLOOKUPSWITCHCode(int, char*, lookupentry*);
-void GenTABLESWITCHCode(int, int, int, char*, tableentry*);
+void GenLOOKUPSWITCHCode(int, char*);
+void GenTABLESWITCHCode(int, int, int, char*);
+void InitOpCodeTables();
 void InitAssembler();
 void EndAssembler();
 void SetThisClass(short, char*, char*);
@@ -57,14 +59,19 @@ void SetSourceFile(char*);
 void NewNewMethod(int);
 void NewMethod(char*, char*, int, int);
 void EndMethod();
+char* RefSignature(short);
+char* RefName(short);
+char* ClassName(short);
+const char* LoadedSignature(short);
 void NewField(int, char*, char*, ArgType);
 char* GetThisClass();
 void DefineLabel(char*);
 void NewLocalVar(char*, char*);
 void IncrementLocalVarSlot(char*);
 short GetLocalVar(char*);
-lookupentry * AddToLookupList(lookupentry*, int, char*);
-tableentry * AddToTableList(tableentry*, char*);
+void StartSwitch();
+void AddLookupEntry(long, char*);
+void AddTableEntry(char*);
 void AddToExceptionList(char*, char*, char*, char*);
 void AddToThrowsList(char*);
 void AddToLineNumberList(char*, short);
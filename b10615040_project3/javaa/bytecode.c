@@ -0,0 +1,1445 @@
+/* Routines that walk over the bytecode of a method once it has all been
+   generated.  The main one is RelayoutMethod, which is what lets a method
+   grow past 32K: every branch is first generated with a 2 byte offset,
+   and at the end of the method the ones that can't reach their label are
+   widened (goto -> goto_w, jsr -> jsr_w, and a conditional branch becomes
+   the opposite branch around a goto_w).  Widening moves the rest of the
+   code, which can push other branches out of range, so we keep going
+   until nothing else needs to change.  The same layout also handles
+   other instructions changing length, such as an ldc_w that turns into
+   an ldc once the constant pool has been put in order.
+   OptimizeMethod uses the same edits to take out nops.  MaxStackDepth
+   follows every path through a method to find out how much operand
+   stack it needs, and ComputeStackMap follows them again to find out
+   the types, for the StackMapTable.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "listing.h"
+#include "bytewriter.h"
+#include "bytecode.h"
+#include "build.h"
+#include "context.h"
+
+/* the longest code in which RenumberCode can't have to widen a branch.
+   All it does to the code is shorten an ldc_w to an ldc, and however
+   much that moves things, the padding of the switches between a branch
+   and its label can only add 3 bytes to the distance. */
+#define LongestSafeMethod (32767 - 3)
+
+/* total length of each instruction, opcode included.  0 is an opcode
+   we don't know about, -1 means the length depends on the operands */
+static const signed char OpLength[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /*   0 */
+    2, 3, 2, 3, 3, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1,  /*  16 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /*  32 */
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1,  /*  48 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /*  64 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /*  80 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /*  96 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /* 112 */
+    1, 1, 1, 1, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  /* 128 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 3, 3, 3,  /* 144 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 2,-1,-1, 1, 1, 1, 1,  /* 160 */
+    1, 1, 3, 3, 3, 3, 3, 3, 3, 5, 5, 3, 2, 3, 1, 1,  /* 176 */
+    3, 3, 1, 1,-1, 4, 3, 3, 5, 5, 0, 0, 0, 0, 0, 0,  /* 192 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 208 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 224 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0   /* 240 */
+};
+
+static long GetU4(const char* p)
+{
+  return (long) (int) (((unsigned long) (unsigned char) p[0] << 24)
+		     | ((unsigned long) (unsigned char) p[1] << 16)
+		     | ((unsigned long) (unsigned char) p[2] << 8)
+		     |  (unsigned long) (unsigned char) p[3]);
+}
+
+/* number of filler bytes after a tableswitch or lookupswitch opcode at
+   pc, so that the default offset starts on a 4 byte boundary */
+int SwitchPad(long pc)
+{
+  return (int) (3 - (pc % 4));
+}
+
+/* the length in bytes of the instruction that starts at code[pc] */
+int InstructionLength(const char* code, long pc)
+{
+  int op = (unsigned char) code[pc];
+  long operands;
+  if (OpLength[op] > 0) return OpLength[op];
+  if (OpLength[op] == 0) oops("Unknown opcode in generated code.");
+  if (op == OP_WIDE)
+     return ((unsigned char) code[pc+1] == OP_IINC) ? 6 : 4;
+  operands = pc + 1 + SwitchPad(pc);  /* default, then low/high or npairs */
+  if (op == OP_TABLESWITCH)
+     return (int) (operands + 12
+		   + 4 * (GetU4(&code[operands+8]) - GetU4(&code[operands+4]) + 1)
+		   - pc);
+  return (int) (operands + 8 + 8 * GetU4(&code[operands+4]) - pc);
+}
+
+static int GetU2(const char* p)
+{
+  return ((unsigned char) p[0] << 8) | (unsigned char) p[1];
+}
+
+/* the constant pool index used by the instruction at code[pc], or -1 if
+   it doesn't use one */
+long ConstOperand(const char* code, long pc)
+{
+  int op = (unsigned char) code[pc];
+  if (op == OP_LDC) return (unsigned char) code[pc+1];
+  if ((op == OP_LDC_W) || (op == OP_LDC2_W)
+      || ((op >= OP_GETSTATIC) && (op <= OP_INVOKEINTERFACE))
+      || (op == OP_NEW) || (op == OP_ANEWARRAY) || (op == OP_CHECKCAST)
+      || (op == OP_INSTANCEOF) || (op == OP_MULTIANEWARRAY))
+     return GetU2(&code[pc+1]);
+  return -1;
+}
+
+static int IsSwitch(int op)
+{
+  return (op == OP_TABLESWITCH) || (op == OP_LOOKUPSWITCH);
+}
+
+/* ifeq <-> ifne, iflt <-> ifge, ..., ifnull <-> ifnonnull */
+static int InvertBranch(int op)
+{
+  if (op == OP_IFNULL) return OP_IFNONNULL;
+  if (op == OP_IFNONNULL) return OP_IFNULL;
+  return ((op - OP_IFEQ) % 2 == 0) ? op + 1 : op - 1;
+}
+
+/* how long the instruction at pc becomes once it's been widened */
+static int WidenedLength(int op)
+{
+  if ((op == OP_GOTO) || (op == OP_JSR)) return 5;  /* goto_w, jsr_w */
+  return 3 + 5;  /* inverted branch over a goto_w */
+}
+
+/* works out where every instruction goes if the ones marked in widened[]
+   get their long form and the edits are made, filling in newpc[] for
+   every instruction start (and for the end of the code).  Returns the
+   new code length. */
+static long Layout(MethodInfo* m, long* newpc, const char* widened,
+		   const InstructionEdit* edit, const InstructionEdit* lastedit)
+{
+  long pc = 0;
+  long at = 0;
+  int len;
+  int op;
+  while (pc < m->CodeCounter)
+  {
+    newpc[pc] = at;
+    len = InstructionLength(m->Code, pc);
+    op = (unsigned char) m->Code[pc];
+    if ((edit < lastedit) && (edit->pc == pc))
+       at += (edit++)->length;
+    else if (IsSwitch(op))
+       at += len - SwitchPad(pc) + SwitchPad(at);
+    else if (widened[pc])
+       at += WidenedLength(op);
+    else
+       at += len;
+    pc += len;
+  }
+  newpc[pc] = at;
+  return at;
+}
+
+static short NewPc(const long* newpc, short oldpc)
+{
+  return (short) newpc[(unsigned short) oldpc];
+}
+
+/* moves everything in the method that remembers a code location to
+   where that code ended up */
+static void RemapLocations(MethodInfo* m, const long* newpc)
+{
+  int i;
+  long end;
+  exceptionentry* e;
+  linenumberentry* l;
+  userlocalvarentry* u;
+  StackMapFrame* f;
+  for (i = 0; i < m->LabelCounter; i++)
+    if (m->Label[i].index >= 0)
+       m->Label[i].index = newpc[m->Label[i].index];
+  for (e = m->exceptionhead; e != NULL; e = e->next)
+  {
+    e->start_pc = NewPc(newpc, e->start_pc);
+    e->end_pc = NewPc(newpc, e->end_pc);
+    e->handler_pc = NewPc(newpc, e->handler_pc);
+  }
+  for (l = m->linenumberhead; l != NULL; l = l->next)
+    l->start_pc = NewPc(newpc, l->start_pc);
+  for (u = m->userlocalvarhead; u != NULL; u = u->next)
+  {
+    end = (unsigned short) u->start_pc + (unsigned short) u->length;
+    u->start_pc = NewPc(newpc, u->start_pc);
+    u->length = (short) (newpc[end] - (unsigned short) u->start_pc);
+  }
+  for (i = 0; i <= m->LocalVarCounter; i++)
+  {
+    if (m->LocalVar[i].start_pc == -1) continue;  /* never used */
+    end = (unsigned short) m->LocalVar[i].start_pc
+	  + (unsigned short) m->LocalVar[i].length;
+    m->LocalVar[i].start_pc = NewPc(newpc, m->LocalVar[i].start_pc);
+    m->LocalVar[i].length =
+	(short) (newpc[end] - (unsigned short) m->LocalVar[i].start_pc);
+  }
+  for (i = 0; i < m->FrameCount; i++)
+  {
+    f = &m->Frames[i];
+    f->pc = newpc[f->pc];
+    for (long k = 0; k < f->locals + f->stack; k++)
+      if (f->types[k].tag == ITEM_Uninitialized)
+	 f->types[k].pc = newpc[f->types[k].pc];
+  }
+}
+
+/* the code at pc, after a conditional branch that is being turned
+   around a goto_w, can now only be got to by the inverted branch, so it
+   needs a frame.  ComputeStackMap kept one aside for it, unless it
+   already had one. */
+static void AddSpareFrame(MethodInfo* m, long pc)
+{
+  StackMapFrame* frames;
+  long i, at;
+  for (i = 1; i < m->FrameCount; i++)
+    if (m->Frames[i].pc == pc) return;
+  for (i = 0; (i < m->SpareCount) && (m->Spares[i].pc != pc); i++)
+    ;
+  if (i == m->SpareCount)
+  {
+    warning("The StackMapTable is left out, since a branch had to be "
+	    "widened after it was made.");
+    m->FrameCount = 0;
+    return;
+  }
+  frames = (StackMapFrame*) Allocate((m->FrameCount + 1)
+				     * sizeof(StackMapFrame));
+  for (at = 1; (at < m->FrameCount) && (m->Frames[at].pc < pc); at++)
+    ;
+  memcpy(frames, m->Frames, at * sizeof(StackMapFrame));
+  frames[at] = m->Spares[i];
+  memcpy(&frames[at + 1], &m->Frames[at],
+	 (m->FrameCount - at) * sizeof(StackMapFrame));
+  m->Frames = frames;
+  m->FrameCount++;
+}
+
+/* fills in every branch and switch offset in m from its label refs */
+static void PatchOffsets(MethodInfo* m)
+{
+  long i;
+  long offset;
+  LabelRef* ref;
+  for (i = 0; i < m->LabelRefCounter; i++)
+  {
+    ref = &m->LabelRefs[i];
+    offset = m->Label[ref->label].index - ref->opcodelocation;
+    if (ref->wide)
+       StoreU4(&m->Code[ref->location], offset);
+    else
+       StoreU2(&m->Code[ref->location], (signed short) offset);
+  }
+}
+
+/* makes the editcount edits (in pc order, and never to a branch or a
+   switch), widens every branch in m that can't reach its label with a 2
+   byte offset, and moves the code, the label references in m->LabelRefs
+   and all the tables that point into the code to match.  Then all of the
+   offsets are filled in. */
+void RelayoutMethod(MethodInfo* m, const InstructionEdit* edits,
+		    long editcount)
+{
+  long oldlength = m->CodeCounter;
+  long newlength;
+  long* newpc;
+  char* widened;
+  char* code;
+  long pc, at, offset, i;
+  int len, op, changed, count;
+  LabelRef* ref;
+  const InstructionEdit* edit;
+  const InstructionEdit* lastedit = edits + editcount;
+
+  newpc = (long*) AllocateScratch((oldlength + 1) * sizeof(long));
+  widened = (char*) AllocateScratch(oldlength + 1);
+
+  count = 0;
+  do
+  {
+    newlength = Layout(m, newpc, widened, edits, lastedit);
+    changed = 0;
+    for (i = 0; i < m->LabelRefCounter; i++)
+    {
+      ref = &m->LabelRefs[i];
+      if (ref->wide || widened[ref->opcodelocation]) continue;
+      offset = newpc[m->Label[ref->label].index] - newpc[ref->opcodelocation];
+      if ((offset > 32767) || (offset < -32768))
+      {
+	widened[ref->opcodelocation] = 1;
+	changed = 1;
+	count++;
+      }
+    }
+  } while (changed);
+
+  if ((count == 0) && (editcount == 0))
+  {  /* the usual case: everything is where it was */
+    FreeScratch(newpc);
+    FreeScratch(widened);
+    PatchOffsets(m);
+    return;
+  }
+  if (newlength > 65535)
+     oops("Method is too large after widening its branches.");
+
+  code = (char*) calloc(newlength + 1, 1);
+  if (code == NULL) oops("out of storage while laying out branches");
+  edit = edits;
+  for (pc = 0; pc < oldlength; pc += len)
+  {
+    len = InstructionLength(m->Code, pc);
+    op = (unsigned char) m->Code[pc];
+    at = newpc[pc];
+    if ((edit < lastedit) && (edit->pc == pc))
+    {
+      memcpy(&code[at], edit->bytes, edit->length);
+      edit++;
+    }
+    else if (IsSwitch(op))  /* same operands, different padding */
+    {
+      code[at] = (char) op;
+      memcpy(&code[at + 1 + SwitchPad(at)], &m->Code[pc + 1 + SwitchPad(pc)],
+	     len - 1 - SwitchPad(pc));
+    }
+    else if (!widened[pc])
+    {
+      memcpy(&code[at], &m->Code[pc], len);
+    }
+    else if (op == OP_GOTO)
+    {
+      message("Using GOTO_W");
+      code[at] = (char) OP_GOTO_W;
+    }
+    else if (op == OP_JSR)
+    {
+      message("Using JSR_W");
+      code[at] = (char) OP_JSR_W;
+    }
+    else
+    {
+      message("Branch too far: using opposite branch around GOTO_W");
+      if (m->FrameCount > 0) AddSpareFrame(m, pc + len);
+      code[at] = (char) InvertBranch(op);
+      StoreU2(&code[at + 1], 3 + 5);  /* skip the goto_w */
+      code[at + 3] = (char) OP_GOTO_W;
+    }
+  }
+
+  /* the references now point at the new code; a widened branch is now
+     a reference from its goto_w */
+  for (i = 0; i < m->LabelRefCounter; i++)
+  {
+    ref = &m->LabelRefs[i];
+    pc = ref->opcodelocation;
+    op = (unsigned char) m->Code[pc];
+    at = newpc[pc];
+    if (widened[pc])
+    {
+      if ((op != OP_GOTO) && (op != OP_JSR)) at += 3;
+      ref->location = at + 1;
+      ref->wide = 1;
+    }
+    else if (IsSwitch(op))
+      ref->location += (at + SwitchPad(at)) - (pc + SwitchPad(pc));
+    else
+      ref->location += at - pc;
+    ref->opcodelocation = at;
+  }
+
+  RemapLocations(m, newpc);
+  m->SpareCount = 0;  /* they are for the old code */
+  free(m->Code);
+  m->Code = code;
+  m->CodeSize = newlength + 1;
+  m->CodeCounter = (unsigned short) newlength;
+  FreeScratch(newpc);
+  FreeScratch(widened);
+  PatchOffsets(m);
+}
+
+/* javaa -O: the clean-ups that don't need to know what the code means.
+   First every nop is taken out.  A label on a nop ends up on the
+   instruction after it, along with any labels already there.  A nop
+   stays if it is the last instruction, or if taking it out would leave
+   an exception range with nothing in it.  Then every branch to a goto
+   is sent straight to where that goto goes, following the whole chain.
+   Returns how many bytes the method got shorter. */
+long OptimizeMethod(MethodInfo* m)
+{
+  long oldlength = m->CodeCounter;
+  long* gotoref;
+  char* removed;
+  InstructionEdit* edits;
+  long editcount = 0;
+  long pc, i, target, steps;
+  int op;
+  LabelRef* ref;
+  exceptionentry* e;
+
+  /* strip nops */
+  removed = (char*) AllocateScratch(oldlength + 1);
+  edits = (InstructionEdit*) AllocateScratch((oldlength + 1)
+					     * sizeof(InstructionEdit));
+  for (pc = 0; pc < oldlength; pc += InstructionLength(m->Code, pc))
+    if ((m->Code[pc] == 0) && (pc + 1 < oldlength)) removed[pc] = 1;
+  for (e = m->exceptionhead; e != NULL; e = e->next)
+  {
+    for (pc = (unsigned short) e->start_pc;
+	 (pc < (unsigned short) e->end_pc) && removed[pc];
+	 pc += InstructionLength(m->Code, pc))
+      ;
+    if (pc == (unsigned short) e->end_pc)
+       removed[(unsigned short) e->start_pc] = 0;
+  }
+  for (pc = 0; pc < oldlength; pc += InstructionLength(m->Code, pc))
+    if (removed[pc])
+    {
+      edits[editcount].pc = pc;
+      edits[editcount++].length = 0;
+    }
+  if (editcount > 0) RelayoutMethod(m, edits, editcount);
+  FreeScratch(removed);
+  FreeScratch(edits);
+
+  /* thread jumps to jumps */
+  gotoref = (long*) AllocateScratch((m->CodeCounter + 1) * sizeof(long));
+  for (pc = 0; pc <= m->CodeCounter; pc++) gotoref[pc] = -1;
+  for (i = 0; i < m->LabelRefCounter; i++)
+  {
+    op = (unsigned char) m->Code[m->LabelRefs[i].opcodelocation];
+    if ((op == OP_GOTO) || (op == OP_GOTO_W))
+       gotoref[m->LabelRefs[i].opcodelocation] = i;
+  }
+  for (i = 0; i < m->LabelRefCounter; i++)
+  {
+    ref = &m->LabelRefs[i];
+    op = (unsigned char) m->Code[ref->opcodelocation];
+    if ((op == OP_JSR) || (op == OP_JSR_W)) continue;
+    target = m->Label[ref->label].index;
+    /* a loop of gotos is as good as any other place to end up */
+    for (steps = 0; (gotoref[target] != -1) && (steps < m->LabelRefCounter);
+	 steps++)
+    {
+      ref->label = m->LabelRefs[gotoref[target]].label;
+      target = m->Label[ref->label].index;
+    }
+  }
+  FreeScratch(gotoref);
+  RelayoutMethod(m, NULL, 0);
+  return oldlength - m->CodeCounter;
+}
+
+/* how many words each instruction takes off the operand stack and how
+   many it puts back.  -1 means it depends on the operands: the field and
+   method instructions go by the signature they refer to, and wide and
+   multianewarray are worked out from their operand bytes */
+static const signed char StackPop[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /*   0 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /*  16 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2,  /*  32 */
+    2, 2, 2, 2, 2, 2, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2,  /*  48 */
+    2, 2, 2, 1, 1, 1, 1, 2, 2, 2, 2, 1, 1, 1, 1, 3,  /*  64 */
+    4, 3, 4, 3, 3, 3, 3, 1, 2, 1, 2, 3, 2, 3, 4, 2,  /*  80 */
+    2, 4, 2, 4, 2, 4, 2, 4, 2, 4, 2, 4, 2, 4, 2, 4,  /*  96 */
+    2, 4, 2, 4, 1, 2, 1, 2, 2, 3, 2, 3, 2, 3, 2, 4,  /* 112 */
+    2, 4, 2, 4, 0, 1, 1, 1, 2, 2, 2, 1, 1, 1, 2, 2,  /* 128 */
+    2, 1, 1, 1, 4, 2, 2, 4, 4, 1, 1, 1, 1, 1, 1, 2,  /* 144 */
+    2, 2, 2, 2, 2, 2, 2, 0, 0, 0, 1, 1, 1, 2, 1, 2,  /* 160 */
+    1, 0,-1,-1,-1,-1,-1,-1,-1,-1, 0, 0, 1, 1, 1, 1,  /* 176 */
+    1, 1, 1, 1,-1,-1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0,  /* 192 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 208 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 224 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0   /* 240 */
+};
+static const signed char StackPush[256] = {
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 1, 1, 1, 2, 2,  /*   0 */
+    1, 1, 1, 1, 2, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 2,  /*  16 */
+    2, 2, 1, 1, 1, 1, 2, 2, 2, 2, 1, 1, 1, 1, 1, 2,  /*  32 */
+    1, 2, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /*  48 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /*  64 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 4, 4, 5, 6, 2,  /*  80 */
+    1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2,  /*  96 */
+    1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2,  /* 112 */
+    1, 2, 1, 2, 0, 2, 1, 2, 1, 1, 2, 1, 2, 2, 1, 2,  /* 128 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,  /* 144 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 160 */
+    0, 0,-1,-1,-1,-1,-1,-1,-1,-1, 0, 1, 1, 1, 1, 0,  /* 176 */
+    1, 1, 0, 0,-1,-1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 192 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 208 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /* 224 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0   /* 240 */
+};
+
+/* stack words taken up by a value of the type that starts at signature */
+static int TypeWords(const char* signature)
+{
+  if ((*signature == 'J') || (*signature == 'D')) return 2;
+  if (*signature == 'V') return 0;
+  return 1;
+}
+
+/* stack words taken up by the arguments in a method signature, and in
+   *result the words the method returns */
+static int ArgumentWords(const char* signature, int* result)
+{
+  int words = 0;
+  const char* p = signature + 1;  /* past the ( */
+  while (*p != ')')
+  {
+    words += TypeWords(p);
+    while (*p == '[') p++;
+    if (*p == 'L') p = strchr(p, ';');
+    p++;
+  }
+  *result = TypeWords(p + 1);
+  return words;
+}
+
+/* the words that the instruction at code[pc] pops and then pushes */
+static void StackEffect(const char* code, long pc, int* pop, int* push)
+{
+  int op = (unsigned char) code[pc];
+  int words;
+  char* signature;
+  if (StackPop[op] >= 0)
+  {
+    *pop = StackPop[op];
+    *push = StackPush[op];
+    return;
+  }
+  if (op == OP_WIDE)
+  {
+    op = (unsigned char) code[pc+1];
+    *pop = StackPop[op];
+    *push = StackPush[op];
+    return;
+  }
+  if (op == OP_MULTIANEWARRAY)
+  {
+    *pop = (unsigned char) code[pc+3];  /* one count per dimension */
+    *push = 1;
+    return;
+  }
+  signature = RefSignature((short) GetU2(&code[pc+1]));
+  switch (op) {
+    case OP_GETSTATIC: *pop = 0; *push = TypeWords(signature); break;
+    case OP_PUTSTATIC: *pop = TypeWords(signature); *push = 0; break;
+    case OP_GETFIELD: *pop = 1; *push = TypeWords(signature); break;
+    case OP_PUTFIELD: *pop = 1 + TypeWords(signature); *push = 0; break;
+    default:
+    {
+      *pop = ArgumentWords(signature, &words);
+      if (op != OP_INVOKESTATIC) (*pop)++;  /* the object */
+      *push = words;
+    }
+  }
+}
+
+/* MaxStackDepth gets to the instruction at pc with depth words on the
+   stack; the first time, it goes on the list to be followed from */
+static void ReachPc(StackWalk* walk, long pc, long depth)
+{
+  if ((pc < 0) || (pc >= walk->length)) return;
+  if (walk->depths[pc] == -1)
+  {
+    walk->depths[pc] = depth;
+    walk->work[walk->worksize++] = pc;
+    if (depth > walk->max) walk->max = depth;
+  }
+  else if ((walk->depths[pc] != depth) && !walk->mismatch)
+  {
+    walk->mismatch = 1;
+    warning("Stack depth differs between the paths into an instruction.");
+  }
+}
+
+/* the target of the branch instruction at code[pc] */
+static long BranchTarget(const char* code, long pc)
+{
+  int op = (unsigned char) code[pc];
+  if ((op == OP_GOTO_W) || (op == OP_JSR_W)) return pc + GetU4(&code[pc+1]);
+  return pc + (short) GetU2(&code[pc+1]);
+}
+
+/* how deep the operand stack can get in a method, found by following
+   every path through the code from the start and from each exception
+   handler (where the stack holds just the exception).  A jsr pushes its
+   return address for the subroutine, and the code after it carries on
+   at the depth from before the jsr. */
+int MaxStackDepth(MethodInfo* m)
+{
+  StackWalk walk;
+  const char* code = m->Code;
+  long pc;
+  long depth;
+  long next;
+  long operands;
+  long count;
+  long i;
+  int op;
+  int pop;
+  int push;
+  int underflow = 0;
+  exceptionentry* e;
+
+  if (m->CodeCounter == 0) return 0;
+  walk.length = m->CodeCounter;
+  walk.depths = (long*) AllocateScratch(walk.length * sizeof(long));
+  walk.work = (long*) AllocateScratch(walk.length * sizeof(long));
+  walk.worksize = 0;
+  walk.max = 0;
+  walk.mismatch = 0;
+  for (pc = 0; pc < walk.length; pc++) walk.depths[pc] = -1;
+  ReachPc(&walk, 0, 0);
+  for (e = m->exceptionhead; e != NULL; e = e->next)
+    ReachPc(&walk, (unsigned short) e->handler_pc, 1);
+
+  while (walk.worksize > 0)
+  {
+    pc = walk.work[--walk.worksize];
+    op = (unsigned char) code[pc];
+    next = pc + InstructionLength(code, pc);
+    StackEffect(code, pc, &pop, &push);
+    depth = walk.depths[pc] - pop;
+    if (depth < 0)
+    {
+      if (!underflow)
+	warning("Stack underflow: an instruction pops more than is there.");
+      underflow = 1;
+      depth = 0;
+    }
+    depth += push;
+    if (depth > walk.max) walk.max = depth;
+
+    if (((op >= OP_IFEQ) && (op <= OP_IF_ACMPNE))
+	|| (op == OP_IFNULL) || (op == OP_IFNONNULL))
+    {
+      ReachPc(&walk, BranchTarget(code, pc), depth);
+      ReachPc(&walk, next, depth);
+    }
+    else if ((op == OP_GOTO) || (op == OP_GOTO_W))
+      ReachPc(&walk, BranchTarget(code, pc), depth);
+    else if ((op == OP_JSR) || (op == OP_JSR_W))
+    {
+      ReachPc(&walk, BranchTarget(code, pc), depth + 1);
+      ReachPc(&walk, next, depth);
+    }
+    else if (IsSwitch(op))
+    {
+      operands = pc + 1 + SwitchPad(pc);
+      ReachPc(&walk, pc + GetU4(&code[operands]), depth);
+      if (op == OP_TABLESWITCH)
+      {
+	count = GetU4(&code[operands+8]) - GetU4(&code[operands+4]) + 1;
+	for (i = 0; i < count; i++)
+	  ReachPc(&walk, pc + GetU4(&code[operands + 12 + 4*i]), depth);
+      }
+      else
+      {
+	count = GetU4(&code[operands+4]);
+	for (i = 0; i < count; i++)
+	  ReachPc(&walk, pc + GetU4(&code[operands + 12 + 8*i]), depth);
+      }
+    }
+    else if (((op >= OP_IRETURN) && (op <= OP_RETURN))
+	     || (op == OP_ATHROW) || (op == OP_RET)
+	     || ((op == OP_WIDE) && ((unsigned char) code[pc+1] == OP_RET)))
+      ;  /* this path ends here */
+    else
+      ReachPc(&walk, next, depth);
+  }
+  FreeScratch(walk.depths);
+  FreeScratch(walk.work);
+  return (int) walk.max;
+}
+
+/* ComputeStackMap works out what type each local and each stack word
+   holds at the instructions that need a StackMapTable frame, the same
+   way the old type-inferencing verifier does it: follow every path from
+   the start and from each exception handler, and where paths meet, keep
+   what they have in common.  We don't load any classes, so two
+   different classes meeting make a java/lang/Object (and two arrays of
+   objects an Object[]); code that needs the closer common superclass
+   won't pass the new verifier, and the JVM falls back to the old one for
+   that class, the same as if there were no StackMapTable. */
+
+/* the type each instruction pushes, after taking StackPop[op] words off
+   the stack: 0 for nothing, or ITEM_Integer, ITEM_Float, ITEM_Double or
+   ITEM_Long.  * is done in StepTypes, ? can't have a StackMapTable */
+static const char TypePushed[] =
+    "0*11111114422233"  /*   0 */
+    "11**************"  /*  16 */
+    "**************14"  /*  32 */
+    "23*111**********"  /*  48 */
+    "***************0"  /*  64 */
+    "0000000*********"  /*  80 */
+    "1423142314231423"  /*  96 */
+    "1423142314141414"  /* 112 */
+    "1414042312314314"  /* 128 */
+    "2111111110000000"  /* 144 */
+    "00000000??000000"  /* 160 */
+    "00********?***10"  /* 176 */
+    "*100**000???????"  /* 192 */
+    "????????????????"  /* 208 */
+    "????????????????"  /* 224 */
+    "????????????????"; /* 240 */
+
+/* what the loads and stores of each kind (iload, lload, fload, dload,
+   aload) put on the stack or in a local; ITEM_Top means the type it
+   was given */
+static const char LoadedType[] = {
+    ITEM_Integer, ITEM_Long, ITEM_Float, ITEM_Double, ITEM_Top
+};
+
+static char JavaLangObject[] = "java/lang/Object";
+static char JavaLangThrowable[] = "java/lang/Throwable";
+static char ObjectArray[] = "[Ljava/lang/Object;";
+static char PrimitiveArrays[][3] = {  /* by newarray's atype, from 4 */
+    "[Z", "[C", "[F", "[D", "[B", "[S", "[I", "[J"
+};
+
+static void SetType(VerifyType* t, int tag)
+{
+  t->tag = (char) tag;
+  t->index = 0;
+  t->pc = 0;
+  t->name = NULL;
+}
+
+static void SetObjectType(VerifyType* t, char* name)
+{
+  SetType(t, ITEM_Object);
+  t->name = name;
+}
+
+static int SameType(const VerifyType* a, const VerifyType* b)
+{
+  if (a->tag != b->tag) return 0;
+  if (a->tag == ITEM_Object) return strcmp(a->name, b->name) == 0;
+  if (a->tag == ITEM_Uninitialized) return a->pc == b->pc;
+  return 1;
+}
+
+/* the first length characters of text, kept until the class is done */
+static char* CopyPart(const char* text, long length)
+{
+  char* copy = (char*) Allocate(length + 1);
+  memcpy(copy, text, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+/* the words of the type that starts at *signature, which is moved past
+   it.  Returns how many words there are */
+static int SignatureTypes(const char** signature, VerifyType* words)
+{
+  const char* p = *signature;
+  const char* end;
+  int count = 1;
+  switch (*p) {
+    case 'V': count = 0; break;
+    case 'F': SetType(&words[0], ITEM_Float); break;
+    case 'J':
+    case 'D':
+    {
+      SetType(&words[0], (*p == 'J') ? ITEM_Long : ITEM_Double);
+      SetType(&words[1], ITEM_Top);
+      count = 2;
+      break;
+    }
+    case 'L':
+    {
+      end = strchr(p, ';');
+      SetObjectType(&words[0], CopyPart(p + 1, end - p - 1));
+      p = end;
+      break;
+    }
+    case '[':
+    {
+      for (end = p; *end == '['; end++)
+	;
+      if (*end == 'L') end = strchr(end, ';');
+      SetObjectType(&words[0], CopyPart(p, end - p + 1));
+      p = end;
+      break;
+    }
+    default: SetType(&words[0], ITEM_Integer);  /* I, Z, B, C and S */
+  }
+  *signature = p + 1;
+  return count;
+}
+
+static void TypeProblem(TypeWalk* w, const char* problem)
+{
+  if (w->problem == NULL) w->problem = problem;
+}
+
+static void PushTypes(TypeWalk* w, const VerifyType* words, int count)
+{
+  if (w->sp + count > w->stacksize)
+  {
+    TypeProblem(w, "the stack goes past max_stack");
+    return;
+  }
+  memcpy(&w->types[w->locals + w->sp], words, count * sizeof(VerifyType));
+  w->sp += count;
+}
+
+/* pushes ITEM_Integer, ITEM_Float, ITEM_Double, ITEM_Long or ITEM_Null */
+static void PushType(TypeWalk* w, int tag)
+{
+  VerifyType words[2];
+  SetType(&words[0], tag);
+  SetType(&words[1], ITEM_Top);
+  PushTypes(w, words, ((tag == ITEM_Long) || (tag == ITEM_Double)) ? 2 : 1);
+}
+
+static void PushSignature(TypeWalk* w, const char* signature)
+{
+  VerifyType words[2];
+  PushTypes(w, words, SignatureTypes(&signature, words));
+}
+
+/* takes count words off the stack, and returns where they were */
+static VerifyType* PopTypes(TypeWalk* w, int count)
+{
+  if (w->sp < count)
+  {
+    TypeProblem(w, "an instruction pops more than is on the stack");
+    w->sp = count;
+  }
+  w->sp -= count;
+  return &w->types[w->locals + w->sp];
+}
+
+/* the dup instructions: copies the top count words to below the depth
+   words under them */
+static void DupTypes(TypeWalk* w, int count, int depth)
+{
+  VerifyType* base;
+  if (w->sp < count + depth)
+  {
+    TypeProblem(w, "an instruction pops more than is on the stack");
+    return;
+  }
+  if (w->sp + count > w->stacksize)
+  {
+    TypeProblem(w, "the stack goes past max_stack");
+    return;
+  }
+  base = &w->types[w->locals + w->sp - count - depth];
+  memmove(base + count, base, (count + depth) * sizeof(VerifyType));
+  memcpy(base, base + count + depth, count * sizeof(VerifyType));
+  w->sp += count;
+}
+
+/* puts count words into the locals from slot on.  A long or double
+   that the first of them lands on the second half of is gone. */
+static void StoreTypes(TypeWalk* w, long slot, const VerifyType* words,
+		       int count)
+{
+  if (slot + count > w->locals)
+  {
+    TypeProblem(w, "it uses a local past max_locals");
+    return;
+  }
+  if ((slot > 0) && ((w->types[slot-1].tag == ITEM_Long)
+		     || (w->types[slot-1].tag == ITEM_Double)))
+     SetType(&w->types[slot-1], ITEM_Top);
+  memmove(&w->types[slot], words, count * sizeof(VerifyType));
+}
+
+/* an iload ... aload (kind 0 to 4) or istore ... astore of slot */
+static void LoadOrStore(TypeWalk* w, int store, int kind, long slot)
+{
+  VerifyType words[2];
+  int count = ((kind == 1) || (kind == 3)) ? 2 : 1;
+  if (!store)
+  {
+    if (slot + count > w->locals)
+       TypeProblem(w, "it uses a local past max_locals");
+    else if (kind == 4)
+       PushTypes(w, &w->types[slot], 1);
+    else
+       PushType(w, LoadedType[kind]);
+    return;
+  }
+  memcpy(words, PopTypes(w, count), count * sizeof(VerifyType));
+  if (kind != 4)
+  {
+    SetType(&words[0], LoadedType[kind]);
+    SetType(&words[1], ITEM_Top);
+  }
+  StoreTypes(w, slot, words, count);
+}
+
+/* once <init> has been called on an object, everywhere it is, it's now
+   an object of its class */
+static void InitializeType(TypeWalk* w, MethodInfo* m, const VerifyType* object)
+{
+  VerifyType before = *object;
+  VerifyType after;
+  if (before.tag == ITEM_UninitializedThis)
+     SetObjectType(&after, w->thisclass);
+  else if (before.tag == ITEM_Uninitialized)
+     SetObjectType(&after, ClassName((short) GetU2(&m->Code[before.pc + 1])));
+  else
+     return;
+  for (long i = 0; i < w->locals + w->sp; i++)
+    if (SameType(&w->types[i], &before)) w->types[i] = after;
+}
+
+/* changes the types in w to what they are after the instruction at pc */
+static void StepTypes(TypeWalk* w, MethodInfo* m, long pc)
+{
+  const char* code = m->Code;
+  int op = (unsigned char) code[pc];
+  int words;
+  long index;
+  char* signature;
+  char* name;
+  VerifyType* popped;
+  VerifyType type;
+
+  if (op == OP_WIDE)
+  {
+    op = (unsigned char) code[pc+1];
+    index = GetU2(&code[pc+2]);
+    if ((op >= OP_ILOAD) && (op <= OP_ALOAD))
+       LoadOrStore(w, 0, op - OP_ILOAD, index);
+    else if ((op >= OP_ISTORE) && (op <= OP_ASTORE))
+       LoadOrStore(w, 1, op - OP_ISTORE, index);
+    else if (op == OP_RET)
+       TypeProblem(w, "it uses jsr and ret");
+    return;  /* iinc leaves the types alone */
+  }
+  if ((op >= OP_ILOAD) && (op <= OP_ALOAD))
+  {
+    LoadOrStore(w, 0, op - OP_ILOAD, (unsigned char) code[pc+1]);
+    return;
+  }
+  if ((op >= OP_ILOAD_0) && (op <= OP_ALOAD_3))
+  {
+    LoadOrStore(w, 0, (op - OP_ILOAD_0) / 4, (op - OP_ILOAD_0) % 4);
+    return;
+  }
+  if ((op >= OP_ISTORE) && (op <= OP_ASTORE))
+  {
+    LoadOrStore(w, 1, op - OP_ISTORE, (unsigned char) code[pc+1]);
+    return;
+  }
+  if ((op >= OP_ISTORE_0) && (op <= OP_ASTORE_3))
+  {
+    LoadOrStore(w, 1, (op - OP_ISTORE_0) / 4, (op - OP_ISTORE_0) % 4);
+    return;
+  }
+  if (TypePushed[op] == '?')
+  {
+    if ((op == OP_JSR) || (op == OP_JSR_W) || (op == OP_RET))
+       TypeProblem(w, "it uses jsr and ret");
+    else
+       TypeProblem(w, "it has an instruction we don't know the types of");
+    return;
+  }
+  if (TypePushed[op] != '*')
+  {
+    PopTypes(w, StackPop[op]);
+    if (TypePushed[op] != '0') PushType(w, TypePushed[op] - '0');
+    return;
+  }
+
+  index = ConstOperand(code, pc);
+  switch (op) {
+    case OP_ACONST_NULL: PushType(w, ITEM_Null); break;
+    case OP_LDC:
+    case OP_LDC_W:
+    case OP_LDC2_W: PushSignature(w, LoadedSignature((short) index)); break;
+    case OP_AALOAD:
+    {
+      PopTypes(w, 1);  /* the index */
+      type = *PopTypes(w, 1);
+      if (type.tag == ITEM_Null)
+	 PushType(w, ITEM_Null);
+      else if ((type.tag == ITEM_Object) && (type.name[0] == '[')
+	       && ((type.name[1] == 'L') || (type.name[1] == '[')))
+	 PushSignature(w, type.name + 1);
+      else
+	 TypeProblem(w, "aaload is used on something that isn't an array "
+		     "of objects");
+      break;
+    }
+    case OP_POP: PopTypes(w, 1); break;
+    case OP_POP2: PopTypes(w, 2); break;
+    case OP_DUP: DupTypes(w, 1, 0); break;
+    case OP_DUP_X1: DupTypes(w, 1, 1); break;
+    case OP_DUP_X2: DupTypes(w, 1, 2); break;
+    case OP_DUP2: DupTypes(w, 2, 0); break;
+    case OP_DUP2_X1: DupTypes(w, 2, 1); break;
+    case OP_DUP2_X2: DupTypes(w, 2, 2); break;
+    case OP_SWAP:
+    {
+      DupTypes(w, 1, 1);  /* a b -> b a b */
+      PopTypes(w, 1);
+      break;
+    }
+    case OP_GETSTATIC: PushSignature(w, RefSignature((short) index)); break;
+    case OP_PUTSTATIC: PopTypes(w, TypeWords(RefSignature((short) index)));
+		       break;
+    case OP_GETFIELD:
+    {
+      PopTypes(w, 1);
+      PushSignature(w, RefSignature((short) index));
+      break;
+    }
+    case OP_PUTFIELD: PopTypes(w, 1 + TypeWords(RefSignature((short) index)));
+		      break;
+    case OP_NEW:
+    {
+      SetType(&type, ITEM_Uninitialized);
+      type.pc = pc;
+      PushTypes(w, &type, 1);
+      break;
+    }
+    case OP_NEWARRAY:
+    {
+      PopTypes(w, 1);
+      if (((unsigned char) code[pc+1] < 4) || ((unsigned char) code[pc+1] > 11))
+      {
+	TypeProblem(w, "newarray has a type that isn't one");
+	break;
+      }
+      SetObjectType(&type, PrimitiveArrays[(unsigned char) code[pc+1] - 4]);
+      PushTypes(w, &type, 1);
+      break;
+    }
+    case OP_ANEWARRAY:
+    {
+      PopTypes(w, 1);
+      name = ClassName((short) index);
+      signature = (char*) Allocate(strlen(name) + 4);
+      if (name[0] == '[') sprintf(signature, "[%s", name);
+      else sprintf(signature, "[L%s;", name);
+      SetObjectType(&type, signature);
+      PushTypes(w, &type, 1);
+      break;
+    }
+    case OP_CHECKCAST:
+    case OP_MULTIANEWARRAY:
+    {
+      PopTypes(w, (op == OP_CHECKCAST) ? 1 : (unsigned char) code[pc+3]);
+      SetObjectType(&type, ClassName((short) index));
+      PushTypes(w, &type, 1);
+      break;
+    }
+    default:  /* the invokes */
+    {
+      signature = RefSignature((short) index);
+      PopTypes(w, ArgumentWords(signature, &words));
+      if (op != OP_INVOKESTATIC)
+      {
+	popped = PopTypes(w, 1);
+	if ((op == OP_INVOKESPECIAL)
+	    && (strcmp(RefName((short) index), "<init>") == 0))
+	   InitializeType(w, m, popped);
+      }
+      PushSignature(w, strchr(signature, ')') + 1);
+    }
+  }
+}
+
+/* a StackMapTable frame for the instruction at pc, not yet reached */
+static void NeedFrame(TypeWalk* w, long pc)
+{
+  StackMapFrame* frame;
+  if ((pc < 0) || (pc >= w->length))
+  {
+    TypeProblem(w, "a branch goes past the end of the code");
+    return;
+  }
+  if (w->frames[pc] != NULL) return;
+  frame = (StackMapFrame*) Allocate(sizeof(StackMapFrame));
+  frame->pc = pc;
+  frame->locals = w->locals;
+  frame->stack = -1;
+  frame->types = (VerifyType*) Allocate((w->locals + w->stacksize + 1)
+					* sizeof(VerifyType));
+  w->frames[pc] = frame;
+}
+
+/* what is in a local or stack word where two paths meet.  Returns 1 if
+   into changed. */
+static int MergeType(VerifyType* into, const VerifyType* from)
+{
+  if ((into->tag == ITEM_Top) || SameType(into, from)) return 0;
+  if ((into->tag == ITEM_Object) && (from->tag == ITEM_Null)) return 0;
+  if ((into->tag == ITEM_Null) && (from->tag == ITEM_Object))
+     *into = *from;
+  else if ((into->tag == ITEM_Object) && (from->tag == ITEM_Object))
+  {
+    if ((into->name[0] == '[') && (from->name[0] == '[')
+	&& (into->name[1] != 'L') && (into->name[1] != '[')
+	&& (from->name[1] != 'L') && (from->name[1] != '['))
+       SetObjectType(into, JavaLangObject);  /* arrays of different primitives */
+    else if ((into->name[0] == '[') && (from->name[0] == '[')
+	     && ((into->name[1] == 'L') || (into->name[1] == '['))
+	     && ((from->name[1] == 'L') || (from->name[1] == '[')))
+    {
+      if (strcmp(into->name, ObjectArray) == 0) return 0;
+      SetObjectType(into, ObjectArray);
+    }
+    else
+    {
+      if (strcmp(into->name, JavaLangObject) == 0) return 0;
+      SetObjectType(into, JavaLangObject);
+    }
+  }
+  else
+    SetType(into, ITEM_Top);
+  return 1;
+}
+
+/* another path gets to the instruction at pc, which has a frame, with
+   these locals and depth words of stack.  If that changes the frame, it
+   has to be followed again. */
+static void MergeFrame(TypeWalk* w, long pc, const VerifyType* locals,
+		       const VerifyType* stack, long depth)
+{
+  StackMapFrame* frame = w->frames[pc];
+  int changed = 0;
+  long i;
+  if (frame->stack == -1)
+  {
+    memcpy(frame->types, locals, w->locals * sizeof(VerifyType));
+    memcpy(frame->types + w->locals, stack, depth * sizeof(VerifyType));
+    frame->stack = depth;
+    changed = 1;
+  }
+  else if (frame->stack != depth)
+  {
+    TypeProblem(w, "the stack is a different depth on two paths into one "
+		"instruction");
+    return;
+  }
+  else
+  {
+    for (i = 0; i < w->locals; i++)
+      changed |= MergeType(&frame->types[i], &locals[i]);
+    for (i = 0; i < depth; i++)
+    {
+      changed |= MergeType(&frame->types[w->locals + i], &stack[i]);
+      if ((frame->types[w->locals + i].tag == ITEM_Top)
+	  && (stack[i].tag != ITEM_Top))
+	 TypeProblem(w, "two paths into one instruction leave different "
+		     "types on the stack");
+    }
+  }
+  if (changed && !w->queued[pc])
+  {
+    w->queued[pc] = 1;
+    w->work[w->worksize++] = pc;
+  }
+}
+
+/* the instruction at pc can throw to any handler whose range it is in,
+   with the locals it has right now */
+static void MergeHandlers(TypeWalk* w, MethodInfo* m, long pc)
+{
+  VerifyType exception;
+  for (exceptionentry* e = m->exceptionhead; e != NULL; e = e->next)
+  {
+    if ((pc < (unsigned short) e->start_pc) || (pc >= (unsigned short) e->end_pc))
+       continue;
+    SetObjectType(&exception, (e->catch_type == 0) ? JavaLangThrowable
+		  : ClassName(e->catch_type));
+    MergeFrame(w, (unsigned short) e->handler_pc, w->types, &exception, 1);
+  }
+}
+
+/* follows the code from the frame at pc until it gets to the end of the
+   path or to another frame */
+static void FollowTypes(TypeWalk* w, MethodInfo* m, long pc)
+{
+  const char* code = m->Code;
+  StackMapFrame* frame = w->frames[pc];
+  long operands, count, i, next;
+  int op;
+  memcpy(w->types, frame->types, (w->locals + frame->stack) * sizeof(VerifyType));
+  w->sp = frame->stack;
+  for (;;)
+  {
+    w->reached[pc] = 1;
+    op = (unsigned char) code[pc];
+    next = pc + InstructionLength(code, pc);
+    MergeHandlers(w, m, pc);
+    StepTypes(w, m, pc);
+    MergeHandlers(w, m, pc);  /* a store may have changed the locals */
+    if (w->problem != NULL) return;
+    if (((op >= OP_IFEQ) && (op <= OP_IF_ACMPNE))
+	|| (op == OP_IFNULL) || (op == OP_IFNONNULL))
+      MergeFrame(w, BranchTarget(code, pc), w->types, w->types + w->locals, w->sp);
+    else if ((op == OP_GOTO) || (op == OP_GOTO_W))
+    {
+      MergeFrame(w, BranchTarget(code, pc), w->types, w->types + w->locals, w->sp);
+      return;
+    }
+    else if (IsSwitch(op))
+    {
+      operands = pc + 1 + SwitchPad(pc);
+      MergeFrame(w, pc + GetU4(&code[operands]), w->types,
+		 w->types + w->locals, w->sp);
+      if (op == OP_TABLESWITCH)
+	 count = GetU4(&code[operands+8]) - GetU4(&code[operands+4]) + 1;
+      else
+	 count = GetU4(&code[operands+4]);
+      for (i = 0; i < count; i++)
+	MergeFrame(w, pc + GetU4(&code[(op == OP_TABLESWITCH)
+				       ? operands + 12 + 4*i
+				       : operands + 12 + 8*i]),
+		   w->types, w->types + w->locals, w->sp);
+      return;
+    }
+    else if (((op >= OP_IRETURN) && (op <= OP_RETURN)) || (op == OP_ATHROW))
+      return;
+    if (next >= w->length)
+    {
+      TypeProblem(w, "the code runs off the end");
+      return;
+    }
+    if (w->frames[next] != NULL)
+    {
+      MergeFrame(w, next, w->types, w->types + w->locals, w->sp);
+      return;
+    }
+    pc = next;
+  }
+}
+
+/* code that no path gets to has no types to work out, but the new
+   verifier still wants a frame for it after the goto or return before
+   it.  So, since it can never run anyway, it is made into nops and an
+   athrow, which only need a frame holding the exception, and the
+   branches in it are forgotten.  Not inside an exception range, though,
+   where the handler's frame would have to hold for it too. */
+static void BlankDeadCode(TypeWalk* w, MethodInfo* m, char* name)
+{
+  char* code = m->Code;
+  char* dead;
+  long pc, start, i, blanked = 0;
+  char text[200];
+  dead = (char*) AllocateScratch(w->length + 1);
+  for (pc = 0; pc < w->length; pc += InstructionLength(code, pc))
+    if (!w->reached[pc])
+       memset(&dead[pc], 1, InstructionLength(code, pc));
+  for (exceptionentry* e = m->exceptionhead; e != NULL; e = e->next)
+    for (pc = (unsigned short) e->start_pc; pc < (unsigned short) e->end_pc; pc++)
+      if (dead[pc]) TypeProblem(w, "it has code that no path gets to in an "
+				"exception range");
+  if (w->problem != NULL)
+  {
+    FreeScratch(dead);
+    return;
+  }
+  for (pc = 0; pc < w->length; )
+  {
+    if (!dead[pc])
+    {
+      pc++;
+      continue;
+    }
+    for (start = pc; dead[pc]; pc++) code[pc] = 0;  /* nop */
+    code[pc - 1] = (char) OP_ATHROW;
+    blanked += pc - start;
+    NeedFrame(w, start);
+    w->spare[start] = 0;
+    for (i = 0; i < w->locals; i++) SetType(&w->frames[start]->types[i], ITEM_Top);
+    SetObjectType(&w->frames[start]->types[w->locals], JavaLangThrowable);
+    w->frames[start]->stack = 1;
+  }
+  if (blanked > 0)
+  {
+    for (i = 0, pc = 0; i < m->LabelRefCounter; i++)
+      if (!dead[m->LabelRefs[i].opcodelocation])
+	 m->LabelRefs[pc++] = m->LabelRefs[i];
+    m->LabelRefCounter = pc;
+    if (m->max_stack < 1) m->max_stack = 1;
+    snprintf(text, sizeof(text), "%.100s: %ld bytes that no path gets to are "
+	     "now nops and an athrow", name, blanked);
+    message(text);
+  }
+  FreeScratch(dead);
+}
+
+/* the types at every branch target and exception handler in m, which is
+   called name and has the given signature, in m->Frames.  Returns NULL
+   if it worked, or why it didn't, in which case m gets no frames. */
+const char* ComputeStackMap(MethodInfo* m, char* name, char* signature,
+			    char* thisclass)
+{
+  TypeWalk walk;
+  TypeWalk* w = &walk;
+  const char* code = m->Code;
+  const char* p;
+  long pc, next, operands, count, spares, i, slot;
+  int op, startframe;
+  VerifyType words[2];
+  exceptionentry* e;
+
+  m->FrameCount = 0;
+  m->SpareCount = 0;
+  if (m->CodeCounter == 0) return NULL;
+  w->length = m->CodeCounter;
+  w->locals = (m->max_locals > -1) ? m->max_locals : m->currentslot;
+  w->stacksize = m->max_stack;
+  w->frames = (StackMapFrame**) AllocateScratch(w->length
+						* sizeof(StackMapFrame*));
+  w->reached = (char*) AllocateScratch(w->length);
+  w->spare = (char*) AllocateScratch(w->length);
+  w->queued = (char*) AllocateScratch(w->length);
+  w->work = (long*) AllocateScratch(w->length * sizeof(long));
+  w->types = (VerifyType*) AllocateScratch((w->locals + w->stacksize + 1)
+					   * sizeof(VerifyType));
+  w->worksize = 0;
+  w->thisclass = thisclass;
+  w->problem = NULL;
+
+  /* every instruction that can be got to other than from the one before
+     it needs a frame */
+  for (pc = 0; pc < w->length; pc += InstructionLength(code, pc))
+  {
+    op = (unsigned char) code[pc];
+    if (((op >= OP_IFEQ) && (op <= OP_GOTO))
+	|| (op == OP_IFNULL) || (op == OP_IFNONNULL) || (op == OP_GOTO_W))
+       NeedFrame(w, BranchTarget(code, pc));
+    else if (IsSwitch(op))
+    {
+      operands = pc + 1 + SwitchPad(pc);
+      NeedFrame(w, pc + GetU4(&code[operands]));
+      if (op == OP_TABLESWITCH)
+      {
+	count = GetU4(&code[operands+8]) - GetU4(&code[operands+4]) + 1;
+	for (i = 0; i < count; i++)
+	  NeedFrame(w, pc + GetU4(&code[operands + 12 + 4*i]));
+      }
+      else
+      {
+	count = GetU4(&code[operands+4]);
+	for (i = 0; i < count; i++)
+	  NeedFrame(w, pc + GetU4(&code[operands + 12 + 8*i]));
+      }
+    }
+  }
+  for (e = m->exceptionhead; e != NULL; e = e->next)
+    NeedFrame(w, (unsigned short) e->handler_pc);
+  /* and in a method long enough that RenumberCode may yet have to turn a
+     conditional branch around a goto_w, so might the instruction after
+     the branch.  Those frames are worked out too, and kept to one side
+     (in m->Spares) for RelayoutMethod to use if it comes to that. */
+  if (w->length > LongestSafeMethod)
+    for (pc = 0; pc < w->length; pc += InstructionLength(code, pc))
+    {
+      op = (unsigned char) code[pc];
+      next = pc + InstructionLength(code, pc);
+      if ((((op >= OP_IFEQ) && (op <= OP_IF_ACMPNE))
+	   || (op == OP_IFNULL) || (op == OP_IFNONNULL))
+	  && (next < w->length) && (w->frames[next] == NULL))
+      {
+	NeedFrame(w, next);
+	w->spare[next] = 1;
+      }
+    }
+  startframe = (w->frames[0] != NULL);
+  NeedFrame(w, 0);  /* where we start from, written only if it's needed */
+
+  /* the locals at the start come from the signature */
+  for (slot = 0; slot < w->locals; slot++) SetType(&w->types[slot], ITEM_Top);
+  slot = 0;
+  if ((m->access_flags & 0x0008) == 0)  /* not static, so there's this */
+  {
+    if ((strcmp(name, "<init>") == 0) && (strcmp(thisclass, JavaLangObject) != 0))
+       SetType(&words[0], ITEM_UninitializedThis);
+    else
+       SetObjectType(&words[0], thisclass);
+    StoreTypes(w, slot++, words, 1);
+  }
+  for (p = signature + 1; *p != ')'; )
+  {
+    count = SignatureTypes(&p, words);
+    StoreTypes(w, slot, words, count);
+    slot += count;
+  }
+  if (w->problem == NULL)
+  {
+    m->Frames = (StackMapFrame*) Allocate(sizeof(StackMapFrame));
+    m->Frames[0].pc = 0;
+    m->Frames[0].locals = w->locals;
+    m->Frames[0].stack = 0;
+    m->Frames[0].types = (VerifyType*) Allocate((w->locals + 1)
+						* sizeof(VerifyType));
+    memcpy(m->Frames[0].types, w->types, w->locals * sizeof(VerifyType));
+    MergeFrame(w, 0, w->types, NULL, 0);
+  }
+
+  while ((w->worksize > 0) && (w->problem == NULL))
+  {
+    pc = w->work[--w->worksize];
+    w->queued[pc] = 0;
+    FollowTypes(w, m, pc);
+  }
+  if (w->problem == NULL) BlankDeadCode(w, m, name);
+
+  if (w->problem == NULL)
+  {
+    count = 1;
+    spares = 0;
+    for (pc = startframe ? 0 : 1; pc < w->length; pc++)
+      if ((w->frames[pc] != NULL) && (w->frames[pc]->stack != -1))
+      {
+	if (w->spare[pc]) spares++;
+	else count++;
+      }
+    if (count > 1)
+    {
+      StackMapFrame* start = m->Frames;
+      m->Frames = (StackMapFrame*) Allocate(count * sizeof(StackMapFrame));
+      m->Frames[0] = *start;
+      m->Spares = (StackMapFrame*) Allocate((spares + 1)
+					    * sizeof(StackMapFrame));
+      count = 1;
+      spares = 0;
+      for (pc = startframe ? 0 : 1; pc < w->length; pc++)
+	if ((w->frames[pc] != NULL) && (w->frames[pc]->stack != -1))
+	{
+	  if (w->spare[pc]) m->Spares[spares++] = *w->frames[pc];
+	  else m->Frames[count++] = *w->frames[pc];
+	}
+      m->FrameCount = count;
+      m->SpareCount = spares;
+    }
+  }
+  FreeScratch(w->frames);
+  FreeScratch(w->reached);
+  FreeScratch(w->spare);
+  FreeScratch(w->queued);
+  FreeScratch(w->work);
+  FreeScratch(w->types);
+  return w->problem;
+}
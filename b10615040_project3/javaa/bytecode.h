@@ -0,0 +1,73 @@
+/* Walking over the bytecode of a finished method.  See bytecode.c */
+
+/* the raw opcode values the walkers need to recognize on their own */
+#define OP_ACONST_NULL 1
+#define OP_LDC 18
+#define OP_LDC_W 19
+#define OP_LDC2_W 20
+#define OP_ILOAD 21
+#define OP_ALOAD 25
+#define OP_ILOAD_0 26
+#define OP_ALOAD_3 45
+#define OP_AALOAD 50
+#define OP_ISTORE 54
+#define OP_ASTORE 58
+#define OP_ISTORE_0 59
+#define OP_ASTORE_3 78
+#define OP_POP 87
+#define OP_POP2 88
+#define OP_DUP 89
+#define OP_DUP_X1 90
+#define OP_DUP_X2 91
+#define OP_DUP2 92
+#define OP_DUP2_X1 93
+#define OP_DUP2_X2 94
+#define OP_SWAP 95
+#define OP_IINC 132
+#define OP_IFEQ 153
+#define OP_IF_ACMPNE 166
+#define OP_GOTO 167
+#define OP_JSR 168
+#define OP_RET 169
+#define OP_TABLESWITCH 170
+#define OP_LOOKUPSWITCH 171
+#define OP_IRETURN 172
+#define OP_RETURN 177
+#define OP_GETSTATIC 178
+#define OP_PUTSTATIC 179
+#define OP_GETFIELD 180
+#define OP_PUTFIELD 181
+#define OP_INVOKESPECIAL 183
+#define OP_INVOKESTATIC 184
+#define OP_INVOKEINTERFACE 185
+#define OP_NEW 187
+#define OP_NEWARRAY 188
+#define OP_ANEWARRAY 189
+#define OP_ATHROW 191
+#define OP_CHECKCAST 192
+#define OP_INSTANCEOF 193
+#define OP_WIDE 196
+#define OP_MULTIANEWARRAY 197
+#define OP_IFNULL 198
+#define OP_IFNONNULL 199
+#define OP_GOTO_W 200
+#define OP_JSR_W 201
+
+/* the verification types in a StackMapTable frame */
+#define ITEM_Top 0
+#define ITEM_Integer 1
+#define ITEM_Float 2
+#define ITEM_Double 3
+#define ITEM_Long 4
+#define ITEM_Null 5
+#define ITEM_UninitializedThis 6
+#define ITEM_Object 7
+#define ITEM_Uninitialized 8
+
+int InstructionLength(const char*, long);
+int SwitchPad(long);
+long ConstOperand(const char*, long);
+void RelayoutMethod(MethodInfo*, const InstructionEdit*, long);
+long OptimizeMethod(MethodInfo*);
+int MaxStackDepth(MethodInfo*);
+const char* ComputeStackMap(MethodInfo*, char*, char*, char*);
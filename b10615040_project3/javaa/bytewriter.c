@@ -0,0 +1,131 @@
+/* A growable byte buffer that stores everything big-endian, the way the
+   class file format wants it.  The whole class file is built up in memory
+   and written out with a single fwrite, instead of one fputc per byte.
+   The buffer is scratch space in the current context, so it doesn't leak
+   if an oops() abandons the class file halfway through.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "listing.h"
+#include "bytewriter.h"
+#include "context.h"
+
+#define INITIAL_WRITER_SIZE 4096
+
+void InitByteWriter(ByteWriter* w)
+{
+  w->buf = NULL;
+  w->len = 0;
+  w->size = 0;
+}
+
+void FreeByteWriter(ByteWriter* w)
+{
+  FreeScratch(w->buf);
+  InitByteWriter(w);
+}
+
+/* forget the contents but keep the storage around for the next user */
+void ResetByteWriter(ByteWriter* w)
+{
+  w->len = 0;
+}
+
+/* make sure there is room for n more bytes, and return where they go */
+static unsigned char* Reserve(ByteWriter* w, long n)
+{
+  long newsize;
+  unsigned char* newbuf;
+  if (w->len + n > w->size)
+  {
+    newsize = (w->size > 0) ? w->size : INITIAL_WRITER_SIZE;
+    while (newsize < w->len + n) newsize *= 2;
+    newbuf = (unsigned char*) ReallocateScratch(w->buf, newsize);
+    w->buf = newbuf;
+    w->size = newsize;
+  }
+  w->len += n;
+  return &w->buf[w->len - n];
+}
+
+void StoreU2(char* p, int val)
+{
+  p[0] = (char) ((val >> 8) & 0xFF);
+  p[1] = (char) (val & 0xFF);
+}
+
+void StoreU4(char* p, long val)
+{
+  p[0] = (char) ((val >> 24) & 0xFF);
+  p[1] = (char) ((val >> 16) & 0xFF);
+  p[2] = (char) ((val >> 8) & 0xFF);
+  p[3] = (char) (val & 0xFF);
+}
+
+void PutU1(ByteWriter* w, int val)
+{
+  *Reserve(w, 1) = (unsigned char) (val & 0xFF);
+}
+
+void PutU2(ByteWriter* w, int val)
+{
+  StoreU2((char*) Reserve(w, 2), val);
+}
+
+void PutU4(ByteWriter* w, long val)
+{
+  StoreU4((char*) Reserve(w, 4), val);
+}
+
+void PutU8(ByteWriter* w, long long val)
+{
+  char* p = (char*) Reserve(w, 8);
+  StoreU4(p, (long) (val >> 32));
+  StoreU4(p + 4, (long) (val & 0xFFFFFFFF));
+}
+
+void PutFloat(ByteWriter* w, float val)
+{
+  int bits;
+  memcpy(&bits, &val, 4);
+  PutU4(w, bits);
+}
+
+void PutDouble(ByteWriter* w, double val)
+{
+  long long bits;
+  memcpy(&bits, &val, 8);
+  PutU8(w, bits);
+}
+
+void PutBytes(ByteWriter* w, const char* bytes, long n)
+{
+  if (n > 0) memcpy(Reserve(w, n), bytes, n);
+}
+
+/* swap a run of consecutive u2 fields (for instance one exception table
+   entry, or the first shorts of a FieldInfo) into the buffer in one go */
+void PutU2Array(ByteWriter* w, const short* vals, int count)
+{
+  unsigned char* p = Reserve(w, 2 * count);
+  for (int i = 0; i < count; i++)
+  {
+    *p++ = (unsigned char) ((vals[i] >> 8) & 0xFF);
+    *p++ = (unsigned char) (vals[i] & 0xFF);
+  }
+}
+
+void PutWriter(ByteWriter* w, ByteWriter* from)
+{
+  PutBytes(w, (const char*) from->buf, from->len);
+}
+
+/* writes it all to outfp; returns 0 if it couldn't */
+int FlushByteWriter(ByteWriter* w, FILE* outfp)
+{
+  int ok = (w->len == 0) || (fwrite(w->buf, 1, w->len, outfp) == (size_t) w->len);
+  ResetByteWriter(w);
+  return ok;
+}
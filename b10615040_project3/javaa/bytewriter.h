@@ -0,0 +1,16 @@
+/* Buffered big-endian output for class files.  See bytewriter.c */
+void InitByteWriter(ByteWriter*);
+void FreeByteWriter(ByteWriter*);
+void ResetByteWriter(ByteWriter*);
+void PutU1(ByteWriter*, int);
+void PutU2(ByteWriter*, int);
+void PutU4(ByteWriter*, long);
+void PutU8(ByteWriter*, long long);
+void PutFloat(ByteWriter*, float);
+void PutDouble(ByteWriter*, double);
+void PutBytes(ByteWriter*, const char*, long);
+void PutU2Array(ByteWriter*, const short*, int);
+void PutWriter(ByteWriter*, ByteWriter*);
+int FlushByteWriter(ByteWriter*, FILE*);
+void StoreU2(char*, int);
+void StoreU4(char*, long);
@@ -0,0 +1,724 @@
+/* classcheck: reads class files back in, so that javaa can be tested
+   without a JVM (see make test).
+
+   classcheck file.class
+	checks that the class file is well formed: the constant pool
+	entries refer to entries of the right kind, the attributes are as
+	long as they say, every instruction is whole and uses a constant
+	or local variable that is there, and every branch, exception
+	handler, line number and StackMapTable frame lands on the start
+	of an instruction.  A method with a StackMapTable, or from
+	version 50 on any method, has to have a frame everywhere the
+	verifier wants one: at every branch target and handler, and
+	after every goto, return, throw and switch.
+
+   classcheck reference.class file.class
+	checks both, then that they hold the same class.  The constants
+	are compared by what they say rather than where they are, so the
+	order of the constant pool and ldc against ldc_w make no
+	difference, and neither do the version or the attributes only
+	debuggers use (SourceFile, LineNumberTable, LocalVariableTable).
+
+   classcheck -d file.class
+	prints what the comparison is made on. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+typedef struct
+{
+  const char *name;	/* the file, for messages */
+  unsigned char *b;
+  long length;
+  long at;		/* where reading has got to */
+  int count;		/* constant pool count: the entries are 1..count-1 */
+  long *entry;		/* where each entry starts, 0 for the unusable
+			   one after a long or double */
+  int major, minor;
+} ClassFile;
+
+enum { Utf8 = 1, Integer = 3, Float, Long, Double, Class, String,
+       Fieldref, Methodref, InterfaceMethodref, NameAndType };
+
+void Bad(ClassFile *c, const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  fprintf(stderr, "%s: ", c->name);
+  vfprintf(stderr, format, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+  exit(1);
+}
+
+/* big-endian reads at an offset, checked against the end of the file */
+unsigned long Get(ClassFile *c, long at, int n)
+{
+  unsigned long value = 0;
+  if ((at < 0) || (at + n > c->length))
+    Bad(c, "runs off the end at byte %ld", at);
+  while (n-- > 0)
+    value = (value << 8) | c->b[at++];
+  return value;
+}
+
+unsigned long Read(ClassFile *c, int n)
+{
+  unsigned long value = Get(c, c->at, n);
+  c->at += n;
+  return value;
+}
+
+int Tag(ClassFile *c, unsigned long k)
+{
+  if ((k == 0) || (k >= (unsigned long) c->count) || (c->entry[k] == 0))
+    return 0;
+  return c->b[c->entry[k]];
+}
+
+/* checks that entry k is one of the tags in the 0-ended list */
+void Want(ClassFile *c, unsigned long k, const char *what, ...)
+{
+  va_list tags;
+  int tag, t = Tag(c, k);
+  va_start(tags, what);
+  while ((tag = va_arg(tags, int)) != 0)
+    if (tag == t)
+    {
+      va_end(tags);
+      return;
+    }
+  va_end(tags);
+  Bad(c, "constant %lu is not %s", k, what);
+}
+
+const char *Name(ClassFile *c, unsigned long k, int *length)
+{
+  Want(c, k, "a name", Utf8, 0);
+  *length = Get(c, c->entry[k] + 1, 2);
+  return (const char *) c->b + c->entry[k] + 3;
+}
+
+int IsNamed(ClassFile *c, unsigned long k, const char *name)
+{
+  int length;
+  const char *text = Name(c, k, &length);
+  return (length == (int) strlen(name)) && (memcmp(text, name, length) == 0);
+}
+
+void ReadPool(ClassFile *c)
+{
+  int k, tag;
+  long at;
+  c->count = Read(c, 2);
+  c->entry = (long *) calloc(c->count + 1, sizeof(long));
+  for (k = 1; k < c->count; k++)
+  {
+    c->entry[k] = c->at;
+    switch (tag = Read(c, 1))
+    {
+    case Utf8: c->at += Read(c, 2); break;
+    case Integer: case Float: c->at += 4; break;
+    case Long: case Double: c->at += 8; k++; break;
+    case Class: case String: c->at += 2; break;
+    case Fieldref: case Methodref: case InterfaceMethodref:
+    case NameAndType: c->at += 4; break;
+    default: Bad(c, "constant %d has an unknown tag %d", k, tag);
+    }
+  }
+  if (k > c->count)
+    Bad(c, "the last constant is a long or double");
+  if (c->at > c->length)
+    Bad(c, "the constant pool runs off the end");
+  for (k = 1; k < c->count; k++)
+  {
+    at = c->entry[k] + 1;
+    switch (Tag(c, k))
+    {
+    case Class: Want(c, Get(c, at, 2), "a class name", Utf8, 0); break;
+    case String: Want(c, Get(c, at, 2), "a string", Utf8, 0); break;
+    case NameAndType:
+      Want(c, Get(c, at, 2), "a member name", Utf8, 0);
+      Want(c, Get(c, at + 2, 2), "a signature", Utf8, 0);
+      break;
+    case Fieldref: case Methodref: case InterfaceMethodref:
+      Want(c, Get(c, at, 2), "a class", Class, 0);
+      Want(c, Get(c, at + 2, 2), "a name and type", NameAndType, 0);
+      break;
+    }
+  }
+}
+
+/* writes out what constant k says */
+void Constant(ClassFile *c, FILE *out, unsigned long k)
+{
+  long at = c->entry[k] + 1;
+  int length;
+  const char *text;
+  switch (Tag(c, k))
+  {
+  case Utf8:
+    text = Name(c, k, &length);
+    fwrite(text, 1, length, out);
+    break;
+  case Integer: fprintf(out, "int %ld", (long) (int) Get(c, at, 4)); break;
+  case Float: fprintf(out, "float 0x%08lx", Get(c, at, 4)); break;
+  case Long: case Double:
+    fprintf(out, "%s 0x%08lx%08lx", (Tag(c, k) == Long) ? "long" : "double",
+	    Get(c, at, 4), Get(c, at + 4, 4));
+    break;
+  case Class:
+    fprintf(out, "class ");
+    Constant(c, out, Get(c, at, 2));
+    break;
+  case String:
+    fprintf(out, "\"");
+    Constant(c, out, Get(c, at, 2));
+    fprintf(out, "\"");
+    break;
+  case NameAndType:
+    Constant(c, out, Get(c, at, 2));
+    fprintf(out, " ");
+    Constant(c, out, Get(c, at + 2, 2));
+    break;
+  case Fieldref: case Methodref: case InterfaceMethodref:
+    fprintf(out, "%s ", (Tag(c, k) == Fieldref) ? "field" :
+	    (Tag(c, k) == Methodref) ? "method" : "interface method");
+    Constant(c, out, Get(c, c->entry[Get(c, at, 2)] + 1, 2));
+    fprintf(out, ".");
+    Constant(c, out, Get(c, at + 2, 2));
+    break;
+  }
+}
+
+/* how many bytes of operands each opcode has: -1 for the ones that
+   are not instructions, -2 for the switches and wide, which work it
+   out as they go */
+signed char Operands[256];
+
+void SetOperands(void)
+{
+  int op;
+  for (op = 0; op < 256; op++)
+    Operands[op] = (op <= 201) ? 0 : -1;
+  Operands[16] = Operands[18] = Operands[169] = Operands[188] = 1;
+  for (op = 21; op <= 25; op++)
+    Operands[op] = Operands[op + 33] = 1;	/* loads and stores */
+  Operands[17] = Operands[19] = Operands[20] = Operands[132] = 2;
+  for (op = 153; op <= 168; op++)
+    Operands[op] = 2;				/* branches */
+  for (op = 178; op <= 184; op++)
+    Operands[op] = 2;				/* fields, invokes */
+  Operands[187] = Operands[189] = Operands[192] = Operands[193] = 2;
+  Operands[198] = Operands[199] = 2;
+  Operands[197] = 3;
+  Operands[185] = Operands[200] = Operands[201] = 4;
+  Operands[170] = Operands[171] = Operands[196] = -2;
+  Operands[186] = -1;				/* invokedynamic */
+}
+
+typedef struct
+{
+  long start, length;	/* of the code, in the file */
+  int *ordinal;		/* which instruction starts at each pc, or -1 */
+  char *frame;		/* by pc: NeedFrame and HasFrame */
+  int maps;		/* there is a StackMapTable */
+  int max_locals;
+} Code;
+
+enum { NeedFrame = 1, HasFrame = 2 };
+
+/* the instruction a branch goes to, which has to start one */
+int Target(ClassFile *c, Code *code, long pc, long offset)
+{
+  long to = pc + offset;
+  if ((to < 0) || (to >= code->length) || (code->ordinal[to] < 0))
+    Bad(c, "the branch at pc %ld does not go to an instruction", pc);
+  code->frame[to] |= NeedFrame;
+  return code->ordinal[to];
+}
+
+/* which local variable the instruction at p uses, and how many slots
+   it takes, or -1 */
+long Local(ClassFile *c, long p, int op, int *slots)
+{
+  int wide = (op == 196), type;
+  long index;
+  if (wide)
+    op = Get(c, p + 1, 1);
+  if ((op >= 26) && (op <= 45))
+    type = (op - 26) / 4, index = (op - 26) % 4;
+  else if ((op >= 59) && (op <= 78))
+    type = (op - 59) / 4, index = (op - 59) % 4;
+  else if (((op >= 21) && (op <= 25)) || ((op >= 54) && (op <= 58)) ||
+	   (op == 132) || (op == 169))
+  {
+    type = (op <= 25) ? op - 21 : (op <= 58) ? op - 54 : 0;
+    index = Get(c, p + 1 + wide, 1 + wide);
+  }
+  else if (wide)
+    Bad(c, "wide %d is not an instruction", op);
+  else
+    return -1;
+  *slots = ((type == 1) || (type == 3)) ? 2 : 1;	/* long, double */
+  return index;
+}
+
+/* goes through the code once to find where the instructions start, and
+   then again to check them and, if out isn't 0, write them out */
+void Instructions(ClassFile *c, Code *code, FILE *out)
+{
+  long pc, p, n, low, high, length, local;
+  int pass, op, slots, count;
+  unsigned long k;
+  code->ordinal = (int *) malloc((code->length + 1) * sizeof(int));
+  code->frame = (char *) calloc(code->length + 1, 1);
+  for (pc = 0; pc <= code->length; pc++)
+    code->ordinal[pc] = -1;
+  for (pass = 0; pass < 2; pass++)
+    for (pc = 0, count = 0; pc < code->length; pc += length, count++)
+    {
+      p = code->start + pc;
+      op = Get(c, p, 1);
+      if (Operands[op] == -1)
+	Bad(c, "%d at pc %ld is not an instruction", op, pc);
+      length = 1 + Operands[op];
+      if ((op == 170) || (op == 171))
+      {
+	n = (pc + 4) & ~3L;		/* the operands are 4-byte aligned */
+	if (op == 170)
+	{
+	  low = (long) (int) Get(c, code->start + n + 4, 4);
+	  high = (long) (int) Get(c, code->start + n + 8, 4);
+	  if (low > high)
+	    Bad(c, "tableswitch at pc %ld goes from %ld to %ld", pc, low, high);
+	  length = n + 12 + 4 * (high - low + 1) - pc;
+	}
+	else
+	  length = n + 8 + 8 * (long) Get(c, code->start + n + 4, 4) - pc;
+      }
+      else if (op == 196)
+	length = (Get(c, p + 1, 1) == 132) ? 6 : 4;
+      if (pc + length > code->length)
+	Bad(c, "the instruction at pc %ld runs off the end of the code", pc);
+      if (pass == 0)
+      {
+	code->ordinal[pc] = count;
+	continue;
+      }
+      /* goto, goto_w, ret, the returns, athrow and the switches */
+      if ((op == 167) || (op == 200) || ((op >= 169) && (op <= 177)) ||
+	  (op == 191))
+	code->frame[pc + length] |= NeedFrame;
+      if ((local = Local(c, p, op, &slots)) >= 0)
+	if (local + slots > code->max_locals)
+	  Bad(c, "pc %ld uses local %ld, but max_locals is %d", pc, local,
+	      code->max_locals);
+      /* ldc_w is written as ldc, and goto_w and jsr_w as goto and jsr */
+      if (out)
+	fprintf(out, "  %d: %d", count, (op == 19) ? 18 : (op == 200) ? 167 :
+		(op == 201) ? 168 : op);
+      if ((op == 18) || (op == 19) || (op == 20) ||
+	  ((op >= 178) && (op <= 185)) || (op == 187) || (op == 189) ||
+	  (op == 192) || (op == 193) || (op == 197))
+      {
+	k = Get(c, p + 1, (op == 18) ? 1 : 2);
+	if ((op == 18) || (op == 19))
+	  Want(c, k, "a constant for ldc", Integer, Float, String, 0);
+	else if (op == 20)
+	  Want(c, k, "a constant for ldc2_w", Long, Double, 0);
+	else if (op <= 181)
+	  Want(c, k, "a field", Fieldref, 0);
+	else if (op <= 184)
+	  Want(c, k, "a method", Methodref, 0);
+	else if (op == 185)
+	  Want(c, k, "an interface method", InterfaceMethodref, 0);
+	else
+	  Want(c, k, "a class", Class, 0);
+	if (out)
+	{
+	  fprintf(out, " ");
+	  Constant(c, out, k);
+	  if ((op == 185) || (op == 197))
+	    fprintf(out, " %lu", Get(c, p + 3, 1));
+	}
+      }
+      else if (((op >= 153) && (op <= 168)) || (op == 198) || (op == 199))
+      {
+	n = Target(c, code, pc, (long) (short) Get(c, p + 1, 2));
+	if (out) fprintf(out, " -> %ld", n);
+      }
+      else if ((op == 200) || (op == 201))
+      {
+	n = Target(c, code, pc, (long) (int) Get(c, p + 1, 4));
+	if (out) fprintf(out, " -> %ld", n);
+      }
+      else if ((op == 170) || (op == 171))
+      {
+	n = code->start + ((pc + 4) & ~3L);
+	k = Target(c, code, pc, (long) (int) Get(c, n, 4));
+	if (out) fprintf(out, " default -> %lu", k);
+	if (op == 170)
+	  for (low = (long) (int) Get(c, n + 4, 4), n += 12; n < p + length;
+	       n += 4, low++)
+	  {
+	    k = Target(c, code, pc, (long) (int) Get(c, n, 4));
+	    if (out) fprintf(out, " %ld -> %lu", low, k);
+	  }
+	else
+	  for (n += 8; n < p + length; n += 8)
+	  {
+	    if ((n > code->start + ((pc + 4) & ~3L) + 8) &&
+		((int) Get(c, n - 8, 4) >= (int) Get(c, n, 4)))
+	      Bad(c, "the lookupswitch at pc %ld is not in order", pc);
+	    k = Target(c, code, pc, (long) (int) Get(c, n + 4, 4));
+	    if (out) fprintf(out, " %ld -> %lu", (long) (int) Get(c, n, 4), k);
+	  }
+      }
+      else if (out)
+	for (n = 1; n < length; n++)
+	  fprintf(out, " %lu", Get(c, p + n, 1));
+      if (out) fprintf(out, "\n");
+    }
+}
+
+/* an instruction's start, or with end set, the end of the code too */
+int Start(Code *code, long pc, int end)
+{
+  if ((pc == code->length) && end)
+    return 1;
+  return (pc >= 0) && (pc < code->length) && (code->ordinal[pc] >= 0);
+}
+
+void Attributes(ClassFile *c, FILE *out, Code *code);
+
+void ReadCode(ClassFile *c, FILE *out, long end)
+{
+  Code code;
+  long n, at;
+  unsigned long k;
+  int max_stack = Read(c, 2);
+  code.max_locals = Read(c, 2);
+  code.length = Read(c, 4);
+  code.start = c->at;
+  if ((code.length == 0) || (code.length >= 65536))
+    Bad(c, "a method has %ld bytes of code", code.length);
+  Get(c, code.start + code.length - 1, 1);
+  if (out) fprintf(out, "  max_stack %d max_locals %d\n", max_stack,
+		   code.max_locals);
+  Instructions(c, &code, out);
+  c->at += code.length;
+  for (n = Read(c, 2); n > 0; n--)
+  {
+    at = c->at;
+    c->at += 8;
+    if (!Start(&code, Get(c, at, 2), 0) || !Start(&code, Get(c, at + 2, 2), 1)
+	|| (Get(c, at, 2) >= Get(c, at + 2, 2))
+	|| !Start(&code, Get(c, at + 4, 2), 0))
+      Bad(c, "an exception handler's pcs are not instructions");
+    code.frame[Get(c, at + 4, 2)] |= NeedFrame;
+    if ((k = Get(c, at + 6, 2)) != 0)
+      Want(c, k, "a class to catch", Class, 0);
+    if (out)
+    {
+      fprintf(out, "  catch %d to %d at %d ",
+	      code.ordinal[Get(c, at, 2)], ((long) Get(c, at + 2, 2) == code.length)
+	      ? (int) code.length : code.ordinal[Get(c, at + 2, 2)],
+	      code.ordinal[Get(c, at + 4, 2)]);
+      if (k) Constant(c, out, k);
+      else fprintf(out, "anything");
+      fprintf(out, "\n");
+    }
+  }
+  code.maps = 0;
+  Attributes(c, out, &code);
+  if (c->at != end)
+    Bad(c, "a Code attribute is the wrong length");
+  /* from version 50 on the JVM only falls back to the old verifier
+     when there isn't a StackMapTable, which javaa never needs for
+     the code it is tested on */
+  for (n = 0; (code.maps || (c->major >= 50)) && (n < code.length); n++)
+    if (code.frame[n] == NeedFrame)
+      Bad(c, code.maps ? "the StackMapTable has no frame for pc %ld"
+	  : "there is no StackMapTable, but pc %ld needs a frame", n);
+  free(code.ordinal);
+  free(code.frame);
+}
+
+/* checks count verification types at c->at */
+void Types(ClassFile *c, Code *code, long count)
+{
+  int tag;
+  unsigned long pc;
+  for (; count > 0; count--)
+  {
+    tag = Read(c, 1);
+    if (tag == 7)
+      Want(c, Read(c, 2), "a class for a StackMapTable frame", Class, 0);
+    else if (tag == 8)
+    {
+      pc = Read(c, 2);
+      if (!Start(code, pc, 0) || (Get(c, code->start + pc, 1) != 187))
+	Bad(c, "an uninitialized object in a StackMapTable frame does not "
+	    "come from a new");
+    }
+    else if (tag > 8)
+      Bad(c, "%d is not a verification type", tag);
+  }
+}
+
+/* checks that each frame of the StackMapTable at c->at is at an
+   instruction and marks it in code->frame */
+void StackMapTable(ClassFile *c, Code *code, long end)
+{
+  long n, pc = -1;
+  int type;
+  if (code->maps)
+    Bad(c, "a Code attribute has two StackMapTables");
+  code->maps = 1;
+  for (n = Read(c, 2); n > 0; n--)
+  {
+    type = Read(c, 1);
+    if (type < 64)
+      pc += type + 1;
+    else if (type < 128)
+    {
+      pc += type - 64 + 1;
+      Types(c, code, 1);
+    }
+    else if (type < 247)
+      Bad(c, "%d is not a StackMapTable frame type", type);
+    else
+    {
+      pc += Read(c, 2) + 1;
+      if (type == 247)
+	Types(c, code, 1);
+      else if ((type > 251) && (type < 255))
+	Types(c, code, type - 251);
+      else if (type == 255)
+      {
+	Types(c, code, Read(c, 2));
+	Types(c, code, Read(c, 2));
+      }
+    }
+    if (!Start(code, pc, 0))
+      Bad(c, "a StackMapTable frame at pc %ld is not at an instruction", pc);
+    code->frame[pc] |= HasFrame;
+  }
+  if (c->at != end)
+    Bad(c, "a StackMapTable is the wrong length");
+}
+
+/* checks the attributes at c->at, and writes out the ones that aren't
+   only for debuggers.  code is the Code the attributes belong to. */
+void Attributes(ClassFile *c, FILE *out, Code *code)
+{
+  long n, i, at, length, end;
+  unsigned long name;
+  for (n = Read(c, 2); n > 0; n--)
+  {
+    name = Read(c, 2);
+    Want(c, name, "an attribute name", Utf8, 0);
+    length = Read(c, 4);
+    end = c->at + length;
+    if (end > c->length)
+      Bad(c, "an attribute runs off the end");
+    if (IsNamed(c, name, "Code"))
+    {
+      if (code)
+	Bad(c, "a Code attribute has a Code attribute");
+      ReadCode(c, out, end);
+    }
+    else if (IsNamed(c, name, "ConstantValue"))
+    {
+      if (length != 2)
+	Bad(c, "a ConstantValue attribute is the wrong length");
+      Want(c, Read(c, 2), "a constant value", Integer, Float, Long, Double,
+	   String, 0);
+      if (out)
+      {
+	fprintf(out, "  = ");
+	Constant(c, out, Get(c, c->at - 2, 2));
+	fprintf(out, "\n");
+      }
+    }
+    else if (IsNamed(c, name, "LineNumberTable") && code)
+    {
+      if (length != 2 + 4 * (long) Get(c, c->at, 2))
+	Bad(c, "a LineNumberTable is the wrong length");
+      for (i = 0; i < (long) Get(c, c->at, 2); i++)
+	if (!Start(code, Get(c, c->at + 2 + 4 * i, 2), 0))
+	  Bad(c, "a line number is not at an instruction");
+    }
+    else if (IsNamed(c, name, "LocalVariableTable") && code)
+    {
+      /* javaa gives a variable that is declared but never used a
+	 start_pc of 0xffff, so only the names and slots are checked */
+      if (length != 2 + 10 * (long) Get(c, c->at, 2))
+	Bad(c, "a LocalVariableTable is the wrong length");
+      for (i = 0; i < (long) Get(c, c->at, 2); i++)
+      {
+	at = c->at + 2 + 10 * i;
+	Want(c, Get(c, at + 4, 2), "a local variable name", Utf8, 0);
+	Want(c, Get(c, at + 6, 2), "a local variable type", Utf8, 0);
+	if ((int) Get(c, at + 8, 2) >= code->max_locals)
+	  Bad(c, "local variable %lu is past max_locals", Get(c, at + 8, 2));
+      }
+    }
+    else if (IsNamed(c, name, "StackMapTable") && code)
+      StackMapTable(c, code, end);
+    else if (IsNamed(c, name, "SourceFile") && !code)
+    {
+      if (length != 2)
+	Bad(c, "a SourceFile attribute is the wrong length");
+      Want(c, Get(c, c->at, 2), "a source file name", Utf8, 0);
+    }
+    else if (out && !IsNamed(c, name, "StackMapTable"))
+    {
+      fprintf(out, "  attribute ");
+      Constant(c, out, name);
+      for (i = 0; i < length; i++)
+	fprintf(out, " %02x", c->b[c->at + i]);
+      fprintf(out, "\n");
+    }
+    c->at = end;
+  }
+}
+
+/* the fields or the methods */
+void Members(ClassFile *c, FILE *out, const char *what)
+{
+  long n;
+  unsigned long access;
+  for (n = Read(c, 2); n > 0; n--)
+  {
+    access = Read(c, 2);
+    Want(c, Get(c, c->at, 2), "a member name", Utf8, 0);
+    Want(c, Get(c, c->at + 2, 2), "a signature", Utf8, 0);
+    if (out)
+    {
+      fprintf(out, "%s 0x%04lx ", what, access);
+      Constant(c, out, Read(c, 2));
+      fprintf(out, " ");
+      Constant(c, out, Read(c, 2));
+      fprintf(out, "\n");
+    }
+    else
+      c->at += 4;
+    Attributes(c, out, 0);
+  }
+}
+
+/* checks the class file, writing it out as it goes if out isn't 0 */
+void Check(ClassFile *c, FILE *out)
+{
+  long n;
+  c->at = 0;
+  if (Read(c, 4) != 0xCAFEBABE)
+    Bad(c, "is not a class file");
+  c->minor = Read(c, 2);
+  c->major = Read(c, 2);
+  ReadPool(c);
+  Want(c, Get(c, c->at + 2, 2), "this class", Class, 0);
+  if (Get(c, c->at + 4, 2) != 0)
+    Want(c, Get(c, c->at + 4, 2), "the superclass", Class, 0);
+  if (out)
+  {
+    fprintf(out, "0x%04lx ", Get(c, c->at, 2));
+    Constant(c, out, Get(c, c->at + 2, 2));
+    fprintf(out, " extends ");
+    if (Get(c, c->at + 4, 2)) Constant(c, out, Get(c, c->at + 4, 2));
+    else fprintf(out, "nothing");
+    fprintf(out, "\n");
+  }
+  c->at += 6;
+  for (n = Read(c, 2); n > 0; n--)
+  {
+    Want(c, Get(c, c->at, 2), "an interface", Class, 0);
+    if (out)
+    {
+      fprintf(out, "implements ");
+      Constant(c, out, Get(c, c->at, 2));
+      fprintf(out, "\n");
+    }
+    c->at += 2;
+  }
+  Members(c, out, "field");
+  Members(c, out, "method");
+  Attributes(c, out, 0);
+  if (c->at != c->length)
+    Bad(c, "has %ld bytes after the end of the class", c->length - c->at);
+}
+
+void Load(ClassFile *c, const char *name)
+{
+  FILE *in = fopen(name, "rb");
+  memset(c, 0, sizeof(*c));
+  c->name = name;
+  if (in == NULL)
+    Bad(c, "can't open it");
+  fseek(in, 0, SEEK_END);
+  c->length = ftell(in);
+  rewind(in);
+  c->b = (unsigned char *) malloc(c->length + 1);
+  if (fread(c->b, 1, c->length, in) != (size_t) c->length)
+    Bad(c, "can't read it");
+  fclose(in);
+}
+
+/* the description of a class, in a temporary file */
+FILE *Describe(ClassFile *c)
+{
+  FILE *out = tmpfile();
+  if (out == NULL)
+    Bad(c, "can't make a temporary file");
+  Check(c, out);
+  rewind(out);
+  return out;
+}
+
+int main(int argc, char *argv[])
+{
+  ClassFile reference, c;
+  FILE *a, *b;
+  char lineA[4096], lineB[4096];
+  int line, gotA, gotB;
+  SetOperands();
+  if ((argc == 3) && (strcmp(argv[1], "-d") == 0))
+  {
+    Load(&c, argv[2]);
+    Check(&c, stdout);
+    return 0;
+  }
+  if (argc == 2)
+  {
+    Load(&c, argv[1]);
+    Check(&c, 0);
+    return 0;
+  }
+  if (argc != 3)
+  {
+    fprintf(stderr, "Usage: classcheck [-d] file.class | "
+	    "classcheck reference.class file.class\n");
+    return 1;
+  }
+  Load(&reference, argv[1]);
+  Load(&c, argv[2]);
+  a = Describe(&reference);
+  b = Describe(&c);
+  for (line = 1; ; line++)
+  {
+    gotA = fgets(lineA, sizeof(lineA), a) != NULL;
+    gotB = fgets(lineB, sizeof(lineB), b) != NULL;
+    if (!gotA && !gotB)
+      return 0;
+    if (!gotA || !gotB || (strcmp(lineA, lineB) != 0))
+      break;
+  }
+  fprintf(stderr, "%s is not the same class as %s, from line %d "
+	  "of classcheck -d:\n", c.name, reference.name, line);
+  fprintf(stderr, "  %s", gotA ? lineA : "(the end)\n");
+  fprintf(stderr, "  %s", gotB ? lineB : "(the end)\n");
+  return 1;
+}
@@ -0,0 +1,140 @@
+/* The assembler used to keep everything about the file it was working on
+   in globals, which meant one file per run.  Now that state lives in an
+   AssemblerContext, and Ctx points at the one for the file this thread
+   is assembling. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "arena.h"
+#include "listing.h"
+#include "context.h"
+
+thread_local AssemblerContext *Ctx;
+
+/* Work space that is only needed while one method, or the class file, is
+   being put together.  It is too big to leave in the arena until the file
+   is done, so it is freed as soon as the work is, but every block is on
+   Ctx->scratch until then.  If an oops() abandons the file halfway
+   through, FreeAssemblerContext frees whatever is still there. */
+typedef
+   struct ScratchBlock {
+      struct ScratchBlock *prev;
+      struct ScratchBlock *next;
+   }
+ScratchBlock;
+
+#define SCRATCH_HEADER ((long) ((sizeof(ScratchBlock) + 15) & ~15))
+#define SCRATCH_DATA(b) ((void *) ((char *) (b) + SCRATCH_HEADER))
+#define SCRATCH_BLOCK(p) ((ScratchBlock *) ((char *) (p) - SCRATCH_HEADER))
+
+/* a fresh context whose listing goes to listfp and errors to errfp */
+AssemblerContext *NewAssemblerContext(FILE *listfp, FILE *errfp)
+{
+  AssemblerContext *context;
+  /* no oops() here: there's no context to report it in yet */
+  if ((context = (AssemblerContext *) calloc(1, sizeof(AssemblerContext)))
+      == NULL)
+  {
+    fprintf(errfp, "out of storage for assembler\n");
+    exit(1);
+  }
+  InitArena(&context->arena);
+  context->NestLevel = StartNestLevel;
+  context->listfp = listfp;
+  context->errfp = errfp;
+  return context;
+}
+
+void FreeAssemblerContext(AssemblerContext *context)
+{
+  long i;
+  for (i = 0; i < context->MethodsSize; i++)
+  {
+    if (context->Methods[i] == NULL) continue;
+    free(context->Methods[i]->Code);
+    free(context->Methods[i]->LabelRefs);
+  }
+  free(context->Methods);
+  free(context->SwitchEntries);
+  free(context->currentmethod.Code);
+  free(context->currentmethod.LabelRefs);
+  free(context->Names);
+  free(context->SymbolHash);
+  while (context->scratch != NULL)
+  {
+    ScratchBlock *next = context->scratch->next;
+    free(context->scratch);
+    context->scratch = next;
+  }
+  FreeArena(&context->arena);
+  free(context);
+}
+
+/* size bytes from the current file's arena.  They go away with the rest
+   of the context, so there is no freeing them one at a time. */
+void *Allocate(long size)
+{
+  void *p;
+  if ((p = ArenaAlloc(&Ctx->arena, size)) == NULL)
+     oops("out of storage for assembler");
+  return p;
+}
+
+/* a copy of str in the current file's arena */
+char *CopyString(const char *str)
+{
+  return strcpy((char *) Allocate(strlen(str) + 1), str);
+}
+
+static void LinkScratch(ScratchBlock *b)
+{
+  b->prev = NULL;
+  b->next = Ctx->scratch;
+  if (b->next != NULL) b->next->prev = b;
+  Ctx->scratch = b;
+}
+
+static void UnlinkScratch(ScratchBlock *b)
+{
+  if (b->prev != NULL) b->prev->next = b->next;
+  else Ctx->scratch = b->next;
+  if (b->next != NULL) b->next->prev = b->prev;
+}
+
+/* size bytes of work space, all zero, until FreeScratch */
+void *AllocateScratch(long size)
+{
+  ScratchBlock *b;
+  if ((b = (ScratchBlock *) calloc(1, SCRATCH_HEADER + size)) == NULL)
+     oops("out of storage for assembler");
+  LinkScratch(b);
+  return SCRATCH_DATA(b);
+}
+
+/* p, from AllocateScratch (or NULL), made size bytes long; whatever is
+   past the old end is not cleared */
+void *ReallocateScratch(void *p, long size)
+{
+  ScratchBlock *b;
+  ScratchBlock *moved;
+  if (p == NULL) return AllocateScratch(size);
+  b = SCRATCH_BLOCK(p);
+  UnlinkScratch(b);
+  if ((moved = (ScratchBlock *) realloc(b, SCRATCH_HEADER + size)) == NULL)
+  {
+    LinkScratch(b);
+    oops("out of storage for assembler");
+  }
+  LinkScratch(moved);
+  return SCRATCH_DATA(moved);
+}
+
+void FreeScratch(void *p)
+{
+  ScratchBlock *b;
+  if (p == NULL) return;
+  b = SCRATCH_BLOCK(p);
+  UnlinkScratch(b);
+  free(b);
+}
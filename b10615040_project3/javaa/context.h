@@ -0,0 +1,10 @@
+/* The assembler context of the file being assembled on this thread.
+   See context.c */
+extern thread_local AssemblerContext *Ctx;
+AssemblerContext *NewAssemblerContext(FILE *, FILE *);
+void FreeAssemblerContext(AssemblerContext *);
+void *Allocate(long);
+char *CopyString(const char *);
+void *AllocateScratch(long);
+void *ReallocateScratch(void *, long);
+void FreeScratch(void *);
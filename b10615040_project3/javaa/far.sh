@@ -0,0 +1,22 @@
+#!/bin/sh
+# writes Far.jasm, a method just long enough that its last ifeq only goes
+# out of range once the constant pool is in order: the ldc_w's before it
+# become ldc's, which moves the lookupswitch after it so that its padding
+# grows by 3 bytes.  So RenumberCode has to turn the ifeq around a goto_w
+# after the StackMapTable has been made, and the code after the goto_w
+# needs the frame ComputeStackMap kept aside for it (see make test).
+awk 'BEGIN {
+  print "class Far\n{\n  method public static int f(int)\n  max_stack 3\n  {"
+  print "    ldc \"a\"\n    pop\n    ldc \"b\"\n    pop"
+  print "    iload 0\n    ifeq Str"
+  print "    getstatic java.io.PrintStream java.lang.System.out\n    goto Go"
+  print "Str:\n    ldc \"t\""
+  print "Go:\n    getstatic java.io.PrintStream java.lang.System.out"
+  print "    iload 0\n    ifne Far\n    pop"
+  print "    getstatic java.io.InputStream java.lang.System.in"
+  print "    iload 0\n    ifeq Far\n    nop"
+  print "    iload 0\n    tableswitch 0 to 0 default Sw { Sw }\nSw:"
+  for (i = 0; i < 10913; i++) print "    iinc 0 1"
+  print "    pop\n    pop\n    iconst_1\n    ireturn"
+  print "Far:\n    pop\n    pop\n    iconst_0\n    ireturn\n  }\n}"
+}'
@@ -8,6 +8,9 @@
 #include "build.h"
 #include "gram.h"
 #include "listing.h"
+#include "bytewriter.h"
+#include "bytecode.h"
+#include "context.h"
 
 #define CONSTANT_Class -10
 #define CONSTANT_Fieldref -11
@@ -23,106 +26,50 @@
 
 
 int UseStdOut;
-
-signed long GetLabel(char*, long, long);
+int DumpConstPool = 1;  /* javaa -q and -nodump turn this off */
+int OptimizeCode = 0;   /* javaa -O */
+int ClassStats = 0;     /* javaa --stats */
+int StackMaps = 1;      /* javaa -nostackmap turns this off */
+
+signed long GetLabel(char*);
+void AddLabelToCode(char*, long, int);
+void ResolveLabels();
+char* MethodName();
+void OptimizeCurrentMethod();
+void CheckMaxStack();
+void MakeStackMap();
 
 OpCodeTranslator OpCodeArray[202];
 int OpCodeArrayCounter;
 OpCodeTranslator ConstTypeArray[12];
 int ConstTypeArrayCounter;
-/* char Code[1000]; */
-/* int CodeCounter; */
-ConstPoolEntry ConstPool[1000];
-int ConstPoolArrayIndex; /*current Const Pool array number*/
-int ConstPoolIndex; /*current Const Pool index number (as Java VM thinks it is)*/
-int ConstPoolRealIndex[1000];  /* this holds the "real" index into the 
-				constant pool.  The indexes in the
-				ConstPoolEntry type are really indexes into
-				this array which holds the "true" index, in
-				case we want to implement priority */
-thisclassstruct ThisClass;
-short SuperClass;
-FieldInfo field[50];
-short FieldCount;
-methodname * methodnameshead;
-MethodInfo currentmethod;
-/*MethodInfo method[10];*/
-short MethodCount;
-
 char* GetLocalVarSigFromSlot(int);
 
 void copyshort2char(char* myarrayptr, short int myint)
 {
-  // memcpy(myarrayptr,&myint,2);
-  int c = 0;
-  myarrayptr[c++] = (char) myint >> 8;
-  myarrayptr[c++] = (char) myint & 0xFF;
-}
-
-
-void outshort2char(short int myint, FILE* myoutfp)
-{
-  // fwrite(&myint,2,1,myoutfp);
-  fputc(myint >> 8, myoutfp);
-  fputc(myint & 0xFF, myoutfp);
+  StoreU2(myarrayptr, myint);
 }
 
 void copylong2char(char* myarrayptr, long myint)
 {
-  // memcpy(myarrayptr,&myint,4);
-  int c = 0;
-  myarrayptr[c++] = (char) myint >> 24;
-  myarrayptr[c++] = (char) (myint & 0xFFFFFF) >> 16;
-  myarrayptr[c++] = (char) (myint & 0xFFFF) >> 8;
-  myarrayptr[c++] = (char) myint & 0xFF;
+  StoreU4(myarrayptr, myint);
 }
 
-void outlong2char(long myint, FILE* myoutfp)
+/* makes room for count more bytes of code in the current method */
+static void ReserveCode(long count)
 {
-  // fwrite(&myint,4,1,myoutfp);
-  fputc(myint >> 24, myoutfp);
-  fputc((myint & 0xFFFFFF) >> 16, myoutfp);
-  fputc((myint & 0xFFFF) >> 8, myoutfp);
-  fputc(myint & 0xFF, myoutfp);
-}
-
-void outfloat2char(float myfloat, FILE* myoutfp)
-{
-  // fwrite(&myfloat,4,1,myoutfp);
-  int myint;
-  memcpy(&myint, &myfloat, 4);
-  fputc(myint >> 24, myoutfp);
-  fputc((myint & 0xFFFFFF) >> 16, myoutfp);
-  fputc((myint & 0xFFFF) >> 8, myoutfp);
-  fputc(myint & 0xFF, myoutfp);
-}
-
-void outlonglong2char(long long int mylong, FILE* myoutfp)
-{
-  // fwrite(&mylong,8,1,myoutfp);
-  fputc(mylong >> 56, myoutfp);
-  fputc((mylong & 0xFFFFFFFFFFFFFF) >> 48, myoutfp);
-  fputc((mylong & 0xFFFFFFFFFFFF) >> 40, myoutfp);
-  fputc((mylong & 0xFFFFFFFFFF) >> 32, myoutfp);
-  fputc((mylong & 0xFFFFFFFF) >> 24, myoutfp);
-  fputc((mylong & 0xFFFFFF) >> 16, myoutfp);
-  fputc((mylong & 0xFFFF) >> 8, myoutfp);
-  fputc(mylong & 0xFF, myoutfp);
-}
-
-void outdouble2char(double mydouble, FILE* myoutfp)
-{
-  // fwrite(&mydouble,8,1,myoutfp);
-  long long int  mylong;
-  memcpy(&mylong, &mydouble, 8);
-  fputc(mylong >> 56, myoutfp);
-  fputc((mylong & 0xFFFFFFFFFFFFFF) >> 48, myoutfp);
-  fputc((mylong & 0xFFFFFFFFFFFF) >> 40, myoutfp);
-  fputc((mylong & 0xFFFFFFFFFF) >> 32, myoutfp);
-  fputc((mylong & 0xFFFFFFFF) >> 24, myoutfp);
-  fputc((mylong & 0xFFFFFF) >> 16, myoutfp);
-  fputc((mylong & 0xFFFF) >> 8, myoutfp);
-  fputc(mylong & 0xFF, myoutfp);
+  long needed = Ctx->currentmethod.CodeCounter + count;
+  long newsize;
+  char* newcode;
+  if (needed > 65535) oops("Method is too large.");
+  if (needed <= Ctx->currentmethod.CodeSize) return;
+  newsize = (Ctx->currentmethod.CodeSize > 0) ?
+	    Ctx->currentmethod.CodeSize * 2 : 256;
+  if (newsize < needed) newsize = needed;
+  newcode = (char*) realloc(Ctx->currentmethod.Code, newsize);
+  if (newcode == NULL) oops("out of storage for code");
+  Ctx->currentmethod.Code = newcode;
+  Ctx->currentmethod.CodeSize = newsize;
 }
 
 /* this function simply takes the passed char and puts it in the next
@@ -130,31 +77,22 @@ void outdouble2char(double mydouble, FILE* myoutfp)
 */
 void AddToCode(char mychar)
 {
-  currentmethod.Code[currentmethod.CodeCounter++] = mychar;
+  ReserveCode(1);
+  Ctx->currentmethod.Code[Ctx->currentmethod.CodeCounter++] = mychar;
 }
 
 void AddShortToCode(short myshort)
 {
-  // memcpy(&currentmethod.Code[currentmethod.CodeCounter],&myshort,2);
-  // currentmethod.CodeCounter +=2;
-  currentmethod.Code[currentmethod.CodeCounter++] = 
-	  		(char) myshort >> 8;
-  currentmethod.Code[currentmethod.CodeCounter++] = 
-	  		(char) myshort & 0xFF;
+  ReserveCode(2);
+  StoreU2(&Ctx->currentmethod.Code[Ctx->currentmethod.CodeCounter], myshort);
+  Ctx->currentmethod.CodeCounter += 2;
 }
 
 void AddLongToCode(long mylong)
 {
-  // memcpy(&currentmethod.Code[currentmethod.CodeCounter],&mylong,4);
-  // currentmethod.CodeCounter +=4;
-  currentmethod.Code[currentmethod.CodeCounter++] = 
-	  		(char) mylong >> 24;
-  currentmethod.Code[currentmethod.CodeCounter++] =
-	  		(char)(mylong&0xFFFFFF)>>16;
-  currentmethod.Code[currentmethod.CodeCounter++] =
-	 		(char)(mylong&0xFFFF)>>8;
-  currentmethod.Code[currentmethod.CodeCounter++] = 
-	  		(char) mylong & 0xFF;
+  ReserveCode(4);
+  StoreU4(&Ctx->currentmethod.Code[Ctx->currentmethod.CodeCounter], mylong);
+  Ctx->currentmethod.CodeCounter += 4;
 }
 
 void EnterConstType(int myconsttype, char mybyteval)
@@ -189,11 +127,11 @@ short int InConstPool(char myconsttype, char* mystringval)
     case CONSTANT_Utf8:
     {
       i = 1;
-      while (i < ConstPoolArrayIndex) 
+      while (i < Ctx->ConstPoolArrayIndex) 
       {
-        if ((myconsttype == ConstPool[i].consttype) &&
-            (strcmp(mystringval, ConstPool[i].stringval) == 0)) 
-          return ConstPool[i].myindex;
+        if ((myconsttype == Ctx->ConstPool[i].consttype) &&
+            (strcmp(mystringval, Ctx->ConstPool[i].stringval) == 0)) 
+          return Ctx->ConstPool[i].myindex;
         else
           i++;
        }
@@ -206,11 +144,11 @@ short int InConstPool(char myconsttype, char* mystringval)
       temp = InConstPool(CONSTANT_Utf8, mystringval);
       if (temp == -1) return -1;  /* no Utf8 with that name */
       i = 1;
-      while (i < ConstPoolArrayIndex) 
+      while (i < Ctx->ConstPoolArrayIndex) 
       {
-         if ((myconsttype == ConstPool[i].consttype) &&
-             (ConstPool[i].index1 == temp)) 
-          return ConstPool[i].myindex;
+         if ((myconsttype == Ctx->ConstPool[i].consttype) &&
+             (Ctx->ConstPool[i].index1 == temp)) 
+          return Ctx->ConstPool[i].myindex;
         else
           i++;
        }
@@ -239,12 +177,12 @@ short int InConstPool(char myconsttype, char* mystringval1, char* mystringval2)
       temp2 = InConstPool(CONSTANT_Utf8, mystringval2);
       if (temp2 == -1) return -1;  /* no Utf8 with that name */
       i = 1;
-      while (i < ConstPoolArrayIndex) 
+      while (i < Ctx->ConstPoolArrayIndex) 
       {
-         if ((myconsttype == ConstPool[i].consttype) &&
-             (ConstPool[i].index1 == temp1) &&
-             (ConstPool[i].index2 == temp2)) 
-          return ConstPool[i].myindex;
+         if ((myconsttype == Ctx->ConstPool[i].consttype) &&
+             (Ctx->ConstPool[i].index1 == temp1) &&
+             (Ctx->ConstPool[i].index2 == temp2)) 
+          return Ctx->ConstPool[i].myindex;
         else
           i++;
        }
@@ -276,12 +214,12 @@ short int InConstPool(char myconsttype, char* mystringval1, char* mystringval2,
       temp2 = InConstPool(CONSTANT_NameAndType, mystringval2, mystringval3);
       if (temp2 == -1) return -1;  /* no NameAndType */
       i = 1;
-      while (i < ConstPoolArrayIndex) 
+      while (i < Ctx->ConstPoolArrayIndex) 
       {
-         if ((myconsttype == ConstPool[i].consttype) &&
-             (ConstPool[i].index1 == temp1) &&
-             (ConstPool[i].index2 == temp2)) 
-          return ConstPool[i].myindex;
+         if ((myconsttype == Ctx->ConstPool[i].consttype) &&
+             (Ctx->ConstPool[i].index1 == temp1) &&
+             (Ctx->ConstPool[i].index2 == temp2)) 
+          return Ctx->ConstPool[i].myindex;
         else
           i++;
        }
@@ -307,11 +245,11 @@ short int InConstPool(char myconsttype, long int mylong)
     case CONSTANT_Integer:
     {
       i = 0;
-      while (i < ConstPoolArrayIndex) 
+      while (i < Ctx->ConstPoolArrayIndex) 
       {
-         if ((myconsttype == ConstPool[i].consttype) &&
-             (ConstPool[i].intval == mylong)) 
-          return ConstPool[i].myindex;
+         if ((myconsttype == Ctx->ConstPool[i].consttype) &&
+             (Ctx->ConstPool[i].intval == mylong)) 
+          return Ctx->ConstPool[i].myindex;
         else
           i++;
        }
@@ -336,11 +274,11 @@ short int InConstPool(char myconsttype, float myfloat)
     case CONSTANT_Float:
     {
       i = 0;
-      while (i < ConstPoolArrayIndex) 
+      while (i < Ctx->ConstPoolArrayIndex) 
       {
-         if ((myconsttype == ConstPool[i].consttype) &&
-             (ConstPool[i].floatval == myfloat)) 
-          return ConstPool[i].myindex;
+         if ((myconsttype == Ctx->ConstPool[i].consttype) &&
+             (Ctx->ConstPool[i].floatval == myfloat)) 
+          return Ctx->ConstPool[i].myindex;
         else
           i++;
        }
@@ -366,11 +304,11 @@ short int InConstPool(char myconsttype, long long int mylong)
     case CONSTANT_Long:
     {
       i = 0;
-      while (i < ConstPoolArrayIndex) 
+      while (i < Ctx->ConstPoolArrayIndex) 
       {
-         if ((myconsttype == ConstPool[i].consttype) &&
-             (ConstPool[i].longval == mylong)) 
-          return ConstPool[i].myindex;
+         if ((myconsttype == Ctx->ConstPool[i].consttype) &&
+             (Ctx->ConstPool[i].longval == mylong)) 
+          return Ctx->ConstPool[i].myindex;
         else
           i++;
        }
@@ -395,11 +333,11 @@ short int InConstPool(char myconsttype, double mydouble)
     case CONSTANT_Double:
     {
       i = 0;
-      while (i < ConstPoolArrayIndex) 
+      while (i < Ctx->ConstPoolArrayIndex) 
       {
-         if ((myconsttype == ConstPool[i].consttype) &&
-             (ConstPool[i].doubleval == mydouble))  
-          return ConstPool[i].myindex;
+         if ((myconsttype == Ctx->ConstPool[i].consttype) &&
+             (Ctx->ConstPool[i].doubleval == mydouble))  
+          return Ctx->ConstPool[i].myindex;
         else
           i++;
        }
@@ -429,23 +367,22 @@ short GenConst(char myconsttype, char* mystringval)
   //message("In GenConst");
   checkresult = InConstPool(myconsttype, mystringval);
   if (checkresult >= 0) return checkresult;
-  toreturn = ConstPoolIndex;
-  touse = ConstPoolArrayIndex;
-  ConstPoolArrayIndex++;
-  ConstPoolIndex++;
-  ConstPool[touse].consttype = myconsttype;
-  ConstPool[touse].myindex = toreturn;
+  toreturn = Ctx->ConstPoolIndex;
+  touse = Ctx->ConstPoolArrayIndex;
+  Ctx->ConstPoolArrayIndex++;
+  Ctx->ConstPoolIndex++;
+  Ctx->ConstPool[touse].consttype = myconsttype;
+  Ctx->ConstPool[touse].myindex = toreturn;
   switch(myconsttype) {
     case CONSTANT_Utf8:
     {
-      ConstPool[touse].stringval = (char *) malloc(strlen(mystringval));
-      strcpy(ConstPool[touse].stringval, mystringval);
+      Ctx->ConstPool[touse].stringval = CopyString(mystringval);
       break;
     }
     case CONSTANT_String:
     case CONSTANT_Class:
     {
-      ConstPool[touse].index1 = GenConst(CONSTANT_Utf8,mystringval);
+      Ctx->ConstPool[touse].index1 = GenConst(CONSTANT_Utf8,mystringval);
       break;
     }
     default:
@@ -466,17 +403,17 @@ short GenConst(char myconsttype, char* mystringval1, char* mystringval2)
   //message("In GenConst");
   checkresult = InConstPool(myconsttype, mystringval1, mystringval2);
   if (checkresult >= 0) return checkresult;
-  toreturn = ConstPoolIndex;
-  touse = ConstPoolArrayIndex;
-  ConstPoolIndex++;
-  ConstPoolArrayIndex++;
-  ConstPool[touse].consttype = myconsttype;
-  ConstPool[touse].myindex = toreturn;
+  toreturn = Ctx->ConstPoolIndex;
+  touse = Ctx->ConstPoolArrayIndex;
+  Ctx->ConstPoolIndex++;
+  Ctx->ConstPoolArrayIndex++;
+  Ctx->ConstPool[touse].consttype = myconsttype;
+  Ctx->ConstPool[touse].myindex = toreturn;
   switch(myconsttype) {
     case CONSTANT_NameAndType:
     {
-      ConstPool[touse].index1 = GenConst(CONSTANT_Utf8,mystringval1);
-      ConstPool[touse].index2 = GenConst(CONSTANT_Utf8,mystringval2);
+      Ctx->ConstPool[touse].index1 = GenConst(CONSTANT_Utf8,mystringval1);
+      Ctx->ConstPool[touse].index2 = GenConst(CONSTANT_Utf8,mystringval2);
       break;
     }
     default:
@@ -499,19 +436,19 @@ short GenConst(char myconsttype, char* mystringval1, char* mystringval2,
   checkresult = InConstPool(myconsttype, mystringval1, mystringval2, 
 			    mystringval3);
   if (checkresult >= 0) return checkresult;
-  toreturn = ConstPoolIndex;
-  touse = ConstPoolArrayIndex;
-  ConstPoolIndex++;
-  ConstPoolArrayIndex++;
-  ConstPool[touse].consttype = myconsttype;
-  ConstPool[touse].myindex = toreturn;
+  toreturn = Ctx->ConstPoolIndex;
+  touse = Ctx->ConstPoolArrayIndex;
+  Ctx->ConstPoolIndex++;
+  Ctx->ConstPoolArrayIndex++;
+  Ctx->ConstPool[touse].consttype = myconsttype;
+  Ctx->ConstPool[touse].myindex = toreturn;
   switch(myconsttype) {
     case CONSTANT_Fieldref:
     case CONSTANT_Methodref:
     case CONSTANT_InterfaceMethodref:
     {
-      ConstPool[touse].index1 = GenConst(CONSTANT_Class,mystringval1);
-      ConstPool[touse].index2 = GenConst(CONSTANT_NameAndType,
+      Ctx->ConstPool[touse].index1 = GenConst(CONSTANT_Class,mystringval1);
+      Ctx->ConstPool[touse].index2 = GenConst(CONSTANT_NameAndType,
 					    mystringval2, mystringval3);
       break;
     }
@@ -533,16 +470,16 @@ short GenConst(char myconsttype, long int mylong)
   //message("In GenConst");
   checkresult = InConstPool(myconsttype, mylong); 
   if (checkresult >= 0) return checkresult;
-  toreturn = ConstPoolIndex;
-  touse = ConstPoolArrayIndex;
-  ConstPoolIndex++;
-  ConstPoolArrayIndex++;
-  ConstPool[touse].consttype = myconsttype;
-  ConstPool[touse].myindex = toreturn;
+  toreturn = Ctx->ConstPoolIndex;
+  touse = Ctx->ConstPoolArrayIndex;
+  Ctx->ConstPoolIndex++;
+  Ctx->ConstPoolArrayIndex++;
+  Ctx->ConstPool[touse].consttype = myconsttype;
+  Ctx->ConstPool[touse].myindex = toreturn;
   switch(myconsttype) {
     case CONSTANT_Integer:
     {
-      ConstPool[touse].intval = mylong; 
+      Ctx->ConstPool[touse].intval = mylong; 
       break;
     }
     default:
@@ -563,16 +500,16 @@ short GenConst(char myconsttype, float myfloat)
   //message("In GenConst");
   checkresult = InConstPool(myconsttype, myfloat); 
   if (checkresult >= 0) return checkresult;
-  toreturn = ConstPoolIndex;
-  touse = ConstPoolArrayIndex;
-  ConstPoolIndex++;
-  ConstPoolArrayIndex++;
-  ConstPool[touse].consttype = myconsttype;
-  ConstPool[touse].myindex = toreturn;
+  toreturn = Ctx->ConstPoolIndex;
+  touse = Ctx->ConstPoolArrayIndex;
+  Ctx->ConstPoolIndex++;
+  Ctx->ConstPoolArrayIndex++;
+  Ctx->ConstPool[touse].consttype = myconsttype;
+  Ctx->ConstPool[touse].myindex = toreturn;
   switch(myconsttype) {
     case CONSTANT_Float:
     {
-      ConstPool[touse].floatval = myfloat; 
+      Ctx->ConstPool[touse].floatval = myfloat; 
       break;
     }
     default:
@@ -593,17 +530,17 @@ short GenConst(char myconsttype, long long int mylong)
   //message("In GenConst");
   checkresult = InConstPool(myconsttype, mylong); 
   if (checkresult >= 0) return checkresult;
-  toreturn = ConstPoolIndex;
-  touse = ConstPoolArrayIndex;
-  ConstPoolIndex++;
-  ConstPoolIndex++;
-  ConstPoolArrayIndex++;
-  ConstPool[touse].consttype = myconsttype;
-  ConstPool[touse].myindex = toreturn;
+  toreturn = Ctx->ConstPoolIndex;
+  touse = Ctx->ConstPoolArrayIndex;
+  Ctx->ConstPoolIndex++;
+  Ctx->ConstPoolIndex++;
+  Ctx->ConstPoolArrayIndex++;
+  Ctx->ConstPool[touse].consttype = myconsttype;
+  Ctx->ConstPool[touse].myindex = toreturn;
   switch(myconsttype) {
     case CONSTANT_Long:
     {
-      ConstPool[toreturn].longval = mylong; 
+      Ctx->ConstPool[touse].longval = mylong; 
       break;
     }
     default:
@@ -624,17 +561,17 @@ short GenConst(char myconsttype, double mydouble)
   //message("In GenConst");
   checkresult = InConstPool(myconsttype,mydouble); 
   if (checkresult >= 0) return checkresult;
-  toreturn = ConstPoolIndex;
-  touse = ConstPoolArrayIndex;
-  ConstPoolIndex++;
-  ConstPoolIndex++;
-  ConstPoolArrayIndex++;
-  ConstPool[touse].consttype = myconsttype;
-  ConstPool[touse].myindex = toreturn;
+  toreturn = Ctx->ConstPoolIndex;
+  touse = Ctx->ConstPoolArrayIndex;
+  Ctx->ConstPoolIndex++;
+  Ctx->ConstPoolIndex++;
+  Ctx->ConstPoolArrayIndex++;
+  Ctx->ConstPool[touse].consttype = myconsttype;
+  Ctx->ConstPool[touse].myindex = toreturn;
   switch(myconsttype) {
     case CONSTANT_Double:
     {
-      ConstPool[touse].doubleval = mydouble; 
+      Ctx->ConstPool[touse].doubleval = mydouble; 
       break;
     }
     default:
@@ -667,47 +604,47 @@ char GetOpCode(int myopcode)
 void SetThisClass(short access_flags, char* classname, char* superclassname)
 {
   //message(superclassname);
-  ThisClass.access_flags = access_flags | ACC_SUPER;
-  ThisClass.classindex = GenConst(CONSTANT_Class,classname);
-  ThisClass.classname = classname;
-  ThisClass.superclassindex = GenConst(CONSTANT_Class,superclassname);
-  ThisClass.superclassname = superclassname;
-  ThisClass.interfacecount = 0;
-  ThisClass.interfacehead = NULL;
-  ThisClass.sourcefileindex = -1;  /* it will get set later */
+  Ctx->ThisClass.access_flags = access_flags | ACC_SUPER;
+  Ctx->ThisClass.classindex = GenConst(CONSTANT_Class,classname);
+  Ctx->ThisClass.classname = classname;
+  Ctx->ThisClass.superclassindex = GenConst(CONSTANT_Class,superclassname);
+  Ctx->ThisClass.superclassname = superclassname;
+  Ctx->ThisClass.interfacecount = 0;
+  Ctx->ThisClass.interfacehead = NULL;
+  Ctx->ThisClass.sourcefileindex = -1;  /* it will get set later */
 }
 
 char* GetThisClass()
 {
-  return ThisClass.classname;
+  return Ctx->ThisClass.classname;
 } 
 
 char* GetSuperClass()
 {
-  return ThisClass.superclassname;
+  return Ctx->ThisClass.superclassname;
 }
 
 
 void SetSourceFile(char* name)
 {
-  ThisClass.sourcefileindex = GenConst(CONSTANT_Utf8, name);
-  GenConst(CONSTANT_Utf8, "SourceFile"); /* will be used when outputting this
-					    attribute */
+  Ctx->ThisClass.sourcefileindex = GenConst(CONSTANT_Utf8, name);
 }
 
 void AddToInterfaceList(char* name)
 {
   interfaceentry* toadd;
-  toadd = (interfaceentry*) malloc(sizeof(interfaceentry));
+  toadd = (interfaceentry*) Allocate(sizeof(interfaceentry));
   toadd->index = GenConst(CONSTANT_Class, name);
-  toadd->next = ThisClass.interfacehead;
-  ThisClass.interfacehead = toadd;
-  ThisClass.interfacecount++;
+  toadd->next = Ctx->ThisClass.interfacehead;
+  Ctx->ThisClass.interfacehead = toadd;
+  Ctx->ThisClass.interfacecount++;
 }
  
 
  
-void InitAssembler()
+/* the opcode and constant type tables are the same for every file, so
+   they're filled in once, before any file gets assembled */
+void InitOpCodeTables()
 {
    OpCodeArrayCounter = 0;
    EnterOpCode(AALOAD, 50);
@@ -924,38 +861,317 @@ void InitAssembler()
    EnterConstType(CONSTANT_Double, 6);
    EnterConstType(CONSTANT_NameAndType, 12);
    EnterConstType(CONSTANT_Utf8, 1);
-   ConstPoolIndex = 1;
-   ConstPoolArrayIndex = 1;
-   for (int i=1;i<1000;i++) ConstPoolRealIndex[i]=i; 
+}
+
+void InitAssembler()
+{
+   Ctx->ConstPoolIndex = 1;
+   Ctx->ConstPoolArrayIndex = 1;
+   for (int i=1;i<1000;i++) Ctx->ConstPoolRealIndex[i]=i; 
    //message("Done with InitAssembler");
    //printf("OpCodeArrayCounter is %i\n", OpCodeArrayCounter);
-   MethodCount = 0;
-   FieldCount = 0;
-   methodnameshead = NULL;
+   Ctx->MethodCount = 0;
+   Ctx->FieldCount = 0;
+}
+
+/* The constant pool is built in the order things are first seen, and the
+   indexes GenConst hands out (myindex) are only provisional.  Once the
+   whole class is in, OrderConstPool counts the references to each entry,
+   drops the ones nothing refers to, and sorts the rest: constants that
+   are loaded with ldc come first, the most-loaded first, so as many of
+   them as possible get an index below 256 and can use the 2 byte ldc;
+   after them everything else, most-used first.  ConstPoolRealIndex maps
+   each provisional index to the one that goes in the class file. */
+
+/* where the entry with provisional index myindex is in ConstPool.  The
+   provisional indexes go up with the array position until the pool has
+   been sorted, so we can do a binary search. */
+static int ConstEntry(short myindex)
+{
+  int low = 1;
+  int high = Ctx->ConstPoolArrayIndex - 1;
+  int middle;
+  while (low <= high)
+  {
+    middle = (low + high) / 2;
+    if (Ctx->ConstPool[middle].myindex == myindex) return middle;
+    if (Ctx->ConstPool[middle].myindex < myindex) low = middle + 1;
+    else high = middle - 1;
+  }
+  oops("Bad constant pool index.");
+  return 0;
+}
+
+/* the signature of the field or method that a Fieldref, Methodref or
+   InterfaceMethodref entry refers to, by way of its NameAndType */
+char* RefSignature(short myindex)
+{
+  ConstPoolEntry* ref = &Ctx->ConstPool[ConstEntry(myindex)];
+  ConstPoolEntry* nameandtype = &Ctx->ConstPool[ConstEntry(ref->index2)];
+  return Ctx->ConstPool[ConstEntry(nameandtype->index2)].stringval;
+}
+
+/* the name of the field or method that a ref entry refers to */
+char* RefName(short myindex)
+{
+  ConstPoolEntry* ref = &Ctx->ConstPool[ConstEntry(myindex)];
+  ConstPoolEntry* nameandtype = &Ctx->ConstPool[ConstEntry(ref->index2)];
+  return Ctx->ConstPool[ConstEntry(nameandtype->index1)].stringval;
+}
+
+/* the class, or array signature, that a Class entry names */
+char* ClassName(short myindex)
+{
+  ConstPoolEntry* entry = &Ctx->ConstPool[ConstEntry(myindex)];
+  return Ctx->ConstPool[ConstEntry(entry->index1)].stringval;
+}
+
+/* the signature of what ldc, ldc_w or ldc2_w pushes for an entry */
+const char* LoadedSignature(short myindex)
+{
+  switch (Ctx->ConstPool[ConstEntry(myindex)].consttype) {
+    case CONSTANT_Integer: return "I";
+    case CONSTANT_Float: return "F";
+    case CONSTANT_Long: return "J";
+    case CONSTANT_Double: return "D";
+    case CONSTANT_Class: return "Ljava/lang/Class;";
+  }
+  return "Ljava/lang/String;";
+}
+
+/* counts one more reference to the entry with provisional index myindex.
+   The first one also counts the entries that it refers to. */
+static void UseConst(long* uses, short myindex)
+{
+  int i;
+  if (myindex == 0) return;  /* no entry, e.g. a handler for anything */
+  i = ConstEntry(myindex);
+  if (uses[i]++ > 0) return;
+  switch (Ctx->ConstPool[i].consttype) {
+    case CONSTANT_String:
+    case CONSTANT_Class:
+    {
+      UseConst(uses, Ctx->ConstPool[i].index1);
+      break;
+    }
+    case CONSTANT_NameAndType:
+    case CONSTANT_Fieldref:
+    case CONSTANT_Methodref:
+    case CONSTANT_InterfaceMethodref:
+    {
+      UseConst(uses, Ctx->ConstPool[i].index1);
+      UseConst(uses, Ctx->ConstPool[i].index2);
+      break;
+    }
+  }
+}
+
+/* the name of an attribute that is going into the class file */
+static void UseAttributeName(long* uses, char* name)
+{
+  UseConst(uses, GenConst(CONSTANT_Utf8, name));
+}
+
+/* counts everything in a finished method that refers to the pool,
+   following the same rules MethodDump does for what gets written */
+static void CountMethodConsts(MethodInfo* m, long* uses, long* loads)
+{
+  long pc;
+  long index;
+  int op;
+  UseConst(uses, m->name_index);
+  UseConst(uses, m->signature_index);
+  if (m->CodeCounter > 0)
+  {
+    UseAttributeName(uses, "Code");
+    for (pc = 0; pc < m->CodeCounter; pc += InstructionLength(m->Code, pc))
+    {
+      if ((index = ConstOperand(m->Code, pc)) < 0) continue;
+      UseConst(uses, (short) index);
+      op = (unsigned char) m->Code[pc];
+      if ((op == OP_LDC) || (op == OP_LDC_W))
+	 loads[ConstEntry((short) index)]++;
+    }
+    for (exceptionentry* e = m->exceptionhead; e != NULL; e = e->next)
+      UseConst(uses, e->catch_type);
+    if (m->FrameCount > 1)
+    {
+      UseAttributeName(uses, "StackMapTable");
+      for (long f = 1; f < m->FrameCount; f++)
+	for (long k = 0; k < m->Frames[f].locals + m->Frames[f].stack; k++)
+	  if (m->Frames[f].types[k].tag == ITEM_Object)
+	     UseConst(uses, m->Frames[f].types[k].index);
+      for (long f = 0; f < m->SpareCount; f++)
+	for (long k = 0; k < m->Spares[f].locals + m->Spares[f].stack; k++)
+	  if (m->Spares[f].types[k].tag == ITEM_Object)
+	     UseConst(uses, m->Spares[f].types[k].index);
+    }
+    if (m->LineNumberCounter > 0) UseAttributeName(uses, "LineNumberTable");
+    if (m->UserLocalVarCounter > 0)
+    {
+      UseAttributeName(uses, "LocalVariableTable");
+      for (userlocalvarentry* u = m->userlocalvarhead; u != NULL; u = u->next)
+      {
+	UseConst(uses, u->name_index);
+	UseConst(uses, u->signature_index);
+      }
+    }
+    else if (m->LocalVarCounter >= 0)
+    {
+      UseAttributeName(uses, "LocalVariableTable");
+      for (int k = 0; k <= m->LocalVarCounter; k++)
+      {
+	UseConst(uses, m->LocalVar[k].name_index);
+	UseConst(uses, m->LocalVar[k].signature_index);
+      }
+    }
+  }
+  if (m->ThrowsCounter > 0)
+  {
+    UseAttributeName(uses, "Exceptions");
+    for (throwsentry* t = m->throwshead; t != NULL; t = t->next)
+      UseConst(uses, t->exceptionclass);
+  }
 }
 
-void ConstPoolDump(FILE* myoutfp)
+/* true if entry a goes before entry b in the final pool */
+static int ConstGoesFirst(const long* uses, const long* loads, int a, int b)
+{
+  if (loads[a] != loads[b]) return loads[a] > loads[b];
+  return uses[a] > uses[b];
+}
+
+void OrderConstPool()
+{
+  long uses[1000];
+  long loads[1000];
+  int order[1000];
+  ConstPoolEntry* sorted;
+  int count;
+  int next;
+  int i, j, k;
+
+  for (i = 0; i < 1000; i++) uses[i] = loads[i] = 0;
+  UseConst(uses, Ctx->ThisClass.classindex);
+  UseConst(uses, Ctx->ThisClass.superclassindex);
+  for (interfaceentry* t = Ctx->ThisClass.interfacehead; t != NULL; t = t->next)
+    UseConst(uses, t->index);
+  for (k = 1; k <= Ctx->FieldCount; k++)
+  {
+    UseConst(uses, Ctx->field[k].name_index);
+    UseConst(uses, Ctx->field[k].signature_index);
+    if (Ctx->field[k].constantvalue_index != 0)
+    {
+      UseAttributeName(uses, "ConstantValue");
+      UseConst(uses, Ctx->field[k].constantvalue_index);
+    }
+  }
+  for (k = 0; k < Ctx->MethodCount; k++)
+    CountMethodConsts(Ctx->Methods[k], uses, loads);
+  if (Ctx->ThisClass.sourcefileindex != -1)
+  {
+    UseAttributeName(uses, "SourceFile");
+    UseConst(uses, Ctx->ThisClass.sourcefileindex);
+  }
+
+  /* the entries that are used, in their final order (an insertion sort,
+     so that ties stay in the order they were first seen) */
+  count = 0;
+  for (i = 1; i < Ctx->ConstPoolArrayIndex; i++)
+  {
+    if (uses[i] == 0) continue;
+    for (j = count; (j > 0) && ConstGoesFirst(uses, loads, i, order[j-1]); j--)
+      order[j] = order[j-1];
+    order[j] = i;
+    count++;
+  }
+
+  sorted = (ConstPoolEntry*) malloc((count + 1) * sizeof(ConstPoolEntry));
+  if (sorted == NULL) oops("out of storage for the constant pool");
+  next = 1;
+  for (j = 1; j <= count; j++)
+  {
+    sorted[j] = Ctx->ConstPool[order[j-1]];
+    Ctx->ConstPoolRealIndex[sorted[j].myindex] = next;
+    if ((sorted[j].consttype == CONSTANT_Long) ||
+        (sorted[j].consttype == CONSTANT_Double))
+       next += 2;  /* these take up two entries */
+    else
+       next++;
+  }
+  for (j = 1; j <= count; j++) Ctx->ConstPool[j] = sorted[j];
+  free(sorted);
+  Ctx->ConstPoolArrayIndex = count + 1;
+  Ctx->ConstPoolIndex = next;
+}
+
+/* the index that goes in the class file for provisional index myindex */
+short RealIndex(short myindex)
+{
+  return (short) Ctx->ConstPoolRealIndex[(unsigned short) myindex];
+}
+
+/* puts the final constant pool indexes into a finished method's code.
+   Every ldc starts out as an ldc_w (see GenOneArgCode); the ones whose
+   constant ended up below 256 become an ldc, which moves the code. */
+void RenumberCode(MethodInfo* m)
+{
+  InstructionEdit* edits;
+  long editcount = 0;
+  long pc;
+  long index;
+  int op;
+  edits = (InstructionEdit*) malloc((m->CodeCounter / 2 + 1) *
+				    sizeof(InstructionEdit));
+  if (edits == NULL) oops("out of storage while laying out code");
+  for (pc = 0; pc < m->CodeCounter; pc += InstructionLength(m->Code, pc))
+  {
+    if ((index = ConstOperand(m->Code, pc)) < 0) continue;
+    index = (unsigned short) RealIndex((short) index);
+    op = (unsigned char) m->Code[pc];
+    if (((op == OP_LDC) || (op == OP_LDC_W)) && (index <= 255))
+    {
+      edits[editcount].pc = pc;
+      edits[editcount].length = 2;
+      edits[editcount].bytes[0] = OP_LDC;
+      edits[editcount].bytes[1] = (unsigned char) index;
+      editcount++;
+    }
+    else if (op == OP_LDC)
+    {
+      edits[editcount].pc = pc;
+      edits[editcount].length = 3;
+      edits[editcount].bytes[0] = OP_LDC_W;
+      edits[editcount].bytes[1] = (unsigned char) (index >> 8);
+      edits[editcount].bytes[2] = (unsigned char) index;
+      editcount++;
+    }
+    else
+      StoreU2(&m->Code[pc + 1], (short) index);
+  }
+  RelayoutMethod(m, edits, editcount);
+  free(edits);
+}
+
+void ConstPoolDump(ByteWriter* w)
 {
   short int mylen;
-  outshort2char(ConstPoolIndex, myoutfp);
-  for(int i=1;i<ConstPoolArrayIndex;i++)
+  PutU2(w, Ctx->ConstPoolIndex);
+  for(int i=1;i<Ctx->ConstPoolArrayIndex;i++)
   {
-    putc(GetConstType(ConstPool[i].consttype), myoutfp);
-    switch(ConstPool[i].consttype) {
+    PutU1(w, GetConstType(Ctx->ConstPool[i].consttype));
+    switch(Ctx->ConstPool[i].consttype) {
       case CONSTANT_Utf8:
       {
-	mylen = strlen(ConstPool[i].stringval);
-        outshort2char(mylen, myoutfp);
-        for(int j=0;j<mylen;j++)
-        {
-          putc(ConstPool[i].stringval[j], myoutfp);
-        }
+	mylen = strlen(Ctx->ConstPool[i].stringval);
+        PutU2(w, mylen);
+        PutBytes(w, Ctx->ConstPool[i].stringval, mylen);
         break;
       }
       case CONSTANT_String:
       case CONSTANT_Class:
       {
-        outshort2char(ConstPoolRealIndex[ConstPool[i].index1], myoutfp);
+        PutU2(w, Ctx->ConstPoolRealIndex[Ctx->ConstPool[i].index1]);
         break;
       }
       case CONSTANT_NameAndType:
@@ -963,28 +1179,28 @@ void ConstPoolDump(FILE* myoutfp)
       case CONSTANT_Methodref:
       case CONSTANT_InterfaceMethodref: 
       {
-        outshort2char(ConstPoolRealIndex[ConstPool[i].index1], myoutfp);
-        outshort2char(ConstPoolRealIndex[ConstPool[i].index2], myoutfp);
+        PutU2(w, Ctx->ConstPoolRealIndex[Ctx->ConstPool[i].index1]);
+        PutU2(w, Ctx->ConstPoolRealIndex[Ctx->ConstPool[i].index2]);
         break;
       }
       case CONSTANT_Integer:
       {
-        outlong2char(ConstPool[i].intval, myoutfp);
+        PutU4(w, Ctx->ConstPool[i].intval);
         break;
       }
       case CONSTANT_Float:
       {
-        outfloat2char(ConstPool[i].floatval, myoutfp);
+        PutFloat(w, Ctx->ConstPool[i].floatval);
         break;
       }
       case CONSTANT_Long:
       {
-        outlonglong2char(ConstPool[i].longval, myoutfp);
+        PutU8(w, Ctx->ConstPool[i].longval);
         break;
       }
       case CONSTANT_Double:
       {
-        outdouble2char(ConstPool[i].doubleval, myoutfp);
+        PutDouble(w, Ctx->ConstPool[i].doubleval);
         break;
       }
       default:
@@ -997,188 +1213,264 @@ void ConstPoolDump(FILE* myoutfp)
 }
 
 
-/* very simple file copy.  Probably should use system reads and writes */
-void CopyMethod(char* aname, FILE* myoutfp)
+/* the entries of a frame's locals or stack as the StackMapTable lists
+   them: a long or double is one entry for its two words, and with trim
+   the locals at the end that hold nothing are left off */
+static long FrameEntries(const VerifyType* words, long count, int trim,
+			 const VerifyType** entries)
 {
-   int mychar;
-   FILE *myinfp;
-   if ((myinfp = fopen(aname, "r")) == 0)
-     oops("Couldn't open method file for copying");
-   mychar = fgetc(myinfp);
-   while(mychar != EOF)
-   {
-     fputc(mychar,myoutfp);
-     mychar = fgetc(myinfp);
-   }
-   fclose(myinfp);
+  long n = 0;
+  for (long i = 0; i < count; i++)
+  {
+    entries[n++] = &words[i];
+    if ((words[i].tag == ITEM_Long) || (words[i].tag == ITEM_Double)) i++;
+  }
+  if (trim)
+    while ((n > 0) && (entries[n-1]->tag == ITEM_Top)) n--;
+  return n;
 }
-      
-  
 
-void MethodDump(MethodInfo mymethod, FILE* outfp)
+/* how many of the first entries of a and b are the same */
+static long SameEntries(const VerifyType** a, long na, const VerifyType** b,
+			long nb)
 {
-  int i;
-  int lastlocal;
+  long i;
+  for (i = 0; (i < na) && (i < nb); i++)
+  {
+    if (a[i]->tag != b[i]->tag) break;
+    if ((a[i]->tag == ITEM_Object) && (a[i]->index != b[i]->index)) break;
+    if ((a[i]->tag == ITEM_Uninitialized) && (a[i]->pc != b[i]->pc)) break;
+  }
+  return i;
+}
+
+static void PutVerifyTypes(ByteWriter* w, const VerifyType** entries, long n)
+{
+  for (long i = 0; i < n; i++)
+  {
+    PutU1(w, entries[i]->tag);
+    if (entries[i]->tag == ITEM_Object) PutU2(w, RealIndex(entries[i]->index));
+    else if (entries[i]->tag == ITEM_Uninitialized) PutU2(w, entries[i]->pc);
+  }
+}
+
+/* the StackMapTable attribute, less its name and length.  Each frame is
+   written in the shortest form that gets from the one before it. */
+static void StackMapDump(MethodInfo* m, ByteWriter* w)
+{
+  const VerifyType** last;
+  const VerifyType** locals;
+  const VerifyType** stack;
+  const VerifyType** swap;
+  long nlast, nlocals, nstack, same, delta;
+  long lastpc = -1;
+  StackMapFrame* f;
+  last = (const VerifyType**) malloc((m->Frames[0].locals + 1) * sizeof(VerifyType*));
+  locals = (const VerifyType**) malloc((m->Frames[0].locals + 1) * sizeof(VerifyType*));
+  stack = (const VerifyType**) malloc((m->max_stack + 1) * sizeof(VerifyType*));
+  if ((last == NULL) || (locals == NULL) || (stack == NULL))
+     oops("out of storage for the StackMapTable");
+  nlast = FrameEntries(m->Frames[0].types, m->Frames[0].locals, 1, last);
+  PutU2(w, m->FrameCount - 1);
+  for (long k = 1; k < m->FrameCount; k++)
+  {
+    f = &m->Frames[k];
+    delta = f->pc - lastpc - 1;
+    lastpc = f->pc;
+    nlocals = FrameEntries(f->types, f->locals, 1, locals);
+    nstack = FrameEntries(f->types + f->locals, f->stack, 0, stack);
+    same = SameEntries(last, nlast, locals, nlocals);
+    if ((nstack == 0) && (same == nlast) && (same == nlocals))
+    {
+      if (delta <= 63) PutU1(w, delta);  /* same_frame */
+      else
+      {
+	PutU1(w, 251);  /* same_frame_extended */
+	PutU2(w, delta);
+      }
+    }
+    else if ((nstack == 1) && (same == nlast) && (same == nlocals))
+    {
+      if (delta <= 63) PutU1(w, 64 + delta);  /* same_locals_1_stack_item */
+      else
+      {
+	PutU1(w, 247);
+	PutU2(w, delta);
+      }
+      PutVerifyTypes(w, stack, 1);
+    }
+    else if ((nstack == 0) && (same == nlocals) && (nlast - nlocals <= 3))
+    {
+      PutU1(w, 251 - (nlast - nlocals));  /* chop_frame */
+      PutU2(w, delta);
+    }
+    else if ((nstack == 0) && (same == nlast) && (nlocals - nlast <= 3))
+    {
+      PutU1(w, 251 + (nlocals - nlast));  /* append_frame */
+      PutU2(w, delta);
+      PutVerifyTypes(w, locals + nlast, nlocals - nlast);
+    }
+    else
+    {
+      PutU1(w, 255);  /* full_frame */
+      PutU2(w, delta);
+      PutU2(w, nlocals);
+      PutVerifyTypes(w, locals, nlocals);
+      PutU2(w, nstack);
+      PutVerifyTypes(w, stack, nstack);
+    }
+    swap = last;
+    last = locals;
+    locals = swap;
+    nlast = nlocals;
+  }
+  free(last);
+  free(locals);
+  free(stack);
+}
+
+void MethodDump(MethodInfo* mymethod, ByteWriter* w)
+{
+  ByteWriter stackmap;
   int codeattlen;
   short additionalattrib; 
   short additionalcodeattrib; 
   throwsentry* tempthrow;
-  throwsentry* todiethrow;
   linenumberentry* templinenum;
-  linenumberentry* todielinenum;
   userlocalvarentry* tempuserlocalvar;
-  userlocalvarentry* todieuserlocalvar;
-  outshort2char(mymethod.access_flags, outfp);
-  outshort2char(mymethod.name_index, outfp);
-  outshort2char(mymethod.signature_index, outfp);
+  PutU2(w, mymethod->access_flags);
+  PutU2(w, RealIndex(mymethod->name_index));
+  PutU2(w, RealIndex(mymethod->signature_index));
   additionalattrib = 0;
-  if (mymethod.CodeCounter > 0) additionalattrib++;
-  if (mymethod.ThrowsCounter > 0) additionalattrib++;
-  outshort2char(additionalattrib, outfp); /* attributes count */
-  if (mymethod.CodeCounter > 0)
+  if (mymethod->CodeCounter > 0) additionalattrib++;
+  if (mymethod->ThrowsCounter > 0) additionalattrib++;
+  PutU2(w, additionalattrib); /* attributes count */
+  if (mymethod->CodeCounter > 0)
   {
-    outshort2char(GenConst(CONSTANT_Utf8,"Code"), outfp);
-           /* this should really only be a lookup here since the 
-              constant pool is already dumped. But it won't be dumped
-	      yet if we dump methods to separate files first!*/
+    PutU2(w, RealIndex(GenConst(CONSTANT_Utf8,"Code")));
+           /* only a lookup: OrderConstPool made sure it was there */
 
     /* stack local codelen, exceptiontbllen, attribcnt */
-    // codeattlen = mymethod.CodeCounter+8;
-    codeattlen = mymethod.CodeCounter+12;
-    /*codeattlen = mymethod.CodeCounter+4;*/
-    if (mymethod.ExceptionsCounter > 0)
-       codeattlen += mymethod.ExceptionsCounter * 8;
-    if (mymethod.LineNumberCounter > 0)
-       codeattlen += 8 + (mymethod.LineNumberCounter * 4);
-    if (mymethod.UserLocalVarCounter > 0) /*use user-defined local var table
+    codeattlen = mymethod->CodeCounter+12;
+    if (mymethod->ExceptionsCounter > 0)
+       codeattlen += mymethod->ExceptionsCounter * 8;
+    InitByteWriter(&stackmap);
+    if (mymethod->FrameCount > 1)
+    {
+       StackMapDump(mymethod, &stackmap);
+       codeattlen += 6 + stackmap.len;
+    }
+    if (mymethod->LineNumberCounter > 0)
+       codeattlen += 8 + (mymethod->LineNumberCounter * 4);
+    if (mymethod->UserLocalVarCounter > 0) /*use user-defined local var table
 					    first */
     {
-       codeattlen += 8 + (mymethod.UserLocalVarCounter * 10);
+       codeattlen += 8 + (mymethod->UserLocalVarCounter * 10);
     }
     else
     {
-      if (mymethod.LocalVarCounter >= 0)
-         codeattlen += 8 + ((mymethod.LocalVarCounter + 1) * 10);
+      if (mymethod->LocalVarCounter >= 0)
+         codeattlen += 8 + ((mymethod->LocalVarCounter + 1) * 10);
     }
-    outlong2char(codeattlen,outfp); /* length of whole attribute */
-    /* the next lines are commented out and changed below because
-       although the documentation says u2 u2 u4 for the lengths, the
-       actual class file appears to be u1 u1 u2 */
-    //outshort2char(5,outfp); /* max stack - let user specify? */
-    //outshort2char(0,outfp); /* max_locals - can let user specify or
-//				  can derive from signature and other vars? */
-        
-    //outlong2char(mymethod.CodeCounter,outfp);
-    //putc(5,outfp);
-    //putc(2,outfp);
-    outshort2char(mymethod.max_stack, outfp);
-    //putc(mymethod.max_stack & 0x00FF, outfp);
+    PutU4(w, codeattlen); /* length of whole attribute */
+    PutU2(w, mymethod->max_stack);
     /* output max_locals -- if user specifically defined it, use that,
        otherwise use the slot number of the last variable */
-    if (mymethod.max_locals > -1)
+    if (mymethod->max_locals > -1)
     {
-       outshort2char(mymethod.max_locals, outfp);
-       //putc(mymethod.max_locals & 0x00FF, outfp);
+       PutU2(w, mymethod->max_locals);
     }
     else
     {
-       outshort2char(mymethod.currentslot, outfp);
-       //putc(mymethod.currentslot & 0x00FF, outfp);
-    }
-    outlong2char(mymethod.CodeCounter,outfp);
-    //outshort2char(mymethod.CodeCounter,outfp);
-    i = 0;
-    while (i < mymethod.CodeCounter)
-    {
-      putc(mymethod.Code[i],outfp);
-      i++;
+       PutU2(w, mymethod->currentslot);
     }
+    PutU4(w, mymethod->CodeCounter);
+    PutBytes(w, mymethod->Code, mymethod->CodeCounter);
     /* output exceptions table */
-    outshort2char(mymethod.ExceptionsCounter,outfp); 
-    for(exceptionentry* tempexception = mymethod.exceptionhead;
+    PutU2(w, mymethod->ExceptionsCounter); 
+    for(exceptionentry* tempexception = mymethod->exceptionhead;
         tempexception != NULL; tempexception = tempexception->next)
     {
-      outshort2char(tempexception->start_pc, outfp); 
-      outshort2char(tempexception->end_pc, outfp); 
-      outshort2char(tempexception->handler_pc, outfp); 
-      outshort2char(tempexception->catch_type, outfp); 
+      /* start_pc, end_pc, handler_pc */
+      PutU2Array(w, &tempexception->start_pc, 3);
+      PutU2(w, RealIndex(tempexception->catch_type));
     }
 
     /*calculate the number of additional attributes*/
     additionalcodeattrib = 0;
-    if (mymethod.LineNumberCounter > 0) additionalcodeattrib++;
-    if ((mymethod.UserLocalVarCounter > 0) || (mymethod.LocalVarCounter >= 0)) 
+    if (mymethod->FrameCount > 1) additionalcodeattrib++;
+    if (mymethod->LineNumberCounter > 0) additionalcodeattrib++;
+    if ((mymethod->UserLocalVarCounter > 0) || (mymethod->LocalVarCounter >= 0)) 
        additionalcodeattrib++;
-    outshort2char(additionalcodeattrib, outfp);
+    PutU2(w, additionalcodeattrib);
+
+    if (mymethod->FrameCount > 1)
+    {
+      PutU2(w, RealIndex(GenConst(CONSTANT_Utf8,"StackMapTable")));
+      PutU4(w, stackmap.len);
+      PutWriter(w, &stackmap);
+    }
+    FreeByteWriter(&stackmap);
 
     /*output line number table, if any */
-    if (mymethod.LineNumberCounter > 0)
+    if (mymethod->LineNumberCounter > 0)
     {
-      outshort2char(GenConst(CONSTANT_Utf8,"LineNumberTable"), outfp);
-      outlong2char(2 + (mymethod.LineNumberCounter * 4), outfp);
-      outshort2char(mymethod.LineNumberCounter, outfp);
-      templinenum = mymethod.linenumberhead;
+      PutU2(w, RealIndex(GenConst(CONSTANT_Utf8,"LineNumberTable")));
+      PutU4(w, 2 + (mymethod->LineNumberCounter * 4));
+      PutU2(w, mymethod->LineNumberCounter);
+      templinenum = mymethod->linenumberhead;
       while(templinenum != NULL)
       {
-        outshort2char(templinenum->start_pc, outfp);
-        outshort2char(templinenum->line_number, outfp);
-        todielinenum = templinenum;
+        PutU2Array(w, &templinenum->start_pc, 2);
         templinenum = templinenum->next;
-        free(todielinenum);
       }
     }
 
     /*output local variable table -- do the user-defined one, if there is one,
       otherwise do the generated one. */
-    if (mymethod.UserLocalVarCounter > 0)
+    if (mymethod->UserLocalVarCounter > 0)
     {
-      outshort2char(GenConst(CONSTANT_Utf8,"LocalVariableTable"), outfp);
-      outlong2char(2 + (mymethod.UserLocalVarCounter * 10), outfp);
-      outshort2char(mymethod.UserLocalVarCounter, outfp);
-      tempuserlocalvar = mymethod.userlocalvarhead;
+      PutU2(w, RealIndex(GenConst(CONSTANT_Utf8,"LocalVariableTable")));
+      PutU4(w, 2 + (mymethod->UserLocalVarCounter * 10));
+      PutU2(w, mymethod->UserLocalVarCounter);
+      tempuserlocalvar = mymethod->userlocalvarhead;
       while(tempuserlocalvar != NULL)
       {
-        outshort2char(tempuserlocalvar->start_pc, outfp);
-        outshort2char(tempuserlocalvar->length, outfp);
-        outshort2char(tempuserlocalvar->name_index, outfp);
-        outshort2char(tempuserlocalvar->signature_index, outfp);
-        outshort2char(tempuserlocalvar->slot, outfp);
-        todieuserlocalvar = tempuserlocalvar;
+        PutU2Array(w, &tempuserlocalvar->start_pc, 2); /* start_pc, length */
+        PutU2(w, RealIndex(tempuserlocalvar->name_index));
+        PutU2(w, RealIndex(tempuserlocalvar->signature_index));
+        PutU2(w, tempuserlocalvar->slot);
         tempuserlocalvar = tempuserlocalvar->next;
-        free(todieuserlocalvar);
       }
     }
     else
     {
-      if (mymethod.LocalVarCounter >= 0)
+      if (mymethod->LocalVarCounter >= 0)
       {
-        outshort2char(GenConst(CONSTANT_Utf8,"LocalVariableTable"), outfp);
-        outlong2char((long)((mymethod.LocalVarCounter + 1) * 10) + 2, outfp);
-        outshort2char(mymethod.LocalVarCounter + 1, outfp);
-        for (int k =0; k <= mymethod.LocalVarCounter; k++)
+        PutU2(w, RealIndex(GenConst(CONSTANT_Utf8,"LocalVariableTable")));
+        PutU4(w, (long)((mymethod->LocalVarCounter + 1) * 10) + 2);
+        PutU2(w, mymethod->LocalVarCounter + 1);
+        for (int k =0; k <= mymethod->LocalVarCounter; k++)
         {
-          outshort2char(mymethod.LocalVar[k].start_pc,outfp);
-          outshort2char(mymethod.LocalVar[k].length,outfp);
-          outshort2char(mymethod.LocalVar[k].name_index,outfp);
-          outshort2char(mymethod.LocalVar[k].signature_index,outfp);
-          outshort2char(mymethod.LocalVar[k].slot,outfp);
+          PutU2Array(w, &mymethod->LocalVar[k].start_pc, 2);
+          PutU2(w, RealIndex(mymethod->LocalVar[k].name_index));
+          PutU2(w, RealIndex(mymethod->LocalVar[k].signature_index));
+          PutU2(w, mymethod->LocalVar[k].slot);
         }
       }
     }
   }
   /* output throws (exceptions) table, if any */
-  if (mymethod.ThrowsCounter > 0)
+  if (mymethod->ThrowsCounter > 0)
   {
-    outshort2char(GenConst(CONSTANT_Utf8,"Exceptions"), outfp);
-    outlong2char(2 + (mymethod.ThrowsCounter * 2), outfp); /* attrib length */
-    outshort2char(mymethod.ThrowsCounter, outfp); /* exception tbl length */
-    tempthrow = mymethod.throwshead;
+    PutU2(w, RealIndex(GenConst(CONSTANT_Utf8,"Exceptions")));
+    PutU4(w, 2 + (mymethod->ThrowsCounter * 2)); /* attrib length */
+    PutU2(w, mymethod->ThrowsCounter); /* exception tbl length */
+    tempthrow = mymethod->throwshead;
     while(tempthrow != NULL)
     {
-      outshort2char(tempthrow->exceptionclass, outfp);
-      todiethrow = tempthrow;
+      PutU2(w, RealIndex(tempthrow->exceptionclass));
       tempthrow = tempthrow->next;
-      free(todiethrow);
     }
   }
     
@@ -1187,97 +1479,162 @@ void MethodDump(MethodInfo mymethod, FILE* outfp)
         
 
 
+/* the string in the entry with provisional index myindex, once the
+   pool has been put in order and the binary search won't work */
+static char* SortedConstString(short myindex)
+{
+  for (int i = 1; i < Ctx->ConstPoolArrayIndex; i++)
+    if (Ctx->ConstPool[i].myindex == myindex) return Ctx->ConstPool[i].stringval;
+  return "";
+}
+
+/* text as a JSON string */
+static void PutJsonString(FILE* fp, const char* text)
+{
+  putc('"', fp);
+  for (; *text != '\0'; text++)
+  {
+    if ((*text == '"') || (*text == '\\')) fprintf(fp, "\\%c", *text);
+    else if ((unsigned char) *text < ' ') fprintf(fp, "\\u%04x", *text);
+    else putc(*text, fp);
+  }
+  putc('"', fp);
+}
+
+/* javaa --stats: what went into the class file, as one line of JSON, so
+   that sizes can be kept track of from one version to the next */
+void ClassStatsDump(long classbytes)
+{
+  static const struct { int consttype; const char* name; } types[] = {
+    {CONSTANT_Utf8, "Utf8"}, {CONSTANT_Integer, "Integer"},
+    {CONSTANT_Float, "Float"}, {CONSTANT_Long, "Long"},
+    {CONSTANT_Double, "Double"}, {CONSTANT_Class, "Class"},
+    {CONSTANT_String, "String"}, {CONSTANT_Fieldref, "Fieldref"},
+    {CONSTANT_Methodref, "Methodref"},
+    {CONSTANT_InterfaceMethodref, "InterfaceMethodref"},
+    {CONSTANT_NameAndType, "NameAndType"}
+  };
+  FILE* fp = Ctx->listfp;
+  MethodInfo* m;
+  int count;
+  fprintf(fp, "{\"class\":");
+  PutJsonString(fp, GetThisClass());
+  fprintf(fp, ",\"bytes\":%ld,\"constant_pool\":{\"count\":%d",
+	  classbytes, Ctx->ConstPoolIndex);
+  for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++)
+  {
+    count = 0;
+    for (int i = 1; i < Ctx->ConstPoolArrayIndex; i++)
+      if (Ctx->ConstPool[i].consttype == types[t].consttype) count++;
+    fprintf(fp, ",\"%s\":%d", types[t].name, count);
+  }
+  fprintf(fp, "},\"fields\":%d,\"methods\":[", Ctx->FieldCount);
+  for (int k = 0; k < Ctx->MethodCount; k++)
+  {
+    m = Ctx->Methods[k];
+    fprintf(fp, "%s{\"name\":", (k > 0) ? "," : "");
+    PutJsonString(fp, SortedConstString(m->name_index));
+    fprintf(fp, ",\"signature\":");
+    PutJsonString(fp, SortedConstString(m->signature_index));
+    fprintf(fp, ",\"code_length\":%d,\"max_stack\":%d,\"max_locals\":%d,"
+	    "\"labels\":%d,\"fixups\":%ld,\"frames\":%ld}", m->CodeCounter,
+	    m->max_stack, (m->max_locals > -1) ? m->max_locals : m->currentslot,
+	    m->LabelCounter, m->LabelRefCounter,
+	    (m->FrameCount > 0) ? m->FrameCount - 1 : 0);
+  }
+  fprintf(fp, "]}\n");
+}
+
 void EndAssembler()
 {
    FILE *outfp;
-   int i;
-   methodname *tempmethodname;
-   methodname *todiemethodname;
+   ByteWriter classfile;
    interfaceentry* tempinterface;
-   interfaceentry* todieinterface;
+   char *filename;
+   int written;
 
-   if ((outfp = fopen(ConsStrings(GetThisClass(),".class"), "w")) == 0)
-     perror("out.class"), exit(1);
+   InitByteWriter(&classfile);
    /* Header Info */
-   putc(0xCA, outfp); /* magic number */
-   putc(0xFE, outfp);
-   putc(0xBA, outfp);
-   putc(0xBE, outfp);
-   putc(0x00, outfp); /* minor version */
-   putc(0x02, outfp);
-   putc(0x00, outfp); /* major version */
-   putc(0x2E, outfp);
+   PutU4(&classfile, 0xCAFEBABE); /* magic number */
+   if (StackMaps)
+   {  /* 50 is the first with StackMapTable, and the last where the JVM
+	 falls back to the old verifier for a method that hasn't got one */
+     PutU2(&classfile, 0x0000); /* minor version */
+     PutU2(&classfile, 0x0032); /* major version */
+   }
+   else
+   {
+     PutU2(&classfile, 0x0002); /* minor version */
+     PutU2(&classfile, 0x002E); /* major version */
+   }
    
-   i = 0;
-   printf("\nConstPool Dump:\n");
-   ConstPoolDump(outfp);
-   printf("\nEnd of ConstPool Dump\n");
-   outshort2char(ThisClass.access_flags, outfp); /* Access info */
-   outshort2char(ThisClass.classindex, outfp);
-   outshort2char(ThisClass.superclassindex, outfp);
+   OrderConstPool();
+   for (int k=0;k<Ctx->MethodCount;k++) RenumberCode(Ctx->Methods[k]);
+   if (DumpConstPool) fprintf(Ctx->listfp, "\nConstPool Dump:\n");
+   ConstPoolDump(&classfile);
+   if (DumpConstPool) fprintf(Ctx->listfp, "\nEnd of ConstPool Dump\n");
+   PutU2(&classfile, Ctx->ThisClass.access_flags); /* Access info */
+   PutU2(&classfile, RealIndex(Ctx->ThisClass.classindex));
+   PutU2(&classfile, RealIndex(Ctx->ThisClass.superclassindex));
 
    /* output interfaces (that this class implements) */
-   outshort2char(ThisClass.interfacecount, outfp);
-   tempinterface = ThisClass.interfacehead;
+   PutU2(&classfile, Ctx->ThisClass.interfacecount);
+   tempinterface = Ctx->ThisClass.interfacehead;
    while (tempinterface != NULL)
    {
-     outshort2char(tempinterface->index, outfp);
-     todieinterface = tempinterface;
+     PutU2(&classfile, RealIndex(tempinterface->index));
      tempinterface = tempinterface->next;
-     free(todieinterface);
    }
  
    /* output fields */
-   outshort2char(FieldCount, outfp);
-   for (int k=1;k<=FieldCount;k++)
+   PutU2(&classfile, Ctx->FieldCount);
+   for (int k=1;k<=Ctx->FieldCount;k++)
    {
-     outshort2char(field[k].access_flags, outfp);
-     outshort2char(field[k].name_index, outfp);
-     outshort2char(field[k].signature_index, outfp);
-     if (field[k].constantvalue_index != 0)
+     PutU2(&classfile, Ctx->field[k].access_flags);
+     PutU2(&classfile, RealIndex(Ctx->field[k].name_index));
+     PutU2(&classfile, RealIndex(Ctx->field[k].signature_index));
+     if (Ctx->field[k].constantvalue_index != 0)
      {
-       outshort2char(1,outfp); /*attributes count*/
-       outshort2char(GenConst(CONSTANT_Utf8,"ConstantValue"), outfp);
-       outlong2char(2, outfp); /* attribute length */
-       outshort2char(field[k].constantvalue_index, outfp);
+       PutU2(&classfile, 1); /*attributes count*/
+       PutU2(&classfile, RealIndex(GenConst(CONSTANT_Utf8,"ConstantValue")));
+       PutU4(&classfile, 2); /* attribute length */
+       PutU2(&classfile, RealIndex(Ctx->field[k].constantvalue_index));
      }
      else
      {
-       outshort2char(0, outfp); /*attributes count*/
+       PutU2(&classfile, 0); /*attributes count*/
      }
    }
-   outshort2char(MethodCount, outfp);
-   //printf("\nCode Dump:\n");
-   /* will want to go through linked list of method's file names and copy
-      them into outfp */
-   tempmethodname = methodnameshead;
-   while(tempmethodname != NULL)
-   {  
-     CopyMethod(tempmethodname->name, outfp);
-     remove(tempmethodname->name);
-     todiemethodname = tempmethodname;
-     tempmethodname = tempmethodname->next;
-     free(todiemethodname);
-   }
-   /*for (int j=1;j<=MethodCount;j++)
-   {
-     MethodDump(method[j], outfp);
-   }
-   */
-   if (ThisClass.sourcefileindex == -1)
+   /* output methods */
+   PutU2(&classfile, Ctx->MethodCount);
+   for (int k=0;k<Ctx->MethodCount;k++) MethodDump(Ctx->Methods[k], &classfile);
+   if (Ctx->ThisClass.sourcefileindex == -1)
    {
-     outshort2char(0, outfp); /*attributes count*/
+     PutU2(&classfile, 0); /*attributes count*/
    }
    else
    {
-     outshort2char(1, outfp); /*attributes count*/
-     outshort2char(GenConst(CONSTANT_Utf8,"SourceFile"), outfp); /* just a 
+     PutU2(&classfile, 1); /*attributes count*/
+     PutU2(&classfile, RealIndex(GenConst(CONSTANT_Utf8,"SourceFile"))); /* just a 
 						lookup at this point */
-     outlong2char(2, outfp);  /*attribute length*/
-     outshort2char(ThisClass.sourcefileindex, outfp);
+     PutU4(&classfile, 2);  /*attribute length*/
+     PutU2(&classfile, RealIndex(Ctx->ThisClass.sourcefileindex));
+   }
+   if (ClassStats) ClassStatsDump(classfile.len);
+
+   /* the file is only opened now that there's all of it to write, and
+      taken away again if it couldn't all be written */
+   filename = ConsStrings(GetThisClass(),".class");
+   if ((outfp = fopen(filename, "w")) == 0)
+     oops(ConsStrings("Can't write ", filename));
+   written = FlushByteWriter(&classfile, outfp);
+   if (fclose(outfp) != 0) written = 0;
+   FreeByteWriter(&classfile);
+   if (!written)
+   {
+     remove(filename);
+     oops(ConsStrings("error writing ", filename));
    }
-   //printf("\nEnd of Code Dump\n");
-   fclose(outfp);
 }
 
 
@@ -1340,18 +1697,10 @@ void GenOneArgCode(int opcode, ArgType arg1)
            oops("bad argument type");
          }
        } 
-       if (mytemp > CHAR_MAX)
-       {
-         AddToCode(GetOpCode(LDC_W));
-         AddShortToCode(mytemp);
-	 if (opcode != LDC_W) message("Using LDC_W");
-       }
-       else
-       { 
-         AddToCode(GetOpCode(LDC));
-         AddToCode((char) (mytemp & 0x00FF));
-	 if (opcode != LDC) message("Using LDC");
-       }
+       /* whether this can be an ldc isn't known until the constant
+	  pool has been put in order (see RenumberCode) */
+       AddToCode(GetOpCode(LDC_W));
+       AddShortToCode(mytemp);
        break;
      }
      case (LDC2_W):
@@ -1477,12 +1826,14 @@ void GenLabelArgCode(int opcode, char* arg1)
 {
    signed long location;
    signed long offset;
-   /* need to see if offset big enough to need goto_w, jsr_w, etc. */
+   long opcodelocation;
+   /* branches always start out with a 2 byte offset; ResolveLabels widens
+      the ones that turn out to be too far away once the method is done */
    //message("In GenLabelArgCode");
-   location = GetLabel(arg1, currentmethod.CodeCounter, 
-			currentmethod.CodeCounter + 1);
-   offset = location - (currentmethod.CodeCounter); /* not a valid
-					value if location is -1 */	
+   opcodelocation = Ctx->currentmethod.CodeCounter;
+   location = GetLabel(arg1);
+   offset = location - opcodelocation; /* not a valid value if location 
+					  is -1 */	
    switch (opcode)
    {
      case (IFEQ):
@@ -1501,116 +1852,40 @@ void GenLabelArgCode(int opcode, char* arg1)
      case (IF_ICMPGE):
      case (IF_ACMPEQ):
      case (IF_ACMPNE):
-     {
-       AddToCode(GetOpCode(opcode));
-       if (location == -1) /* label not yet defined */
-       {
-	 AddShortToCode((signed short) 0); /*place holder*/
-       }
-       else
-       {
-         if ((offset > 32767) || (offset < -32768))
-	 {
-	   oops("instruction used label that's too far away.");
-	 }
-	 else
-	 {
-	   AddShortToCode((signed short) offset);
-	 }
-       }
-       break;
-     }
      case (GOTO):
-     {
-       if (location == -1) /* label not yet defined */
-       {
-         // AddToCode(GetOpCode(GOTO_W));
-	 // AddLongToCode((signed long) 0); /*place holder*/
-          AddToCode(GetOpCode(GOTO));
-	  AddShortToCode((signed short) 0); /*place holder*/
-       }
-       else
-       {
-         if ((offset > 32767) || (offset < -32768))
-	 {
-	   message("Using GOTO_W");
-           AddToCode(GetOpCode(GOTO_W));
-	   AddLongToCode(offset);
-	 }
-	 else
-	 {
-           AddToCode(GetOpCode(opcode));
-	   AddShortToCode((signed short) offset);
-	 }
-       }
-       break;
-     }
      case (JSR):
      {
-       if (location == -1) /* label not yet defined */
-       {
-         AddToCode(GetOpCode(JSR_W));
-	 AddLongToCode((signed long) 0); /*place holder*/
-       }
-       else
-       {
-         if ((offset > 32767) || (offset < -32768))
-	 {
-	   message("Using JSR_W");
-           AddToCode(GetOpCode(JSR_W));
-	   AddLongToCode(offset); 
-	 }
-	 else
-	 {
-           AddToCode(GetOpCode(opcode));
-	   AddShortToCode((signed short) offset);
-	 }
-       }
+       AddToCode(GetOpCode(opcode));
+       AddLabelToCode(arg1, opcodelocation, 0);
        break;
      }
      case (GOTO_W):
      {
-       if (location == -1) /* label not yet defined */
+       if ((location != -1) && (offset <= 32767) && (offset >= -32768))
        {
-         AddToCode(GetOpCode(opcode));
-	 AddLongToCode((signed long) 0); /*place holder*/
+	 message("Optimizing: using GOTO");
+         AddToCode(GetOpCode(GOTO));
+         AddLabelToCode(arg1, opcodelocation, 0);
        }
        else
        {
-         if ((offset > 32767) || (offset < -32768))
-	 {
-           AddToCode(GetOpCode(opcode));
-	   AddLongToCode(offset); 
-	 }
-	 else
-	 {
-	   message("Optimizing: using GOTO");
-           AddToCode(GetOpCode(GOTO));
-	   AddShortToCode((signed short) offset);
-	 }
+         AddToCode(GetOpCode(opcode));
+         AddLabelToCode(arg1, opcodelocation, 1);
        }
        break;
      }
      case (JSR_W):
      {
-       if (location == -1) /* label not yet defined */
+       if ((location != -1) && (offset <= 32767) && (offset >= -32768))
        {
-         AddToCode(GetOpCode(opcode));
-	 AddLongToCode((signed long) 0); /*place holder*/
+	 message("Optimizing: using JSR");
+         AddToCode(GetOpCode(JSR));
+         AddLabelToCode(arg1, opcodelocation, 0);
        }
        else
        {
-         if ((offset > 32767) || (offset < -32768))
-	 {
-           AddToCode(GetOpCode(opcode));
-	   AddLongToCode(offset); 
-	 }
-	 else
-	 {
-	   message("Optimizing: using JSR");
-           AddToCode(GetOpCode(JSR));
-	   AddShortToCode((signed short) offset);
-	 }
+         AddToCode(GetOpCode(opcode));
+         AddLabelToCode(arg1, opcodelocation, 1);
        }
        break;
      }
@@ -1719,7 +1994,7 @@ void GenLocalVarArgCode(int opcode, int index)
    if (index > CHAR_MAX)
    {
      /* make sure the user didn't put out a wide statement already*/ 
-     if(currentmethod.Code[currentmethod.CodeCounter-1] !=
+     if(Ctx->currentmethod.Code[Ctx->currentmethod.CodeCounter-1] !=
 	 GetOpCode(WIDE))
      {  
        AddToCode(GetOpCode(WIDE));
@@ -2072,11 +2347,11 @@ void GenIINCCode(int opcode, int index, int myconst)
      oops("Constant too big for IINC instruction.");
    }
    message("In GenIINCCode.");
-   printf("%i\n",myconst);
+   if (Listing) fprintf(Ctx->listfp, "%i\n",myconst);
    if (index > CHAR_MAX)
    {
      /* make sure the user didn't put out a wide statement already*/ 
-     if(currentmethod.Code[currentmethod.CodeCounter-1] !=
+     if(Ctx->currentmethod.Code[Ctx->currentmethod.CodeCounter-1] !=
 	 GetOpCode(WIDE))
      {  
        AddToCode(GetOpCode(WIDE));
@@ -2099,162 +2374,273 @@ void GenNEWARRAYCode(int opcode, int atype)
    AddToCode((char) atype);
 }
 
-void GenLOOKUPSWITCHCode(int opcode, char* mydefault, lookupentry* head)
+/* qsort order for the cases of a switch */
+static int CompareSwitchEntries(const void* a, const void* b)
+{
+   long x = ((const SwitchEntry*) a)->match;
+   long y = ((const SwitchEntry*) b)->match;
+   return (x < y) ? -1 : (x > y);
+}
+
+/* puts out the switch whose cases have been collected in SwitchEntries.
+   The cases are sorted (a lookupswitch has to be, for the JVM's binary
+   search) and a key that is there twice is an error, unless both go to
+   the same label.  Then the switch becomes a tableswitch if the keys are
+   close enough together for a jump table to pay, and a lookupswitch if
+   not, whichever the source said, weighing space against time the same
+   way javac does. */
+static void GenSwitchCode(int written, char* mydefault)
 {
+   SwitchEntry* entries = Ctx->SwitchEntries;
+   long count = 0;
+   long i, key;
+   long long range;
+   int opcode = OP_LOOKUPSWITCH;
    int opcodelocation;
-   long j;
-   lookupentry* tempptr;
-   lookupentry* todie;
-   opcodelocation = currentmethod.CodeCounter;
-   AddToCode(GetOpCode(opcode));
-   /* add byte pad */
-   for (int i = opcodelocation % 4; (i%4 != 0); i++)
+   char text[200];
+
+   qsort(entries, Ctx->SwitchCount, sizeof(SwitchEntry), CompareSwitchEntries);
+   for (i = 0; i < Ctx->SwitchCount; i++)
+   {
+     if ((count > 0) && (entries[count-1].match == entries[i].match))
+     {
+       if (strcmp(entries[count-1].alabel, entries[i].alabel) != 0)
+       {
+	 snprintf(text, sizeof(text), "Case %ld is in the switch twice, for "
+		  "%.60s and %.60s.", entries[i].match, entries[count-1].alabel,
+		  entries[i].alabel);
+	 oops(text);
+       }
+       snprintf(text, sizeof(text), "Case %ld is in the switch twice.",
+		entries[i].match);
+       warning(text);
+       continue;
+     }
+     entries[count++] = entries[i];
+   }
+   if (count > 0)
+   {
+     range = (long long) entries[count-1].match - entries[0].match + 1;
+     if (4 + range + 3 * 3 <= 3 + 2 * (long long) count + 3 * count)
+        opcode = OP_TABLESWITCH;
+   }
+   if (opcode != written)
+     message((opcode == OP_TABLESWITCH) ? "Using TABLESWITCH"
+	                                : "Using LOOKUPSWITCH");
+
+   opcodelocation = Ctx->currentmethod.CodeCounter;
+   AddToCode(opcode);
+   /* add byte pad, so the default offset starts on a 4 byte boundary */
+   for (int i = SwitchPad(opcodelocation); i > 0; i--)
    {
      AddToCode(0); /* filler byte */
-     /* i++;*/ /* isn't this redundant???? Yes, it is!!!*/
    }
-   /* add mydefault offset */
-   AddLongToCode(opcodelocation - GetLabel(mydefault,opcodelocation,
-			  	     	   currentmethod.CodeCounter));
-   /* count npairs */
-   j = 0;
-   tempptr = head;
-   while(tempptr != NULL)
+   AddLabelToCode(mydefault, opcodelocation, 1);
+   if (opcode == OP_TABLESWITCH)
    {
-     j++;
-     tempptr = tempptr->next;
+     AddLongToCode(entries[0].match);
+     AddLongToCode(entries[count-1].match);
+     /* the keys in between that have no case go to the default */
+     for (i = 0, key = entries[0].match; i < count; key++)
+       if (entries[i].match == key)
+	 AddLabelToCode(entries[i++].alabel, opcodelocation, 1);
+       else
+	 AddLabelToCode(mydefault, opcodelocation, 1);
    }
-   AddLongToCode(j);
-   /* now add the pairs */
-   tempptr = head;
-   while (tempptr != NULL)
+   else
    {
-     AddLongToCode(tempptr->match);
-     AddLongToCode(opcodelocation - GetLabel(tempptr->alabel,opcodelocation,
-			  	     	   currentmethod.CodeCounter));
-     todie = tempptr;
-     tempptr = tempptr->next;
-     free(todie);
+     AddLongToCode(count);
+     for (i = 0; i < count; i++)
+     {
+       AddLongToCode(entries[i].match);
+       AddLabelToCode(entries[i].alabel, opcodelocation, 1);
+     }
    }
 }
 
-void GenTABLESWITCHCode(int opcode, int mylow, int myhigh, 
-			char* mydefault, tableentry* head)
+void GenLOOKUPSWITCHCode(int opcode, char* mydefault)
 {
-   int opcodelocation;
-   long j;
-   tableentry* tempptr;
-   tableentry* todie;
-   opcodelocation = currentmethod.CodeCounter;
-   AddToCode(GetOpCode(opcode));
-   /* add byte pad */
-   for (int i = opcodelocation % 4; (i%4 != 0); i++)
-   {
-     AddToCode(0); /* filler byte */
-     i++; /* isn't this redundant???? */
-   }
-   /* add mydefault offset */
-   AddLongToCode(opcodelocation - GetLabel(mydefault,opcodelocation,
-			  	     	   currentmethod.CodeCounter));
-   /* count npairs */
-   AddLongToCode(mylow);
-   AddLongToCode(myhigh);
-
-   /* now add the entries */
-   tempptr = head;
-   while (tempptr != NULL)
+   GenSwitchCode((unsigned char) GetOpCode(opcode), mydefault);
+}
+
+/* a tableswitch lists its labels in key order, starting from mylow */
+void GenTABLESWITCHCode(int opcode, int mylow, int myhigh, char* mydefault)
+{
+   char text[200];
+   if (Ctx->SwitchCount != (long long) myhigh - mylow + 1)
    {
-     AddLongToCode(opcodelocation - GetLabel(tempptr->alabel,opcodelocation,
-			  	     	   currentmethod.CodeCounter));
-     todie = tempptr;
-     tempptr = tempptr->next;
-     free(todie);
+     snprintf(text, sizeof(text), "A tableswitch from %d to %d needs %lld "
+	      "labels, not %ld.", mylow, myhigh,
+	      ((long long) myhigh - mylow + 1 > 0) ?
+	      (long long) myhigh - mylow + 1 : 0, Ctx->SwitchCount);
+     oops(text);
    }
+   for (long i = 0; i < Ctx->SwitchCount; i++)
+     Ctx->SwitchEntries[i].match += mylow;
+   GenSwitchCode((unsigned char) GetOpCode(opcode), mydefault);
 }
      
 
 void NewNewMethod(int access)
 {
-   MethodCount++;
-   currentmethod.access_flags = access;  
-   currentmethod.CodeCounter = 0;
-   GenConst(CONSTANT_Utf8, "Code");  /* note: don't need this if no code
-					ever generated */
-   currentmethod.LabelCounter = 0; 
-   currentmethod.LocalVarCounter = -1;
-   currentmethod.ExceptionsCounter = 0;
-   currentmethod.exceptionhead = NULL;
-   currentmethod.ThrowsCounter = 0;
-   currentmethod.throwshead = NULL;
-   currentmethod.LineNumberCounter = 0;
-   currentmethod.linenumberhead = NULL;
-   currentmethod.UserLocalVarCounter = 0;
-   currentmethod.userlocalvarhead = NULL;
-   if ((currentmethod.access_flags & 0x0008) > 0)
+   Ctx->MethodCount++;
+   Ctx->currentmethod.access_flags = access;  
+   Ctx->currentmethod.CodeCounter = 0;
+   Ctx->currentmethod.LabelCounter = 0; 
+   Ctx->currentmethod.LabelRefCounter = 0;
+   Ctx->currentmethod.LocalVarCounter = -1;
+   Ctx->currentmethod.ExceptionsCounter = 0;
+   Ctx->currentmethod.exceptionhead = NULL;
+   Ctx->currentmethod.ThrowsCounter = 0;
+   Ctx->currentmethod.throwshead = NULL;
+   Ctx->currentmethod.LineNumberCounter = 0;
+   Ctx->currentmethod.linenumberhead = NULL;
+   Ctx->currentmethod.UserLocalVarCounter = 0;
+   Ctx->currentmethod.userlocalvarhead = NULL;
+   Ctx->currentmethod.Frames = NULL;
+   Ctx->currentmethod.FrameCount = 0;
+   Ctx->currentmethod.Spares = NULL;
+   Ctx->currentmethod.SpareCount = 0;
+   if ((Ctx->currentmethod.access_flags & 0x0008) > 0)
       /* this is a static method, no default 0 variable */
    {
-      currentmethod.currentslot = 0; 
+      Ctx->currentmethod.currentslot = 0; 
    }
    else
    {
-      currentmethod.currentslot = 1; 
+      Ctx->currentmethod.currentslot = 1; 
    }
 }
 
 void NewMethod(char* name, char* signature, int maxstack, int maxlocals)
 
 {
-   currentmethod.name_index = GenConst(CONSTANT_Utf8, name);
-   currentmethod.signature_index = GenConst(CONSTANT_Utf8, signature);
-   currentmethod.max_stack = maxstack;
-   currentmethod.max_locals = maxlocals;
+   Ctx->currentmethod.name_index = GenConst(CONSTANT_Utf8, name);
+   Ctx->currentmethod.signature_index = GenConst(CONSTANT_Utf8, signature);
+   Ctx->currentmethod.max_stack = maxstack;
+   Ctx->currentmethod.max_locals = maxlocals;
 }
 
 
-void EndMethod()
+/* the name of the method being assembled, for messages */
+char* MethodName()
+{
+   return Ctx->ConstPool[ConstEntry(Ctx->currentmethod.name_index)].stringval;
+}
+
+/* javaa -O: tidies up the method that just ended and says what it saved */
+void OptimizeCurrentMethod()
 {
-   FILE * myoutfp;
-   methodname * tempmethodname;
-   methodname * prevmethodname;
-   methodname * newmethodname;
+   char text[200];
+   long saved;
+   if (Ctx->currentmethod.CodeCounter == 0) return;
+   saved = OptimizeMethod(&Ctx->currentmethod);
+   snprintf(text, sizeof(text), "%.100s: -O saved %ld bytes, %d left",
+	    MethodName(), saved, Ctx->currentmethod.CodeCounter);
+   message(text);
+}
 
-   /* add new method name to the list*/
-   tempmethodname = methodnameshead;
-   newmethodname = (methodname *) malloc(sizeof(methodname));
-   newmethodname->next = NULL;
-   if (tempmethodname == NULL)
+/* holds the max_stack the method declared up against what its code
+   actually needs.  With no max_stack we fill it in; too small and the
+   class wouldn't verify, so that gets fixed too; too big just costs
+   every call a bigger frame, so we only say so. */
+void CheckMaxStack()
+{
+   int needed;
+   char* name;
+   char text[200];
+   if (Ctx->currentmethod.CodeCounter == 0) return;  /* no Code attribute */
+   needed = MaxStackDepth(&Ctx->currentmethod);
+   if (Ctx->currentmethod.max_stack == needed) return;
+   if (Ctx->currentmethod.max_stack == -1)
    {
-     methodnameshead = newmethodname;
+      Ctx->currentmethod.max_stack = needed;
+      return;
+   }
+   name = MethodName();
+   if (Ctx->currentmethod.max_stack < needed)
+   {
+      snprintf(text, sizeof(text), "%.100s: max_stack %d is too small, "
+	       "using %d", name, Ctx->currentmethod.max_stack, needed);
+      Ctx->currentmethod.max_stack = needed;
    }
    else
+      snprintf(text, sizeof(text), "%.100s: max_stack %d is more than "
+	       "the %d needed", name, Ctx->currentmethod.max_stack, needed);
+   warning(text);
+}
+
+/* works out the StackMapTable frames for the method that just ended,
+   and gives each class in them its constant pool entry while the pool
+   can still take new ones */
+void MakeStackMap()
+{
+   MethodInfo* m = &Ctx->currentmethod;
+   const char* problem;
+   char text[300];
+   StackMapFrame* f;
+   m->FrameCount = 0;
+   if (!StackMaps || (m->CodeCounter == 0)) return;
+   problem = ComputeStackMap(m, MethodName(),
+	      Ctx->ConstPool[ConstEntry(m->signature_index)].stringval,
+	      GetThisClass());
+   if (problem != NULL)
    {
-     while (tempmethodname != NULL)
-     {
-	prevmethodname = tempmethodname;
-	tempmethodname = tempmethodname->next;
-     }
-     prevmethodname->next = newmethodname;
+      snprintf(text, sizeof(text), "%.100s: no StackMapTable, because %s, "
+	       "so the JVM will verify the class the slow way", MethodName(),
+	       problem);
+      warning(text);
+      return;
+   }
+   for (long k = 0; k < m->FrameCount + m->SpareCount; k++)
+   {
+      f = (k < m->FrameCount) ? &m->Frames[k] : &m->Spares[k - m->FrameCount];
+      for (long i = 0; i < f->locals + f->stack; i++)
+	if (f->types[i].tag == ITEM_Object)
+	   f->types[i].index = GenConst(CONSTANT_Class, f->types[i].name);
    }
+}
 
-   /* create a temp file name and open a new file */
-   tmpnam(newmethodname->name); 
-   if ((myoutfp = fopen(newmethodname->name, "w")) == 0)
-     perror("cannot open file"), exit(1);
-   MethodDump(currentmethod,myoutfp);
-   fclose(myoutfp);
+void EndMethod()
+{
+   MethodInfo** newmethods;
+   MethodInfo* done;
+   ResolveLabels();
+   if (OptimizeCode) OptimizeCurrentMethod();
+   CheckMaxStack();
+   MakeStackMap();
+   /* the method can't be written out until the end of the class, when
+      the constant pool indexes it uses are final */
+   if (Ctx->MethodCount > Ctx->MethodsSize)
+   {
+      newmethods = (MethodInfo**) realloc(Ctx->Methods,
+				Ctx->MethodCount * 2 * sizeof(MethodInfo*));
+      if (newmethods == NULL) oops("out of storage for methods");
+      for (long i = Ctx->MethodsSize; i < Ctx->MethodCount * 2; i++)
+	 newmethods[i] = NULL;
+      Ctx->Methods = newmethods;
+      Ctx->MethodsSize = Ctx->MethodCount * 2;
+   }
+   done = (MethodInfo*) Allocate(sizeof(MethodInfo));
+   memcpy(done, &Ctx->currentmethod, sizeof(MethodInfo));
+   Ctx->Methods[Ctx->MethodCount - 1] = done;
+   /* the code and label refs go with it; the next method starts afresh */
+   Ctx->currentmethod.Code = NULL;
+   Ctx->currentmethod.CodeSize = 0;
+   Ctx->currentmethod.LabelRefs = NULL;
+   Ctx->currentmethod.LabelRefSize = 0;
 }
    
 
 /* maybe overload this for the case of constants */
 void NewField(int access, char* name, char* signature, ArgType constantval)
 {
-   FieldCount++;
-   field[FieldCount].access_flags = access;
-   field[FieldCount].name_index = GenConst(CONSTANT_Utf8, name);
-   field[FieldCount].signature_index = GenConst(CONSTANT_Utf8, signature);
+   Ctx->FieldCount++;
+   Ctx->field[Ctx->FieldCount].access_flags = access;
+   Ctx->field[Ctx->FieldCount].name_index = GenConst(CONSTANT_Utf8, name);
+   Ctx->field[Ctx->FieldCount].signature_index = GenConst(CONSTANT_Utf8, signature);
    if (constantval.type != 0)  /* a constant was passed up */
    {
-     GenConst(CONSTANT_Utf8,"ConstantValue"); /* will be referenced later */
      switch (signature[0]) 
      {
        case 'B':
@@ -2265,7 +2651,7 @@ void NewField(int access, char* name, char* signature, ArgType constantval)
        {
 	 if (constantval.type != INTCONSTANT) 
 		oops("Constant type does not match field type.");
-	 field[FieldCount].constantvalue_index = 
+	 Ctx->field[Ctx->FieldCount].constantvalue_index = 
 		GenConst(CONSTANT_Integer, (long)constantval.intval);
 	 break;
        }
@@ -2273,7 +2659,7 @@ void NewField(int access, char* name, char* signature, ArgType constantval)
        {
 	 if (constantval.type != FLOATCONSTANT) 
 		oops("Constant type does not match field type.");
-	 field[FieldCount].constantvalue_index = 
+	 Ctx->field[Ctx->FieldCount].constantvalue_index = 
 		GenConst(CONSTANT_Float,constantval.floatval);
 	 break;
        }
@@ -2281,7 +2667,7 @@ void NewField(int access, char* name, char* signature, ArgType constantval)
        {
 	 if (constantval.type != LONGCONSTANT) 
 		oops("Constant type does not match field type.");
-	 field[FieldCount].constantvalue_index = 
+	 Ctx->field[Ctx->FieldCount].constantvalue_index = 
 		GenConst(CONSTANT_Long,constantval.longval);
 	 break;
        }
@@ -2289,7 +2675,7 @@ void NewField(int access, char* name, char* signature, ArgType constantval)
        {
 	 if (constantval.type != DOUBLECONSTANT) 
 		oops("Constant type does not match field type.");
-	 field[FieldCount].constantvalue_index = 
+	 Ctx->field[Ctx->FieldCount].constantvalue_index = 
 		GenConst(CONSTANT_Double,constantval.doubleval);
 	 break;
        }
@@ -2301,7 +2687,7 @@ void NewField(int access, char* name, char* signature, ArgType constantval)
    }
    else
    {
-     field[FieldCount].constantvalue_index = 0;
+     Ctx->field[Ctx->FieldCount].constantvalue_index = 0;
    }
 }
 
@@ -2314,63 +2700,56 @@ void NewLocalVar(char* name, char* signature)
    /* do we need to search to see if this variable has already been defined? */
    short currentspot;
    short tempslot;
-   currentmethod.LocalVarCounter++;
-   currentspot = currentmethod.LocalVarCounter;
+   Ctx->currentmethod.LocalVarCounter++;
+   currentspot = Ctx->currentmethod.LocalVarCounter;
    if (name != NULL)
    {
-      currentmethod.LocalVar[currentspot].name_index =
+      Ctx->currentmethod.LocalVar[currentspot].name_index =
 				GenConst(CONSTANT_Utf8, name);
-      currentmethod.LocalVar[currentspot].name = 
-			(char *) malloc(strlen(name));
-      strcpy(currentmethod.LocalVar[currentspot].name, name);
+      Ctx->currentmethod.LocalVar[currentspot].name = CopyString(name);
    }
    else
    {
-      currentmethod.LocalVar[currentspot].name_index = 0;
-      currentmethod.LocalVar[currentspot].name = NULL;
+      Ctx->currentmethod.LocalVar[currentspot].name_index = 0;
+      Ctx->currentmethod.LocalVar[currentspot].name = NULL;
    }
-   currentmethod.LocalVar[currentspot].signature_index =
+   Ctx->currentmethod.LocalVar[currentspot].signature_index =
 				GenConst(CONSTANT_Utf8, signature);
-   currentmethod.LocalVar[currentspot].signature = 
-			(char *) malloc(strlen(signature));
-   strcpy(currentmethod.LocalVar[currentspot].signature, signature);
-   currentmethod.LocalVar[currentspot].start_pc = -1; 
-   currentmethod.LocalVar[currentspot].length = 0;
+   Ctx->currentmethod.LocalVar[currentspot].signature = CopyString(signature);
+   Ctx->currentmethod.LocalVar[currentspot].start_pc = -1; 
+   Ctx->currentmethod.LocalVar[currentspot].length = 0;
 
    /* assign the slot number then increment currentslot based on the
       signature of this variable */
-   currentmethod.LocalVar[currentspot].slot = 
-		currentmethod.currentslot;
-   tempslot = currentmethod.currentslot;
+   Ctx->currentmethod.LocalVar[currentspot].slot = 
+		Ctx->currentmethod.currentslot;
+   tempslot = Ctx->currentmethod.currentslot;
    if ((strcmp(signature, "J") ==0) || (strcmp(signature, "D") ==0))  
       /* long or double so takes up two slots */
    {
-      currentmethod.currentslot = tempslot +2;
+      Ctx->currentmethod.currentslot = tempslot +2;
       //message("Incremented slot by 2.");
    }
    else 
    {
-      currentmethod.currentslot = tempslot +1;
+      Ctx->currentmethod.currentslot = tempslot +1;
       //message("Incremented slot by 1.");
    }
-
-   GenConst(CONSTANT_Utf8, "LocalVariableTable");  /* note: don't need this if 
-					no local var table ever generated */
 }
 
 void IncrementLocalVarSlot(char* signature)
 {
    short tempslot;
-   tempslot = currentmethod.currentslot;
+   tempslot = Ctx->currentmethod.currentslot;
    if ((strcmp(signature, "J") ==0) || (strcmp(signature, "D") ==0))  
       /* long or double so takes up two slots */
    {
-      currentmethod.currentslot = tempslot +2;
+      Ctx->currentmethod.currentslot = tempslot +2;
       //message("Incremented slot by 2.");
    }
    else 
    {
-      currentmethod.currentslot = tempslot +1;
+      Ctx->currentmethod.currentslot = tempslot +1;
       //message("Incremented slot by 1.");
    }
 }
@@ -2378,199 +2757,153 @@ void IncrementLocalVarSlot(char* signature)
 char* GetLocalVarSigFromSlot(int index)
 {
    int i;
-   for(i = 0; i <= currentmethod.LocalVarCounter &&
-                  currentmethod.LocalVar[i].slot != index; i++);
-   if (i > currentmethod.LocalVarCounter)
+   for(i = 0; i <= Ctx->currentmethod.LocalVarCounter &&
+                  Ctx->currentmethod.LocalVar[i].slot != index; i++);
+   if (i > Ctx->currentmethod.LocalVarCounter)
 	oops("Generic load/store instruction used, but no local variable found for this slot.");
-   return currentmethod.LocalVar[i].signature;
+   return Ctx->currentmethod.LocalVar[i].signature;
 }
 
 short GetLocalVar(char* name)
 {
    int i;
-   for(i = 0; i <= currentmethod.LocalVarCounter &&
- 		  (currentmethod.LocalVar[i].name == NULL ||
-		  strcmp(currentmethod.LocalVar[i].name,name) !=0); i++);
-   if (i > currentmethod.LocalVarCounter)
+   for(i = 0; i <= Ctx->currentmethod.LocalVarCounter &&
+ 		  (Ctx->currentmethod.LocalVar[i].name == NULL ||
+		  strcmp(Ctx->currentmethod.LocalVar[i].name,name) !=0); i++);
+   if (i > Ctx->currentmethod.LocalVarCounter)
 	oops(ConsStrings("Local Variable not declared: ",name));
-   if (currentmethod.LocalVar[i].start_pc == -1)
-        currentmethod.LocalVar[i].start_pc =
-					currentmethod.CodeCounter;
-   currentmethod.LocalVar[i].length = currentmethod.CodeCounter - 
-				currentmethod.LocalVar[i].start_pc;
-   return currentmethod.LocalVar[i].slot;
+   if (Ctx->currentmethod.LocalVar[i].start_pc == -1)
+        Ctx->currentmethod.LocalVar[i].start_pc =
+					Ctx->currentmethod.CodeCounter;
+   Ctx->currentmethod.LocalVar[i].length = Ctx->currentmethod.CodeCounter - 
+				Ctx->currentmethod.LocalVar[i].start_pc;
+   return Ctx->currentmethod.LocalVar[i].slot;
 }
 
 
-void DefineLabel(char* name)
+/* returns where name is in the label table, putting it there (with no
+   location yet) if this is the first we've heard of it */
+int FindLabel(char* name)
 {
    int i;
-   unresolvedindex* j;
-   unresolvedindex* todie;
-   int k;
-   long t1, t2, t3,t4;
-   int labelptr;
-   labelptr = -1;
-   for (i=0;i<currentmethod.LabelCounter;i++)
+   for (i=0;i<Ctx->currentmethod.LabelCounter;i++)
    {
-     if (strcmp(name, currentmethod.Label[i].name) == 0)
-        labelptr = i;
+     if (strcmp(name, Ctx->currentmethod.Label[i].name) == 0)
+        return i;
    }
-   if (labelptr >= 0) /*label with same name already found*/
-   {
-     if (currentmethod.Label[labelptr].index == -1)/*label not yet defined*/
-     {
-    	currentmethod.Label[labelptr].index 
-		= currentmethod.CodeCounter;
-	j = currentmethod.Label[labelptr].unresolvedindexhead;
-	while (j != NULL) /* fix all unresolved references */
- 	{
- 	  if((currentmethod.Code[j->location-1] == GetOpCode(IFEQ))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(IFLT))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(IFLE))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(IFGT))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(IFGE))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(IFNE))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(IFNULL))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(IFNONNULL))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(IF_ICMPEQ))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(IF_ICMPNE))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(IF_ICMPLT))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(IF_ICMPGT))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(IF_ICMPLE))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(IF_ICMPGE))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(IF_ACMPEQ))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(IF_ACMPNE))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(GOTO))
- 	   ||(currentmethod.Code[j->location-1] == GetOpCode(JSR)))
-	  {
-	    if ((currentmethod.CodeCounter-(j->location-1) > 32767)
-	     || (currentmethod.CodeCounter-(j->location-1) < -32768))
-		oops("instruction used label that's too far away.");
-	    copyshort2char(&currentmethod.Code[j->location],
-		(signed short) currentmethod.CodeCounter
-			       - (j->opcodelocation));
-	    todie = j;
-	    j = j->next;
- 	    free(todie);
-	  }
-	  else
-	  {
-	    copylong2char(&currentmethod.Code[j->location],
-			currentmethod.CodeCounter-(j->opcodelocation));
-	    todie = j;
-	    j = j->next;
- 	    free(todie);
-	  }
-	  currentmethod.Label[labelptr].unresolvedindexhead = NULL;
-      	}
-     }
-     else
-     {
- 	oops("label already defined!");
-     }
-   }
-   else /* label not yet defined */
+   RangeCheck(0, Ctx->currentmethod.LabelCounter, 99, "Too many labels in method");
+   Ctx->currentmethod.Label[Ctx->currentmethod.LabelCounter].name = name;
+   Ctx->currentmethod.Label[Ctx->currentmethod.LabelCounter].index = -1;
+   return Ctx->currentmethod.LabelCounter++;
+}
+
+void DefineLabel(char* name)
+{
+   int labelptr;
+   labelptr = FindLabel(name);
+   if (Ctx->currentmethod.Label[labelptr].index != -1)
    {
-	currentmethod.Label[currentmethod.LabelCounter].name = name;
-	currentmethod.Label[currentmethod.LabelCounter].index = 
-		currentmethod.CodeCounter;
-	currentmethod.Label[currentmethod.LabelCounter].unresolvedindexhead = NULL;
-	currentmethod.LabelCounter++;
-        //message(ConsStrings("Label added: ", name));
+      oops("label already defined!");
    }
+   Ctx->currentmethod.Label[labelptr].index = Ctx->currentmethod.CodeCounter;
+   //message(ConsStrings("Label added: ", name));
 }
 
 
-/*This function returns the location of a label if it is defined.  If it is
-  not defined, it adds "location" to the list of unresolved references.
-  myopcodelocation is the offset from the beginning of the code of the
-  opcode that uses this label (used for calculating the real offset later).
-  mylocation is the offset from the beginning of the code where the label's
-  offset belongs.
+/*This function returns the location of a label if it is defined, or -1
+  if it isn't (yet).  We return the location instead of an offset since
+  the tables that use labels want locations, and branch offsets aren't
+  known until the end of the method anyway (see ResolveLabels).
 */
-signed long GetLabel(char* name, long myopcodelocation, long mylocation)
+signed long GetLabel(char* name)
 {
-   int i;
-   int labelptr;
-   long toreturn;
-   labelptr = -1;
-   unresolvedindex* lastindex;
-   for (i=0;i<currentmethod.LabelCounter;i++)
+   return Ctx->currentmethod.Label[FindLabel(name)].index;
+}
+
+
+/* adds a placeholder offset to label "name" to the code, relative to the
+   instruction at myopcodelocation, and remembers it so ResolveLabels can
+   fill it in.  wide is for the 4 byte offsets (goto_w, jsr_w and the
+   switches), otherwise the offset is 2 bytes */
+void AddLabelToCode(char* name, long myopcodelocation, int wide)
+{
+   LabelRef* newrefs;
+   LabelRef* ref;
+   if (Ctx->currentmethod.LabelRefCounter == Ctx->currentmethod.LabelRefSize)
    {
-     if (strcmp(name, currentmethod.Label[i].name) == 0)
-        labelptr = i;
+      Ctx->currentmethod.LabelRefSize = (Ctx->currentmethod.LabelRefSize > 0) ?
+				   Ctx->currentmethod.LabelRefSize * 2 : 64;
+      newrefs = (LabelRef*) realloc(Ctx->currentmethod.LabelRefs,
+			Ctx->currentmethod.LabelRefSize * sizeof(LabelRef));
+      if (newrefs == NULL) oops("out of storage for label references");
+      Ctx->currentmethod.LabelRefs = newrefs;
    }
-   if (labelptr >= 0)
-   {
-     if (currentmethod.Label[labelptr].index >= 0)
-     {
-	/* let's just return the index instead of the actual offset 
-	   (for cases like tableswitch and lookupswitch where the offset
-	    is calculated from a few bytes back, not just one. */
-        return currentmethod.Label[labelptr].index;
-     }
-     else /*add this to list of unresolved indexes*/ 
-     {
-	lastindex = currentmethod.Label[labelptr].unresolvedindexhead;
-	currentmethod.Label[labelptr].unresolvedindexhead =
-			(unresolvedindex*) malloc(sizeof(unresolvedindex));
-	currentmethod.Label[labelptr].unresolvedindexhead->location =
-			mylocation;
-	currentmethod.Label[labelptr].unresolvedindexhead->opcodelocation 
-			= myopcodelocation;
-	currentmethod.Label[labelptr].unresolvedindexhead->next =
-			lastindex;
-	return -1;
-     }
-   }
-   else /*put label in list with no index*/
+   ref = &Ctx->currentmethod.LabelRefs[Ctx->currentmethod.LabelRefCounter++];
+   ref->opcodelocation = myopcodelocation;
+   ref->location = Ctx->currentmethod.CodeCounter;
+   ref->label = FindLabel(name);
+   ref->wide = wide;
+   if (wide)
+      AddLongToCode((signed long) 0); /*place holder*/
+   else
+      AddShortToCode((signed short) 0); /*place holder*/
+}
+
+
+/* At the end of a method: every label that was used had better be
+   defined by now.  Then any branches too far from their labels get
+   widened, and all of the offsets are filled in. */
+void ResolveLabels()
+{
+   long i;
+   LabelRef* ref;
+   for (i = 0; i < Ctx->currentmethod.LabelRefCounter; i++)
    {
-     currentmethod.Label[currentmethod.LabelCounter].name = name;
-     currentmethod.Label[currentmethod.LabelCounter].index = -1;
-     currentmethod.Label[currentmethod.LabelCounter].unresolvedindexhead 
-			= (unresolvedindex*) malloc(sizeof(unresolvedindex));
-     currentmethod.Label[currentmethod.LabelCounter].unresolvedindexhead->location 
-			= mylocation;
-     currentmethod.Label[currentmethod.LabelCounter].unresolvedindexhead->opcodelocation 
-			= myopcodelocation;
-     currentmethod.Label[currentmethod.LabelCounter].unresolvedindexhead->next 
-			= NULL; 
-     currentmethod.LabelCounter++;
-     return -1;
+     ref = &Ctx->currentmethod.LabelRefs[i];
+     if (Ctx->currentmethod.Label[ref->label].index == -1)
+        oops(ConsStrings("Label not defined: ", 
+			 Ctx->currentmethod.Label[ref->label].name));
    }
+   RelayoutMethod(&Ctx->currentmethod, NULL, 0);
 }
  
 
-lookupentry* AddToLookupList(lookupentry* head, int mymatch, char* thelabel)
+/* the start of a new lookupswitch or tableswitch */
+void StartSwitch()
 {
-  lookupentry* toreturn;
-  toreturn = (lookupentry *) malloc(sizeof(lookupentry));
-  toreturn->match = mymatch;
-  toreturn->alabel = (char *) malloc(strlen(thelabel));
-  strcpy(toreturn->alabel,thelabel);
-  toreturn->next = head;
-  return toreturn;
+  Ctx->SwitchCount = 0;
 }
-	
-tableentry* AddToTableList(tableentry* head, char* thelabel)
+
+void AddLookupEntry(long mymatch, char* thelabel)
 {
-  tableentry* toreturn;
-  toreturn = (tableentry *) malloc(sizeof(tableentry));
-  toreturn->alabel = (char *) malloc(strlen(thelabel));
-  strcpy(toreturn->alabel,thelabel);
-  toreturn->next = head;
-  return toreturn;
+  SwitchEntry* newentries;
+  if (Ctx->SwitchCount == Ctx->SwitchSize)
+  {
+    Ctx->SwitchSize = (Ctx->SwitchSize > 0) ? Ctx->SwitchSize * 2 : 64;
+    newentries = (SwitchEntry*) realloc(Ctx->SwitchEntries,
+				       Ctx->SwitchSize * sizeof(SwitchEntry));
+    if (newentries == NULL) oops("out of storage for switch entries");
+    Ctx->SwitchEntries = newentries;
+  }
+  Ctx->SwitchEntries[Ctx->SwitchCount].match = mymatch;
+  Ctx->SwitchEntries[Ctx->SwitchCount++].alabel = thelabel;
+}
+
+/* tableswitch labels are numbered from 0 here; GenTABLESWITCHCode adds
+   the low key once it knows all of them */
+void AddTableEntry(char* thelabel)
+{
+  AddLookupEntry(Ctx->SwitchCount, thelabel);
 }
 
 void AddToThrowsList(char* name)
 {
   throwsentry* toadd;
-  toadd = (throwsentry*) malloc(sizeof(throwsentry));
+  toadd = (throwsentry*) Allocate(sizeof(throwsentry));
   toadd->exceptionclass = GenConst(CONSTANT_Class, name);
-  toadd->next = currentmethod.throwshead;
-  currentmethod.throwshead = toadd;
-  currentmethod.ThrowsCounter++;
+  toadd->next = Ctx->currentmethod.throwshead;
+  Ctx->currentmethod.throwshead = toadd;
+  Ctx->currentmethod.ThrowsCounter++;
 } 
   
 
@@ -2580,16 +2913,16 @@ void AddToExceptionList(char* start_pc, char* end_pc, char* handler_pc,
   exceptionentry* newexception;
   exceptionentry* tempexception;
   long int tempoffset;
-  newexception = (exceptionentry*) malloc(sizeof(exceptionentry));
-  tempoffset = GetLabel(start_pc, 0, 0);
+  newexception = (exceptionentry*) Allocate(sizeof(exceptionentry));
+  tempoffset = GetLabel(start_pc);
   if (tempoffset == -1) oops("Label not defined.");
   if (tempoffset > 65536) oops("Offset to this label larger than 2 bytes.");
   newexception->start_pc = tempoffset; 
-  tempoffset = GetLabel(end_pc, 0, 0);
+  tempoffset = GetLabel(end_pc);
   if (tempoffset == -1) oops("Label not defined.");
   if (tempoffset > 65536) oops("Offset to this label larger than 2 bytes.");
   newexception->end_pc = tempoffset; 
-  tempoffset = GetLabel(handler_pc, 0, 0);
+  tempoffset = GetLabel(handler_pc);
   if (tempoffset == -1) oops("Label not defined.");
   if (tempoffset > 65536) oops("Offset to this label larger than 2 bytes.");
   newexception->handler_pc = tempoffset;
@@ -2604,17 +2937,17 @@ void AddToExceptionList(char* start_pc, char* end_pc, char* handler_pc,
   newexception->next = NULL;
 
   /*insert into list*/
-  if (currentmethod.exceptionhead == NULL)
+  if (Ctx->currentmethod.exceptionhead == NULL)
   {
-    currentmethod.exceptionhead = newexception;
+    Ctx->currentmethod.exceptionhead = newexception;
   }
   else
   {
-    tempexception = currentmethod.exceptionhead;
+    tempexception = Ctx->currentmethod.exceptionhead;
     for(;tempexception->next != NULL; tempexception = tempexception->next);
     tempexception->next = newexception;
   }
-  currentmethod.ExceptionsCounter++;
+  Ctx->currentmethod.ExceptionsCounter++;
 }
 
 void AddToLineNumberList(char* alabel, short line_number)
@@ -2622,23 +2955,23 @@ void AddToLineNumberList(char* alabel, short line_number)
   linenumberentry* toadd;
   linenumberentry* temp;
   long tempoffset;
-  tempoffset = GetLabel(alabel, 0, 0);
+  tempoffset = GetLabel(alabel);
   if (tempoffset == -1) oops("Label not defined.");
   if (tempoffset > 65536) oops("Offset to this label larger than 2 bytes.");
-  toadd = (linenumberentry*) malloc(sizeof(linenumberentry));
+  toadd = (linenumberentry*) Allocate(sizeof(linenumberentry));
   toadd->start_pc = tempoffset;
   toadd->line_number = line_number;
   toadd->next = NULL;
-  if (currentmethod.linenumberhead == NULL)
+  if (Ctx->currentmethod.linenumberhead == NULL)
   {
-    currentmethod.linenumberhead = toadd;
+    Ctx->currentmethod.linenumberhead = toadd;
   }
   else
   {
-    for(temp = currentmethod.linenumberhead; temp->next != NULL; temp = temp->next);
+    for(temp = Ctx->currentmethod.linenumberhead; temp->next != NULL; temp = temp->next);
     temp->next = toadd;
   }
-  currentmethod.LineNumberCounter++;
+  Ctx->currentmethod.LineNumberCounter++;
 }
 
 void AddToUserLocalVarList(char* startlabel, char* endlabel, char* signature,
@@ -2647,12 +2980,12 @@ void AddToUserLocalVarList(char* startlabel, char* endlabel, char* signature,
   userlocalvarentry* toadd;
   userlocalvarentry* temp;
   long tempoffset;
-  toadd = (userlocalvarentry*) malloc(sizeof(userlocalvarentry));
-  tempoffset = GetLabel(startlabel, 0, 0);
+  toadd = (userlocalvarentry*) Allocate(sizeof(userlocalvarentry));
+  tempoffset = GetLabel(startlabel);
   if (tempoffset == -1) oops("Label not defined.");
   if (tempoffset > 65536) oops("Offset to this label larger than 2 bytes.");
   toadd->start_pc = tempoffset;
-  tempoffset = GetLabel(endlabel, 0, 0);
+  tempoffset = GetLabel(endlabel);
   if (tempoffset == -1) oops("Label not defined.");
   if (tempoffset > 65536) oops("Offset to this label larger than 2 bytes.");
   toadd->length = tempoffset - toadd->start_pc;
@@ -2660,15 +2993,15 @@ void AddToUserLocalVarList(char* startlabel, char* endlabel, char* signature,
   toadd->signature_index = GenConst(CONSTANT_Utf8,signature);
   toadd->slot = slot;
   toadd->next = NULL;
-  if (currentmethod.userlocalvarhead == NULL)
+  if (Ctx->currentmethod.userlocalvarhead == NULL)
   {
-    currentmethod.userlocalvarhead = toadd;
+    Ctx->currentmethod.userlocalvarhead = toadd;
   }
   else
   {
-    for(temp = currentmethod.userlocalvarhead; temp->next != NULL; temp = temp->next);
+    for(temp = Ctx->currentmethod.userlocalvarhead; temp->next != NULL; temp = temp->next);
     temp->next = toadd;
   }
-  currentmethod.UserLocalVarCounter++;
+  Ctx->currentmethod.UserLocalVarCounter++;
 }
 	
@@ -0,0 +1,96 @@
+/* jasmgen: writes a made-up class in jasm to stdout, for timing javaa on
+   inputs of a known size (see bench.sh).  Each method has a chain of
+   labels with a branch at each one, its share of the int constants, a
+   lookupswitch, and loads of some of the fields.  The first line is a
+   comment giving the number of instructions, so throughput can be
+   worked out without having to parse anything. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int Methods = 10;
+int Labels = 10;      /* per method */
+int Constants = 50;   /* in all, spread over the methods */
+int Fields = 5;
+int SwitchEntries = 0;  /* per method */
+
+void usage(void)
+{
+    fprintf(stderr, "Usage: jasmgen [-methods n] [-labels n] [-consts n] "
+	    "[-fields n] [-switch n]\n");
+    exit(1);
+}
+
+/* everything the methods do, in order, either written out or just
+   counted.  Returns the number of instructions. */
+long Generate(FILE *out)
+{
+  long count = 0;
+  int m, i, share, first;
+  for (i = 0; i < Fields; i++)
+    if (out) fprintf(out, "  field static int f%d\n", i);
+  for (m = 0; m < Methods; m++)
+  {
+    if (out) fprintf(out, "  method public static void m%d()\n"
+		     "  max_stack 1\n  max_locals 1\n  {\n"
+		     "    iconst_0\n    istore 0\n", m);
+    count += 2;
+    for (i = 0; i < Labels; i++)
+    {
+      /* every other branch goes back to the start, so the labels are
+	 looked up both before and after they are defined */
+      if (out) fprintf(out, "L%d:\n    iload 0\n    ifne L%d\n", i,
+		       (i % 2 == 0) ? (i + 1) % Labels : 0);
+      count += 2;
+    }
+    first = Constants / Methods * m + ((m < Constants % Methods) ? m
+				       : Constants % Methods);
+    share = Constants / Methods + ((m < Constants % Methods) ? 1 : 0);
+    for (i = first; i < first + share; i++)
+    {
+      if (out) fprintf(out, "    ldc %d\n    pop\n", 100000 + i);
+      count += 2;
+    }
+    for (i = m; i < Fields; i += Methods)
+    {
+      if (out) fprintf(out, "    getstatic int Bench.f%d\n    pop\n", i);
+      count += 2;
+    }
+    if ((SwitchEntries > 0) && (Labels > 0))
+    {
+      if (out)
+      {
+	fprintf(out, "    iload 0\n    lookupswitch default L0 {");
+	for (i = 0; i < SwitchEntries; i++)
+	  fprintf(out, "%s %d : L%d", (i % 8 == 0) ? "\n     " : "",
+		  i * 3, i % Labels);
+	fprintf(out, " }\n");
+      }
+      count += 2;
+    }
+    if (out) fprintf(out, "    return\n  }\n");
+    count++;
+  }
+  return count;
+}
+
+int main(int argc, char *argv[])
+{
+  int i;
+  int *option;
+  for (i = 1; i < argc; i += 2) {
+    if (strcmp(argv[i], "-methods") == 0) option = &Methods;
+    else if (strcmp(argv[i], "-labels") == 0) option = &Labels;
+    else if (strcmp(argv[i], "-consts") == 0) option = &Constants;
+    else if (strcmp(argv[i], "-fields") == 0) option = &Fields;
+    else if (strcmp(argv[i], "-switch") == 0) option = &SwitchEntries;
+    else usage();
+    if ((i + 1 == argc) || ((*option = atoi(argv[i+1])) < 0)) usage();
+  }
+  if (Methods < 1) usage();
+  printf("/* %ld instructions */\n", Generate(NULL));
+  printf("class Bench\n{\n");
+  Generate(stdout);
+  printf("}\n");
+  return(0);
+}
@@ -268,13 +268,22 @@
 #include "listing.h"
 %}
 
+/* reentrant, so that several files can be assembled at once; the
+   scanner state is passed through yyparse to yylex */
+%define api.pure full
+%lex-param {void *scanner}
+%parse-param {void *scanner}
+%code provides {
+int yylex(YYSTYPE *, void *);
+}
+
 %type <argtype>		argument fieldconstant
 %type <string>		label
 %type <intval> 		no_arg_op one_arg_op fieldref_arg_op 
 %type <intval> 		methodref_arg_op class_arg_op label_arg_op 
 %type <intval> 		localvar_arg_op localvar_arg newarraytype 
 %type <intval>		access_specifier class_modifiers method_modifiers
-%type <intval>	 	field_modifiers max_locals_decl
+%type <intval>	 	field_modifiers max_stack_decl max_locals_decl
 %type <intval>		abstract_entry final_entry public_entry  
 %type <intval>		interface_entry static_entry native_entry 
 %type <intval>		synchronized_entry transient_entry volatile_entry
@@ -283,8 +292,6 @@
 %type <string>	 	argumentlist methodargument methodarguments
 %type <string>	 	methodargumentlist 
 %type <classfieldmethodstruct> classfieldmethodname endname
-%type <lookuplistptr>	lookuplist 
-%type <tablelistptr>	tablelist 
 
 %union {
    Terminal        rk;
@@ -304,8 +311,6 @@
    TypeQualifier   typequalifier;
    ArgType	   argtype;
   
-   lookupentry *   lookuplistptr;
-   tableentry *    tablelistptr;
 
    struct {
 	char* classname;
@@ -431,12 +436,7 @@ classword: CLASS
 superclass
 	: EXTENDS classname
 		{ $$ = $2;}
-	| {
-	    char* tempstring;
-	    tempstring = (char *) malloc(strlen("java/lang/Object"));
-	    strcpy(tempstring,"java/lang/Object");
-	    $$ = tempstring;
-	  }
+	| { $$ = ConsStrings("java/lang/Object",""); }
 	;
 
 classname: IDENTIFIER '.' classname
@@ -601,14 +601,14 @@ method  :
           METHOD access_specifier method_modifiers {NewNewMethod($2|$3);} 
   	  returntype 
 	  IDENTIFIER 
-	  '(' methodarguments ')' throwslist MAX_STACK INTCONSTANT 
+	  '(' methodarguments ')' throwslist max_stack_decl 
           max_locals_decl 
 	  { 
 	    char* tmpstr; 
 	    /*message("Calling NewMethod.");*/
 	    tmpstr = ConsStrings("(",ConsStrings($8,ConsStrings(")",$5)));
 	    /*message(tmpstr);*/
-	    NewMethod($6, tmpstr, $12, $13); }
+	    NewMethod($6, tmpstr, $11, $12); }
 	    '{'
             code
  	    exceptiontable
@@ -631,6 +631,12 @@ throwsentries :
 		{AddToThrowsList($1);}
      	;
 
+max_stack_decl:
+	MAX_STACK INTCONSTANT
+		{$$ = $2;}
+	| 	{$$ = -1;}
+	;
+
 max_locals_decl:
 	MAX_LOCALS INTCONSTANT
 		{$$ = $2;}
@@ -641,11 +647,7 @@ returntype
 	: type
 		{ $$ = $1; }
 	| VOID
-	    	{ char* tempstring;
-	     	  tempstring = (char *) malloc(strlen("B"));
-	     	  strcpy(tempstring,"V");
-	     	  $$ = tempstring;
-	  	}
+	    	{ $$ = ConsStrings("V",""); }
 	;
 
 arguments
@@ -803,11 +805,11 @@ op	: no_arg_op
 		{GenIINCCode($1.terminal,$2,$3);
 		}
 	| LOOKUPSWITCH DEFAULT IDENTIFIER '{' lookuplist '}'
-		{GenLOOKUPSWITCHCode($1.terminal,$3,$5);
+		{GenLOOKUPSWITCHCode($1.terminal,$3);
 		}
 	| TABLESWITCH INTCONSTANT TO INTCONSTANT DEFAULT IDENTIFIER '{'
 	  tablelist '}'
-		{GenTABLESWITCHCode($1.terminal,$2,$4,$6,$8);
+		{GenTABLESWITCHCode($1.terminal,$2,$4,$6);
 		} 
         | MULTIANEWARRAY arrayorclassname INTCONSTANT
 		{GenMULTIANEWARRAYCode($1.terminal,$2,$3);
@@ -1234,14 +1236,14 @@ localvar_arg: INTCONSTANT
 		{ $$ = GetLocalVar($1);}
 	;
 
-lookuplist: INTCONSTANT ':' IDENTIFIER lookuplist
-		{ $$ = AddToLookupList($4,$1,$3); }
-	| 	{$$ = NULL;}
+lookuplist: lookuplist INTCONSTANT ':' IDENTIFIER
+		{ AddLookupEntry($2,$4); }
+	| 	{ StartSwitch(); }
 	;
 
-tablelist: IDENTIFIER tablelist
-		{ $$ = AddToTableList($2,$1); }
-	| 	{$$ = NULL;}
+tablelist: tablelist IDENTIFIER
+		{ AddTableEntry($2); }
+	| 	{ StartSwitch(); }
 	;
 
 newarraytype: 
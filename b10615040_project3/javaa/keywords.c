@@ -0,0 +1,383 @@
+/* Keyword recognition for the lexer.  Instead of one case-insensitive
+   regular expression per opcode and directive (which made the scanner
+   tables huge), the lexer matches a plain identifier and looks it up
+   here.  The table is a perfect hash built the first time it's used:
+   keywords are split into buckets by one hash, and each bucket gets a
+   displacement that sends all of its keywords into empty slots of the
+   table using a second hash.  A lookup is then two hashes of the
+   identifier, one slot, and one compare -- no probing.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "types.h"
+#include "gram.h"
+#include "listing.h"
+#include "keywords.h"
+
+#define KEYWORD_SLOTS 512    /* powers of two */
+#define KEYWORD_BUCKETS 128
+#define MAX_KEYWORD_LENGTH 20
+
+/* Matching is case-insensitive, so names here are all lower case */
+static KeywordInfo Keywords[] = {
+   {"class", CLASS},
+   {"extends", EXTENDS},
+   {"access", ACCESS},
+   {"implements", IMPLEMENTS},
+   {"field", FIELD},
+   {"method", METHOD},
+   {"max_stack", MAX_STACK},
+   {"max_locals", MAX_LOCALS},
+   {"code", CODE},
+   {"public", PUBLIC},
+   {"private", PRIVATE},
+   {"protected", PROTECTED},
+   {"abstract", ABSTRACT},
+   {"final", FINAL},
+   {"interface", INTERFACE},
+   {"static", STATIC},
+   {"native", NATIVE},
+   {"synchronized", SYNCHRONIZED},
+   {"transient", TRANSIENT},
+   {"volatile", VOLATILE},
+   {"byte", BYTE},
+   {"char", CHAR},
+   {"double", DOUBLE},
+   {"float", FLOAT},
+   {"int", INT},
+   {"long", LONG},
+   {"short", SHORT},
+   {"boolean", BOOLEAN},
+   {"void", VOID},
+   {"default", DEFAULT},
+   {"to", TO},
+   {"exceptions", EXCEPTIONS},
+   {"sourcefile", SOURCEFILE},
+   {"throws", THROWS},
+   {"linenumbertable", LINENUMBERTABLE},
+   {"localvariabletable", LOCALVARIABLETABLE},
+   {"acc_public", ACC_PUBLIC},
+   {"acc_private", ACC_PRIVATE},
+   {"acc_protected", ACC_PROTECTED},
+   {"acc_static", ACC_STATIC},
+   {"acc_final", ACC_FINAL},
+   {"acc_synchronized", ACC_SYNCHRONIZED},
+   {"acc_volatile", ACC_VOLATILE},
+   {"acc_transient", ACC_TRANSIENT},
+   {"acc_native", ACC_NATIVE},
+   {"acc_interface", ACC_INTERFACE},
+   {"acc_abstract", ACC_ABSTRACT},
+   {"aaload", AALOAD},
+   {"aastore", AASTORE},
+   {"aconst_null", ACONST_NULL},
+   {"aload_0", ALOAD_0},
+   {"aload_1", ALOAD_1},
+   {"aload_2", ALOAD_2},
+   {"aload_3", ALOAD_3},
+   {"anewarray", ANEWARRAY},
+   {"areturn", ARETURN},
+   {"arraylength", ARRAYLENGTH},
+   {"astore_0", ASTORE_0},
+   {"astore_1", ASTORE_1},
+   {"astore_2", ASTORE_2},
+   {"astore_3", ASTORE_3},
+   {"athrow", ATHROW},
+   {"baload", BALOAD},
+   {"bastore", BASTORE},
+   {"bipush", BIPUSH},
+   {"caload", CALOAD},
+   {"castore", CASTORE},
+   {"checkcast", CHECKCAST},
+   {"d2f", D2F},
+   {"d2i", D2I},
+   {"d2l", D2L},
+   {"dadd", DADD},
+   {"daload", DALOAD},
+   {"dastore", DASTORE},
+   {"dcmpg", DCMPG},
+   {"dcmpl", DCMPL},
+   {"dconst_0", DCONST_0},
+   {"dconst_1", DCONST_1},
+   {"ddiv", DDIV},
+   {"dload_0", DLOAD_0},
+   {"dload_1", DLOAD_1},
+   {"dload_2", DLOAD_2},
+   {"dload_3", DLOAD_3},
+   {"dmul", DMUL},
+   {"dneg", DNEG},
+   {"drem", DREM},
+   {"dreturn", DRETURN},
+   {"dstore_0", DSTORE_0},
+   {"dstore_1", DSTORE_1},
+   {"dstore_2", DSTORE_2},
+   {"dstore_3", DSTORE_3},
+   {"dsub", DSUB},
+   {"dup", DUP},
+   {"dup_x1", DUP_X1},
+   {"dup_x2", DUP_X2},
+   {"dup2", DUP2},
+   {"dup2_x1", DUP2_X1},
+   {"dup2_x2", DUP2_X2},
+   {"f2d", F2D},
+   {"f2i", F2I},
+   {"f2l", F2L},
+   {"fadd", FADD},
+   {"faload", FALOAD},
+   {"fastore", FASTORE},
+   {"fcmpg", FCMPG},
+   {"fcmpl", FCMPL},
+   {"fconst_0", FCONST_0},
+   {"fconst_1", FCONST_1},
+   {"fconst_2", FCONST_2},
+   {"fdiv", FDIV},
+   {"fload_0", FLOAD_0},
+   {"fload_1", FLOAD_1},
+   {"fload_2", FLOAD_2},
+   {"fload_3", FLOAD_3},
+   {"fmul", FMUL},
+   {"fneg", FNEG},
+   {"frem", FREM},
+   {"freturn", FRETURN},
+   {"fstore_0", FSTORE_0},
+   {"fstore_1", FSTORE_1},
+   {"fstore_2", FSTORE_2},
+   {"fstore_3", FSTORE_3},
+   {"fsub", FSUB},
+   {"getfield", GETFIELD},
+   {"getstatic", GETSTATIC},
+   {"goto", GOTO},
+   {"goto_w", GOTO_W},
+   {"i2b", I2B},
+   {"i2c", I2C},
+   {"i2d", I2D},
+   {"i2f", I2F},
+   {"i2l", I2L},
+   {"i2s", I2S},
+   {"iadd", IADD},
+   {"iaload", IALOAD},
+   {"iand", IAND},
+   {"iastore", IASTORE},
+   {"iconst_0", ICONST_0},
+   {"iconst_1", ICONST_1},
+   {"iconst_2", ICONST_2},
+   {"iconst_3", ICONST_3},
+   {"iconst_4", ICONST_4},
+   {"iconst_5", ICONST_5},
+   {"iconst_m1", ICONST_M1},
+   {"idiv", IDIV},
+   {"if_acmpeq", IF_ACMPEQ},
+   {"if_acmpne", IF_ACMPNE},
+   {"if_icmpeq", IF_ICMPEQ},
+   {"if_icmpne", IF_ICMPNE},
+   {"if_icmplt", IF_ICMPLT},
+   {"if_icmpge", IF_ICMPGE},
+   {"if_icmpgt", IF_ICMPGT},
+   {"if_icmple", IF_ICMPLE},
+   {"ifeq", IFEQ},
+   {"ifne", IFNE},
+   {"iflt", IFLT},
+   {"ifge", IFGE},
+   {"ifgt", IFGT},
+   {"ifle", IFLE},
+   {"ifnonnull", IFNONNULL},
+   {"ifnull", IFNULL},
+   {"iload_0", ILOAD_0},
+   {"iload_1", ILOAD_1},
+   {"iload_2", ILOAD_2},
+   {"iload_3", ILOAD_3},
+   {"imul", IMUL},
+   {"ineg", INEG},
+   {"ior", IOR},
+   {"irem", IREM},
+   {"ireturn", IRETURN},
+   {"ishl", ISHL},
+   {"ishr", ISHR},
+   {"istore_0", ISTORE_0},
+   {"istore_1", ISTORE_1},
+   {"istore_2", ISTORE_2},
+   {"istore_3", ISTORE_3},
+   {"isub", ISUB},
+   {"iushr", IUSHR},
+   {"ixor", IXOR},
+   {"jsr", JSR},
+   {"jsr_w", JSR_W},
+   {"l2d", L2D},
+   {"l2f", L2F},
+   {"l2i", L2I},
+   {"ladd", LADD},
+   {"laload", LALOAD},
+   {"land", LAND},
+   {"lastore", LASTORE},
+   {"lcmp", LCMP},
+   {"lconst_0", LCONST_0},
+   {"lconst_1", LCONST_1},
+   {"ldiv", LDIV},
+   {"lload_0", LLOAD_0},
+   {"lload_1", LLOAD_1},
+   {"lload_2", LLOAD_2},
+   {"lload_3", LLOAD_3},
+   {"lmul", LMUL},
+   {"lneg", LNEG},
+   {"lor", LOR},
+   {"lrem", LREM},
+   {"lreturn", LRETURN},
+   {"lshl", LSHL},
+   {"lshr", LSHR},
+   {"lstore_0", LSTORE_0},
+   {"lstore_1", LSTORE_1},
+   {"lstore_2", LSTORE_2},
+   {"lstore_3", LSTORE_3},
+   {"lsub", LSUB},
+   {"lushr", LUSHR},
+   {"lxor", LXOR},
+   {"monitorenter", MONITORENTER},
+   {"monitorexit", MONITOREXIT},
+   {"nop", NOP},
+   {"pop", POP},
+   {"pop2", POP2},
+   {"return", RETURN},
+   {"saload", SALOAD},
+   {"sastore", SASTORE},
+   {"swap", SWAP},
+   {"iinc", IINC},
+   {"instanceof", INSTANCEOF},
+   {"invokeinterface", INVOKEINTERFACE},
+   {"invokenonvirtual", INVOKENONVIRTUAL},
+   {"invokestatic", INVOKESTATIC},
+   {"invokevirtual", INVOKEVIRTUAL},
+   {"ldc", LDC},
+   {"ldc_w", LDC_W},
+   {"ldc2_w", LDC2_W},
+   {"multianewarray", MULTIANEWARRAY},
+   {"new", NEW},
+   {"newarray", NEWARRAY},
+   {"putfield", PUTFIELD},
+   {"putstatic", PUTSTATIC},
+   {"sipush", SIPUSH},
+   {"iload", ILOAD},
+   {"fload", FLOAD},
+   {"aload", ALOAD},
+   {"lload", LLOAD},
+   {"dload", DLOAD},
+   {"istore", ISTORE},
+   {"fstore", FSTORE},
+   {"astore", ASTORE},
+   {"lstore", LSTORE},
+   {"dstore", DSTORE},
+   {"ret", RET},
+   {"wide", WIDE},
+   {"load", LOAD},
+   {"store", STORE},
+   {"lookupswitch", LOOKUPSWITCH},
+   {"tableswitch", TABLESWITCH},
+};
+
+static KeywordInfo* KeywordTable[KEYWORD_SLOTS];
+static unsigned short KeywordDisplacement[KEYWORD_BUCKETS];
+static int KeywordTableBuilt = 0;
+
+/* both hashes of the case-folded text, in one pass */
+static void HashKeyword(const char* text, int length,
+			unsigned long* bucket, unsigned long* slot)
+{
+  unsigned int h1 = 2166136261u;  /* FNV-1a */
+  unsigned int h2 = 0;
+  int c;
+  for (int i = 0; i < length; i++)
+  {
+    c = tolower((unsigned char) text[i]);
+    h1 = (h1 ^ c) * 16777619u;
+    h2 = h2 * 31 + c;
+  }
+  *bucket = h1;
+  *slot = h2;
+}
+
+static unsigned long KeywordSlot(unsigned long h1, unsigned long h2, int d)
+{
+  return (h2 + d * ((h1 >> 8) | 1)) & (KEYWORD_SLOTS - 1);
+}
+
+/* tries displacement d for every keyword in bucket b; puts them in the
+   table and returns 1 if they all land in different empty slots */
+static int PlaceBucket(int b, int d, unsigned long* h1, unsigned long* h2,
+		       int count)
+{
+  int i, j;
+  unsigned long s;
+  int placed = 0;
+  for (i = 0; i < count; i++)
+  {
+    if ((h1[i] & (KEYWORD_BUCKETS - 1)) != (unsigned long) b) continue;
+    s = KeywordSlot(h1[i], h2[i], d);
+    if (KeywordTable[s] != NULL) break;
+    KeywordTable[s] = &Keywords[i];
+    placed++;
+  }
+  if (i == count) return 1;
+  /* collision: take back what this try put in */
+  for (j = 0; j < i && placed > 0; j++)
+  {
+    if ((h1[j] & (KEYWORD_BUCKETS - 1)) != (unsigned long) b) continue;
+    KeywordTable[KeywordSlot(h1[j], h2[j], d)] = NULL;
+    placed--;
+  }
+  return 0;
+}
+
+/* builds the table; called once at startup, before there are threads
+   that could race to do it, but LookupKeyword makes sure of it anyway.
+   No oops() here: main calls it before there's a context to report in. */
+void InitKeywordTable(void)
+{
+  int count = sizeof(Keywords) / sizeof(Keywords[0]);
+  unsigned long h1[sizeof(Keywords) / sizeof(Keywords[0])];
+  unsigned long h2[sizeof(Keywords) / sizeof(Keywords[0])];
+  int bucketsize[KEYWORD_BUCKETS];
+  int i, b, size, d;
+  memset(bucketsize, 0, sizeof(bucketsize));
+  for (i = 0; i < count; i++)
+  {
+    if (strlen(Keywords[i].name) > MAX_KEYWORD_LENGTH)
+    {
+      fprintf(stderr, "Keyword longer than MAX_KEYWORD_LENGTH\n");
+      exit(1);
+    }
+    HashKeyword(Keywords[i].name, strlen(Keywords[i].name), &h1[i], &h2[i]);
+    bucketsize[h1[i] & (KEYWORD_BUCKETS - 1)]++;
+  }
+  /* the crowded buckets go first, while there's the most room */
+  for (size = count; size > 0; size--)
+    for (b = 0; b < KEYWORD_BUCKETS; b++)
+    {
+      if (bucketsize[b] != size) continue;
+      for (d = 0; !PlaceBucket(b, d, h1, h2, count); d++)
+	if (d == 65535)
+	{
+	  fprintf(stderr, "Can't build the keyword table\n");
+	  exit(1);
+	}
+      KeywordDisplacement[b] = d;
+    }
+  KeywordTableBuilt = 1;
+}
+
+/* returns the token for text if it's a keyword (in any case), or 0 */
+int LookupKeyword(const char* text, int length)
+{
+  unsigned long h1, h2;
+  KeywordInfo* entry;
+  int i;
+  if (length > MAX_KEYWORD_LENGTH) return 0;
+  if (!KeywordTableBuilt) InitKeywordTable();
+  HashKeyword(text, length, &h1, &h2);
+  entry = KeywordTable[KeywordSlot(h1, h2,
+			KeywordDisplacement[h1 & (KEYWORD_BUCKETS - 1)])];
+  if (entry == NULL) return 0;
+  for (i = 0; i < length; i++)
+    if (tolower((unsigned char) text[i]) != entry->name[i]) return 0;
+  if (entry->name[length] != '\0') return 0;
+  return entry->token;
+}
@@ -0,0 +1,3 @@
+/* Keyword lookup for the lexer.  See keywords.c */
+void InitKeywordTable(void);
+int LookupKeyword(const char*, int);
@@ -1,3 +1,4 @@
+extern int Listing;
 void StartListing(void);
 void EndListing(void);
 void NewLine(int);
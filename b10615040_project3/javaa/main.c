@@ -1,29 +1,191 @@
 /* copyright 1996 Jason Hunt and Washington University, St. Louis */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
 #include "types.h"
 #include "protos.h"
 #include "listing.h"
 #include "build.h"
+#include "keywords.h"
+#include "context.h"
 extern int yydebug;
 extern int UseStdOut;
-extern FILE *yyin;
-main(int argc, char *argv[]){
+extern int DumpConstPool;
+extern int OptimizeCode;
+extern int ClassStats;
+extern int StackMaps;
+
+AssemblyJob* Jobs;
+int JobCount;
+int NextJob;
+pthread_mutex_t JobLock = PTHREAD_MUTEX_INITIALIZER;
+
+int ReportMemory = 0;     /* javaa -mem */
+long PeakArena = 0;       /* the biggest any one file's arena got */
+long TotalAllocations = 0;
+
+void usage(void)
+{
+    fprintf(stderr, "Usage: javaa [-q] [-nodump] [-O] [-nostackmap] [--stats] [-mem] [-j threads] file ...\n");
+    fprintf(stderr, "  -q       no listing and no constant pool dump\n");
+    fprintf(stderr, "  -nodump  listing only, no constant pool dump\n");
+    fprintf(stderr, "  -O       take out nops and send jumps to jumps straight through\n");
+    fprintf(stderr, "  -nostackmap  no StackMapTable, and an old (Java 1.2) class file\n");
+    fprintf(stderr, "  --stats  a line of JSON on what went into each class\n");
+    fprintf(stderr, "  -mem     report how much memory each file took\n");
+    fprintf(stderr, "  -j       how many files to assemble at once\n");
+    exit(1);
+}
+
+/* how much of the arena a file used, just before it is given back */
+void MemoryReport(char *filename, AssemblerContext *context)
+{
+  fprintf(context->listfp,
+	  "%s: %ld allocations, %ld bytes, %ld bytes reserved\n", filename,
+	  context->arena.allocations, context->arena.bytes,
+	  context->arena.reserved);
+  pthread_mutex_lock(&JobLock);
+  if (context->arena.reserved > PeakArena) PeakArena = context->arena.reserved;
+  TotalAllocations += context->arena.allocations;
+  pthread_mutex_unlock(&JobLock);
+}
+
+/* assembles one file in a context of its own, with the listing going to
+   listfp and errors to errfp.  Returns 0 if it worked. */
+int AssembleFile(char *filename, FILE *listfp, FILE *errfp)
+{
+  AssemblerContext *context;
+  void *scanner;
+  FILE *infp;
   int result;
-  if (argc == 1) {
-    fprintf(stderr, "Usage: javaa filename\n");
+  if ((infp = fopen(filename, "r")) == NULL) {
+    fprintf(errfp, "javaa: can't open %s\n", filename);
+    return(1);
+  }
+  context = NewAssemblerContext(listfp, errfp);
+  Ctx = context;
+  yylex_init(&scanner);
+  yyset_in(infp, scanner);
+  if (setjmp(context->abort) == 0) {
+    StartListing();
+    result = yyparse(scanner);
+    EndListing();
+  }
+  else result = 1;  /* oops() gave up on this file */
+  yylex_destroy(scanner);
+  fclose(infp);
+  if (ReportMemory) MemoryReport(filename, context);
+  Ctx = NULL;
+  FreeAssemblerContext(context);
+  return(result);
+}
+
+/* takes files off the job list until there are none left.  Listings and
+   errors are kept until the end so they come out in file order, the
+   same as assembling the files one at a time. */
+void *AssemblyWorker(void *unused)
+{
+  int mine;
+  FILE *listfp;
+  FILE *errfp;
+  for (;;) {
+    pthread_mutex_lock(&JobLock);
+    mine = NextJob++;
+    pthread_mutex_unlock(&JobLock);
+    if (mine >= JobCount) return(NULL);
+    listfp = open_memstream(&Jobs[mine].listing, &Jobs[mine].listinglength);
+    errfp = open_memstream(&Jobs[mine].errors, &Jobs[mine].errorslength);
+    if ((listfp == NULL) || (errfp == NULL)) {
+      /* nowhere to keep its output, so this file fails on its own */
+      fprintf(stderr, "javaa: out of storage for the output of %s\n",
+	      Jobs[mine].filename);
+      if (listfp != NULL) fclose(listfp);
+      if (errfp != NULL) fclose(errfp);
+      Jobs[mine].result = 1;
+      continue;
+    }
+    Jobs[mine].result = AssembleFile(Jobs[mine].filename, listfp, errfp);
+    fclose(listfp);
+    fclose(errfp);
+  }
+}
+
+int AssembleFiles(char **filenames, int count, int threads)
+{
+  pthread_t *workers;
+  int result = 0;
+  int i;
+  Jobs = (AssemblyJob *) calloc(count, sizeof(AssemblyJob));
+  workers = (pthread_t *) malloc(threads * sizeof(pthread_t));
+  if ((Jobs == NULL) || (workers == NULL)) {
+    fprintf(stderr, "out of storage for assembler\n");
     exit(1);
   }
-  yyin = fopen(argv[1], "r"); 
+  for (i = 0; i < count; i++) Jobs[i].filename = filenames[i];
+  JobCount = count;
+  NextJob = 0;
+  for (i = 0; i < threads; i++)
+    pthread_create(&workers[i], NULL, AssemblyWorker, NULL);
+  for (i = 0; i < threads; i++)
+    pthread_join(workers[i], NULL);
+  for (i = 0; i < count; i++) {
+    fwrite(Jobs[i].listing, 1, Jobs[i].listinglength, stdout);
+    fwrite(Jobs[i].errors, 1, Jobs[i].errorslength, stderr);
+    free(Jobs[i].listing);
+    free(Jobs[i].errors);
+    if (Jobs[i].result != 0) result = 1;
+  }
+  free(workers);
+  free(Jobs);
+  return(result);
+}
+
+main(int argc, char *argv[]){
+  int i;
+  int threads = 0;
+  int result;
+  struct rusage resources;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (strcmp(argv[i], "-q") == 0) {
+      Listing = 0;
+      DumpConstPool = 0;
+    }
+    else if (strcmp(argv[i], "-nodump") == 0) DumpConstPool = 0;
+    else if (strcmp(argv[i], "-O") == 0) OptimizeCode = 1;
+    else if (strcmp(argv[i], "-nostackmap") == 0) StackMaps = 0;
+    else if (strcmp(argv[i], "--stats") == 0) ClassStats = 1;
+    else if (strcmp(argv[i], "-mem") == 0) ReportMemory = 1;
+    else if ((strcmp(argv[i], "-j") == 0) && (i + 1 < argc)) {
+      if ((threads = atoi(argv[++i])) <= 0) usage();
+    }
+    else usage();
+  }
+  if (i == argc) usage();
   UseStdOut = 0;
   /* yydebug = 1; */
-  StartListing();
-  result = yyparse();
-  EndListing();
+  InitOpCodeTables();
+  InitKeywordTable();
+  if (i == argc - 1) result = AssembleFile(argv[i], stdout, stderr);
+  else {
+    if (threads == 0) threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+    if (threads > argc - i) threads = argc - i;
+    result = AssembleFiles(&argv[i], argc - i, threads);
+  }
+  if (ReportMemory) {
+    getrusage(RUSAGE_SELF, &resources);
+    printf("peak arena %ld bytes, %ld allocations in all, "
+	   "max resident %ld KB\n", PeakArena, TotalAllocations,
+	   (long) resources.ru_maxrss);
+  }
   return(result);
 }
-void yyerror(char *text) 
+void yyerror(void *scanner, const char *text)
 {
-   oops(text);
+   oops((char *) text);
 }
-int yywrap(void){EndListing(); return(1);}
+int yywrap(void *scanner){EndListing(); return(1);}
@@ -1,10 +1,13 @@
-extern void yyerror(char *);
-extern int yylex(void);
-extern int yyparse(void);
+extern void yyerror(void *, const char *);
+extern int yyparse(void *);
+/* the (reentrant) scanner, from flex */
+extern int yylex_init(void **);
+extern void yyset_in(FILE *, void *);
+extern int yylex_destroy(void *);
 #ifdef __cplusplus
 extern "C" {
 #endif
-   extern int yywrap(void);
+   extern int yywrap(void *);
 #ifdef __cplusplus
         }
 #endif
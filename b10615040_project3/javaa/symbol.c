@@ -6,19 +6,112 @@
 #include "utils.h"
 #include "build.h"
 #include "listing.h"
-
-#define  StartNestLevel  (2)
-#define  EndNestLevel    (64)
+#include "context.h"
 
 static int SymBlock=1024;   /* How many symbols to allocate at a time */
 
-static int NumSymbols=0;
+/* the symbol display itself is in the assembler context (types.h) */
+
+/* Symbols are found through a hash table on their names, instead of by
+   looking at every symbol at every nest level.  A bucket holds all the
+   symbols that can be seen from the current level; leaving a level
+   takes its symbols back out.  The names are interned (see InternName),
+   so the name of a symbol is never copied more than once. */
 
-static Symbol *FirstSymbolatLevel[EndNestLevel+1];
-static Symbol *FreeSymbols;
-static Symbol *UsedSymbols;
+static unsigned long HashName(char *name)
+{
+   unsigned long hash = 2166136261UL;   /* FNV-1a */
+   while (*name) {
+      hash ^= (unsigned char) *name++;
+      hash *= 16777619UL;
+   }
+   return(hash);
+}
+
+/* grows the interned name table to size buckets (a power of 2) */
+static void RehashNames(int size)
+{
+   InternedName **names;
+   InternedName *n, *nextn;
+   int i;
+   names = (InternedName **) calloc(size, sizeof(InternedName *));
+   if (!names) oops("out of storage for names");
+   for (i=0; i<Ctx->NamesSize; ++i)
+      for (n=Ctx->Names[i]; n; n=nextn) {
+         nextn = n->next;
+         n->next = names[n->hash & (size-1)];
+         names[n->hash & (size-1)] = n;
+      }
+   free(Ctx->Names);
+   Ctx->Names = names;
+   Ctx->NamesSize = size;
+}
 
-static int NestLevel = StartNestLevel;
+/* the one copy of name that everybody shares.  Like the strings from
+   ConsStrings it has a length byte in front, and it must never be
+   changed or freed. */
+char *InternName(char *name)
+{
+   InternedName *n;
+   unsigned long hash;
+   int length;
+   char *text;
+   if (Ctx->NameCount >= Ctx->NamesSize)
+      RehashNames(Ctx->NamesSize ? 2*Ctx->NamesSize : 256);
+   hash = HashName(name);
+   for (n=Ctx->Names[hash & (Ctx->NamesSize-1)]; n; n=n->next)
+      if ((n->hash == hash) && !strcmp(n->text,name)) return(n->text);
+   length = strlen(name);
+   n = (InternedName *) Allocate(sizeof(InternedName));
+   text = (char *) Allocate(length+2);
+   text[0] = (unsigned char) length;
+   strcpy(&(text[1]),name);
+   n->text = &(text[1]);
+   n->hash = hash;
+   n->next = Ctx->Names[hash & (Ctx->NamesSize-1)];
+   Ctx->Names[hash & (Ctx->NamesSize-1)] = n;
+   Ctx->NameCount++;
+   return(n->text);
+}
+
+/* grows the symbol hash table to size buckets (a power of 2) */
+static void RehashSymbols(int size)
+{
+   Symbol **buckets;
+   Symbol *sym, *nextsym;
+   int i;
+   buckets = (Symbol **) calloc(size, sizeof(Symbol *));
+   if (!buckets) oops("out of storage for symbol table");
+   for (i=0; i<Ctx->SymbolHashSize; ++i)
+      for (sym=Ctx->SymbolHash[i]; sym; sym=nextsym) {
+         nextsym = sym->nexthash;
+         sym->nexthash = buckets[sym->hash & (size-1)];
+         buckets[sym->hash & (size-1)] = sym;
+      }
+   free(Ctx->SymbolHash);
+   Ctx->SymbolHash = buckets;
+   Ctx->SymbolHashSize = size;
+}
+
+static void HashSymbol(Symbol *sym)
+{
+   Symbol **bucket;
+   if (Ctx->SymbolsHashed >= Ctx->SymbolHashSize)
+      RehashSymbols(Ctx->SymbolHashSize ? 2*Ctx->SymbolHashSize : 256);
+   bucket = &(Ctx->SymbolHash[sym->hash & (Ctx->SymbolHashSize-1)]);
+   sym->nexthash = *bucket;
+   *bucket = sym;
+   Ctx->SymbolsHashed++;
+}
+
+static void UnhashSymbol(Symbol *sym)
+{
+   Symbol **link;
+   link = &(Ctx->SymbolHash[sym->hash & (Ctx->SymbolHashSize-1)]);
+   while (*link != sym) link = &((*link)->nexthash);
+   *link = sym->nexthash;
+   Ctx->SymbolsHashed--;
+}
 
 int IsTypeSymbol(char *name)
 {
@@ -29,19 +122,22 @@ int IsTypeSymbol(char *name)
   else                          return(0);
 }
 
-int CurrentNestLevel(void) { return(NestLevel); }
+int CurrentNestLevel(void) { return(Ctx->NestLevel); }
 
 void IncrNestLevel(void) {
    char str[100];
-   RangeCheck(StartNestLevel,NestLevel,EndNestLevel-1,"Nest level overflow");
-   FirstSymbolatLevel[++NestLevel] = NULL;
+   RangeCheck(StartNestLevel,Ctx->NestLevel,EndNestLevel-1,"Nest level overflow");
+   Ctx->FirstSymbolatLevel[++Ctx->NestLevel] = NULL;
 /* sprintf(str,"Nest level now %d",NestLevel); */
 /* message(str);                               */
 }
 void DecrNestLevel(void) {
    char str[100];
-   RangeCheck(StartNestLevel+1,NestLevel,EndNestLevel,"Nest level underflow");
-   FirstSymbolatLevel[NestLevel--] = NULL;
+   Symbol *sym;
+   RangeCheck(StartNestLevel+1,Ctx->NestLevel,EndNestLevel,"Nest level underflow");
+   for (sym=Ctx->FirstSymbolatLevel[Ctx->NestLevel]; sym; sym=sym->next)
+      UnhashSymbol(sym);
+   Ctx->FirstSymbolatLevel[Ctx->NestLevel--] = NULL;
 /* sprintf(str,"Nest level now %d",NestLevel); */
 /* message(str);                               */
 }
@@ -49,16 +145,16 @@ void DecrNestLevel(void) {
 void DumpSymbolDisplay(void) {
    int i;
    Symbol *sym;
-   for (i=NestLevel; i>= 0; --i) {
-      printf("\n Symbol display level %d\n",i);
-      for (sym=FirstSymbolatLevel[i]; sym; sym=sym->next) {
-         ShowSymbol(sym,2); printf("\n");
+   for (i=Ctx->NestLevel; i>= 0; --i) {
+      fprintf(Ctx->listfp, "\n Symbol display level %d\n",i);
+      for (sym=Ctx->FirstSymbolatLevel[i]; sym; sym=sym->next) {
+         ShowSymbol(sym,2); fprintf(Ctx->listfp, "\n");
       }
    }
 }
 
 int GetNestLevel(void) {
-   return(NestLevel);
+   return(Ctx->NestLevel);
 }
 
 Symbol *RetrieveSymbol(char *name) 
@@ -67,7 +163,7 @@ Symbol *RetrieveSymbol(char *name)
    sym = LookupSymbol(0,name);
    if (!(sym->InUse)) {
       StartMessage();
-      printf("Symbol %s not declared\n",name);
+      fprintf(Ctx->listfp, "Symbol %s not declared\n",name);
       oops("Undeclared symbol");
       EndMessage();
    }
@@ -77,39 +173,38 @@ Symbol *RetrieveSymbol(char *name)
 Symbol *EnterSymbol(MimeType M, char *name)
 {
   Symbol *sym;
-  sym = LookupSymbol(NestLevel, name);
+  sym = LookupSymbol(Ctx->NestLevel, name);
   if (sym->InUse) {
      StartMessage();
-     printf("Symbol %s multiply defined\n",name);
+     fprintf(Ctx->listfp, "Symbol %s multiply defined\n",name);
      EndMessage();
   }
   sym->InUse = 1;
   sym->M     = M;
-  sym->level = NestLevel;
+  sym->level = Ctx->NestLevel;
   return(sym);
 }
 
 Symbol *GetSymbol(void) {
    Symbol *sym;
 
-   if (!FreeSymbols) {
+   if (!Ctx->FreeSymbols) {
       Symbol *newblock;
       int i;
-      newblock = (Symbol *) malloc (SymBlock * sizeof(Symbol));
-      if (!newblock) oops("out of storage for symbol table");
+      newblock = (Symbol *) Allocate(SymBlock * sizeof(Symbol));
       bzero((unsigned char *)newblock,SymBlock * sizeof(Symbol));
       for (i=0; i<SymBlock; ++i) {
-         newblock[i].next = FreeSymbols;
-         FreeSymbols = &(newblock[i]);
+         newblock[i].next = Ctx->FreeSymbols;
+         Ctx->FreeSymbols = &(newblock[i]);
       }
    }
               
 
-   sym =  FreeSymbols;
-   FreeSymbols = FreeSymbols->next;
+   sym =  Ctx->FreeSymbols;
+   Ctx->FreeSymbols = Ctx->FreeSymbols->next;
 
-   sym->nextused = UsedSymbols;
-   UsedSymbols = sym;
+   sym->nextused = Ctx->UsedSymbols;
+   Ctx->UsedSymbols = sym;
 
    sym->next   = NULL;
    return(sym);
@@ -120,15 +215,21 @@ Symbol *ExistsSymbol(char *name)
    return(FindSymbol(0,name));
 }
 
+/* the symbol called name at the innermost level that is >= level */
 Symbol *FindSymbol(int level, char *name)
 {
-   int i;
    Symbol *sym;
-   for (i=NestLevel; i>= level; i--)
-      for (sym = FirstSymbolatLevel[i]; sym; sym=sym->next) {
-         if (!strcmp(name,sym->name)) return(sym);
-      }
-   return(NULL);
+   Symbol *found = NULL;
+   unsigned long hash;
+   if (Ctx->SymbolsHashed == 0) return(NULL);
+   hash = HashName(name);
+   for (sym=Ctx->SymbolHash[hash & (Ctx->SymbolHashSize-1)]; sym;
+        sym=sym->nexthash) {
+      if ((sym->hash != hash) || (sym->level < level)) continue;
+      if ((sym->name != name) && strcmp(name,sym->name)) continue;
+      if (!found || (sym->level > found->level)) found = sym;
+   }
+   return(found);
 }
 
 Symbol *LookupSymbol(int level, char *name) 
@@ -139,13 +240,15 @@ Symbol *LookupSymbol(int level, char *name)
 
    sym =  GetSymbol();
 
-   sym->name = (char *)malloc(strlen(name)+2);
+   sym->name = InternName(name);
+   sym->hash = HashName(name);
    sym->InUse = 0;  /* not yet initialized */
-   sym->SymbolID = ++NumSymbols;
-   strcpy(sym->name,name);
+   sym->SymbolID = ++Ctx->NumSymbols;
+   sym->level = level;
 
-   sym->next                 = FirstSymbolatLevel[level];
-   FirstSymbolatLevel[level] = sym;
+   sym->next                 = Ctx->FirstSymbolatLevel[level];
+   Ctx->FirstSymbolatLevel[level] = sym;
+   HashSymbol(sym);
    return(sym);
 }
 
@@ -212,13 +315,13 @@ void PrintSymbol(Symbol *sym)
 {
    char str[100];
    FormatSymbol(str,sym);
-   printf("%s",str);
+   fprintf(Ctx->listfp, "%s",str);
 }
 
 void ShowSymbol(Symbol *sym, int level)
 {
     int spacing = 2*level+1;
-    printf("\n%-*s",spacing," ");
+    fprintf(Ctx->listfp, "\n%-*s",spacing," ");
     PrintSymbol(sym);
     if ((sym->M.T.ptrcount == 0) && (sym->M.T.function ==0))
     switch (sym->M.T.B) {
@@ -229,7 +332,7 @@ void ShowSymbol(Symbol *sym, int level)
                               ShowSymbol(s,level+1);
                         break;
        case ConstType:
-                        printf(" Value is %d",sym->M.T.info.intval);
+                        fprintf(Ctx->listfp, " Value is %d",sym->M.T.info.intval);
        default:         break;
     }
 }
@@ -238,5 +341,5 @@ void ShowSymbol(Symbol *sym, int level)
 void ForEachSymbol(void (*Apply)(Symbol *, int))
 {
    Symbol *sym;
-   for (sym=UsedSymbols; sym; sym=sym->nextused) Apply(sym,0);
+   for (sym=Ctx->UsedSymbols; sym; sym=sym->nextused) Apply(sym,0);
 }
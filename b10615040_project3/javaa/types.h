@@ -1,4 +1,7 @@
 /* copyright 1996, Jason Hunt and Washington University, St. Louis */
+#include <stdio.h>
+#include <setjmp.h>
+
 typedef
    struct {
       int opcode;
@@ -6,13 +9,14 @@ typedef
    }
 OpCodeTranslator;
 
+/* one case of a lookupswitch or tableswitch, kept until the whole
+   switch has been read (see GenSwitchCode) */
 typedef
-   struct lookupentry{
+   struct {
       long match;
       char* alabel;
-      lookupentry* next;
    }
-;
+SwitchEntry;
 
 typedef
    struct exceptionentry{
@@ -47,27 +51,118 @@ typedef
    }
 ;
 
+/* one use of a label as a branch or switch target.  The offset isn't
+   filled in until the end of the method (see ResolveLabels), once we know
+   which branches have to be widened */
 typedef
-   struct tableentry{
-      char* alabel;
-      tableentry* next;
+   struct {
+      long opcodelocation;  /* the instruction the offset is counted from */
+      long location;        /* where the offset itself goes */
+      short label;          /* index into Label[] */
+      char wide;            /* 4 byte offset instead of 2 */
    }
-;
+LabelRef;
 
+/* a new encoding for one instruction of a finished method, which may be
+   longer or shorter than the old one (see RelayoutMethod) */
 typedef
-   struct methodname{
-      char name[L_tmpnam];
-      methodname* next;
+   struct {
+      long pc;                 /* the instruction being replaced */
+      int length;              /* 0 takes it out altogether */
+      unsigned char bytes[5];
    }
-;
+InstructionEdit;
 
+/* where MaxStackDepth has got to in following the paths through a method */
 typedef
-   struct unresolvedindex{
-      long location;
-      long opcodelocation;
-      unresolvedindex* next;
+   struct {
+      long length;             /* of the code */
+      long* depths;            /* stack depth into each pc, -1 if not seen */
+      long* work;              /* pcs still to be followed */
+      long worksize;
+      long max;
+      int mismatch;            /* already warned about differing depths */
    }
-;
+StackWalk;
+
+/* what a local variable or a word of the operand stack holds, the way
+   the verifier sees it (see ComputeStackMap) */
+typedef
+   struct {
+      char tag;                /* ITEM_Top ... ITEM_Uninitialized */
+      short index;             /* ITEM_Object: its Class entry */
+      long pc;                 /* ITEM_Uninitialized: the new that made it */
+      char* name;              /* ITEM_Object: the class or array signature */
+   }
+VerifyType;
+
+/* the types at the start of one instruction, for the StackMapTable.  A
+   long or double takes two words, the second of them ITEM_Top */
+typedef
+   struct {
+      long pc;
+      long locals;             /* words of locals, max_locals of them */
+      long stack;              /* words on the stack, -1 if not reached */
+      VerifyType* types;       /* the locals, then the stack */
+   }
+StackMapFrame;
+
+/* where ComputeStackMap has got to in working out the types */
+typedef
+   struct {
+      long length;             /* of the code */
+      long locals;             /* max_locals */
+      long stacksize;          /* max_stack */
+      StackMapFrame** frames;  /* by pc, for each instruction that needs a
+                                  frame: the types that have reached it */
+      char* reached;           /* the instructions some path gets to */
+      char* spare;             /* frames that are only there for Spares */
+      char* queued;
+      long* work;              /* frames still to be followed from */
+      long worksize;
+      VerifyType* types;       /* the locals and stack as we go */
+      long sp;
+      char* thisclass;
+      const char* problem;     /* why there can't be a StackMapTable */
+   }
+TypeWalk;
+
+/* one entry in the lexer's keyword table (see keywords.c) */
+typedef
+   struct {
+      const char* name;
+      int token;
+   }
+KeywordInfo;
+
+/* one chunk of an Arena */
+typedef
+   struct ArenaBlock {
+      ArenaBlock* next;
+      long size;           /* bytes after the header */
+      long used;
+   }
+ArenaBlock;
+
+/* a bump allocator for the small blocks of one assembly, all given back
+   at once (see arena.c) */
+typedef
+   struct {
+      ArenaBlock* blocks;  /* the one being carved up comes first */
+      long allocations;
+      long bytes;          /* asked for, rounded up */
+      long reserved;       /* got from malloc, headers included */
+   }
+Arena;
+
+/* a growable buffer of big-endian class file bytes (see bytewriter.c) */
+typedef
+   struct {
+      unsigned char* buf;
+      long len;
+      long size;
+   }
+ByteWriter;
 
 /* This structure is intended to hold every constant pool entry.  
 */
@@ -90,7 +185,6 @@ typedef
    struct {
       char* name;
       long index;
-      unresolvedindex* unresolvedindexhead;
    }
 LabelInfo;
 
@@ -134,10 +228,14 @@ typedef
       short signature_index;
       short max_stack;
       short max_locals;
-      char Code[65535];
+      char* Code;
       unsigned short CodeCounter;
+      long CodeSize;              /* how much room Code has */
       LabelInfo Label[100];
       short LabelCounter;
+      LabelRef* LabelRefs;
+      long LabelRefCounter;
+      long LabelRefSize;
       LocalVarInfo LocalVar[256];
       short LocalVarCounter;
       short currentslot;
@@ -149,6 +247,13 @@ typedef
       linenumberentry* linenumberhead;
       short UserLocalVarCounter;
       userlocalvarentry* userlocalvarhead;
+      StackMapFrame* Frames;      /* Frames[0] is the one the JVM works out
+                                     from the signature, and isn't written */
+      long FrameCount;            /* 0 for no StackMapTable */
+      StackMapFrame* Spares;      /* ones that aren't needed unless the
+                                     branch before them has to be widened
+                                     (see ComputeStackMap) */
+      long SpareCount;
    }
 MethodInfo; 
 
@@ -234,8 +339,17 @@ typedef struct _Symbol {
    int             ExprID;     /* expression ID   */
    struct _Symbol *nextreg;    /* for symbol table in WIL */
    int             registered;
+   struct _Symbol *nexthash;   /* next symbol in its hash bucket */
+   unsigned long   hash;       /* HashName(name)                */
 } Symbol;
 
+/* one entry in the table of interned names (see InternName) */
+typedef struct _InternedName {
+   struct _InternedName *next; /* next name in its hash bucket  */
+   unsigned long   hash;
+   char           *text;       /* with a length byte in front   */
+} InternedName;
+
 typedef struct _Terminal {
    int terminal;
    char string[100];
@@ -302,3 +416,67 @@ typedef struct _TreeNode {
    } WILinfo;
 } TreeNode;
 
+
+#define  StartNestLevel  (2)
+#define  EndNestLevel    (64)
+
+/* Everything the assembler knows about the file it is working on.  Each
+   file gets its own (see context.c), so that several files can be
+   assembled at the same time on different threads. */
+typedef
+   struct {
+      /* the class being built (gen.c) */
+      ConstPoolEntry ConstPool[1000];
+      int ConstPoolArrayIndex; /*current Const Pool array number*/
+      int ConstPoolIndex; /*current Const Pool index number*/
+      int ConstPoolRealIndex[1000]; /* myindex -> index in the class file,
+                                       filled in by OrderConstPool */
+      thisclassstruct ThisClass;
+      short SuperClass;
+      FieldInfo field[50];
+      short FieldCount;
+      MethodInfo currentmethod;
+      short MethodCount;
+      MethodInfo** Methods;    /* every finished method, kept until the
+                                  constant pool has its final order */
+      long MethodsSize;
+      SwitchEntry* SwitchEntries; /* the cases of the switch being read */
+      long SwitchCount;
+      long SwitchSize;
+      /* symbol display (symbol.c) */
+      int NumSymbols;
+      Symbol *FirstSymbolatLevel[EndNestLevel+1];
+      Symbol *FreeSymbols;
+      Symbol *UsedSymbols;
+      int NestLevel;
+      Symbol **SymbolHash;     /* the visible symbols, by name */
+      int SymbolHashSize;
+      int SymbolsHashed;
+      InternedName **Names;    /* every identifier seen so far */
+      int NamesSize;
+      int NameCount;
+      int ArbNames;            /* how many ArbName has made up */
+      /* strings and list nodes that last until the file is done */
+      Arena arena;
+      /* work space for one method or one class file (see context.c) */
+      struct ScratchBlock *scratch;
+      /* listing (endlex) */
+      int linenumber;
+      int col;
+      FILE *listfp;            /* listing and messages */
+      FILE *errfp;             /* errors and warnings */
+      jmp_buf abort;           /* where ABORT goes back to */
+   }
+AssemblerContext;
+
+/* one file of a "javaa a.jasm b.jasm ..." run (see main.c) */
+typedef
+   struct {
+      char *filename;
+      char *listing;
+      size_t listinglength;
+      char *errors;
+      size_t errorslength;
+      int result;
+   }
+AssemblyJob;
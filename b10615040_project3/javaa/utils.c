@@ -8,6 +8,7 @@
 #include "utils.h"
 #include "build.h"
 #include "listing.h"
+#include "context.h"
 
 /* void bzero(unsigned char *start, int len)
 {
@@ -18,40 +19,35 @@ void RangeCheck(int lower, int value, int upper, char *errormessage)
 {
    if ((value < lower) | (value > upper)) {
       StartMessage();
-      printf("RangeCheck fails: %d <= %d <= %d:  ",lower,value,upper);
+      fprintf(Ctx->listfp, "RangeCheck fails: %d <= %d <= %d:  ",lower,value,upper);
       EndMessage();
       oops(errormessage);
    }
 }
 
+/* a name no source can use, made up from a count kept per assembly,
+   so that the same file always gets the same names */
 char *ArbName(void) {
-   static int entered = 0;
    char  *ans;
-   unsigned char c;
-   if (!entered) {
-      int t;
-      entered = 1;
-      t = time(NULL);
-      srand(t);
-   }
-   ans = (char *)malloc(8);
-   sprintf(&(ans[1]),"$%5.5d",rand()%10000);
-   c = strlen(ans);
-   ans[0] = c;
+   size_t c;
+   ans = (char *)Allocate(16);
+   sprintf(&(ans[1]),"$%5.5d",Ctx->ArbNames++);
+   c = strlen(&(ans[1]));
+   ans[0] = (unsigned char) c;
    return(&(ans[1]));
 }
 
 char *ConsStrings(char *str1, char *str2)
 {
    char *ans;
-   unsigned char c;
+   size_t c;
    if (str1 == NULL) str1 = "";
    if (str2 == NULL) str2 = "";
    c = strlen(str1) + strlen(str2);
-   ans = (char *) malloc(c+2);
+   ans = (char *) Allocate(c+2);
    strcpy(&(ans[1]),str1);
    strcpy(&(ans[strlen(str1)+1]),str2);
-   ans[0] = c;
+   ans[0] = (unsigned char) c;  /* only a hint past 255; use strlen */
    return(&(ans[1]));
 }
 
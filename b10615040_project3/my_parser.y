@@ -3,31 +3,84 @@
 #include "SymbolTable.hpp"
 #include "lex.yy.cpp"
 #include "CodeGenerator.hpp"
+#include "SymbolFile.hpp"
 
 bool y_debug = false;
 #define Trace(t)       if(y_debug){ printf(t); cout << endl;}
 
+AtomTable Atoms;
+AtomTable Strings;
+SymbolArena Symbols;
 SymbolTableList ST;
 CodeGenerator CG;
 
+/* the arguments of the calls being parsed, innermost last, so that a call
+   doesn't need a vector of its own */
+vector<SingleValue> CallArgs;
+
+/* the arguments of the method being declared, kept the same way */
+vector<Symbol*> MethodArgs;
+
+/* the usual location bookkeeping, except that every reduction also tells
+   CG which source line the code it generates comes from */
+#define YYLLOC_DEFAULT(Current, Rhs, N)                                 \
+    do {                                                                \
+        if(N){                                                          \
+            (Current).first_line = YYRHSLOC(Rhs, 1).first_line;         \
+            (Current).last_line = YYRHSLOC(Rhs, N).last_line;           \
+            (Current).begin = YYRHSLOC(Rhs, 1).begin;                   \
+            (Current).end = YYRHSLOC(Rhs, N).end;                       \
+        }                                                               \
+        else{                                                           \
+            (Current).first_line = (Current).last_line =                \
+                YYRHSLOC(Rhs, 0).last_line;                             \
+            (Current).begin = (Current).end = YYRHSLOC(Rhs, 0).end;     \
+        }                                                               \
+        CG.set_line((Current).first_line);                              \
+        Reduced = (Current);                                            \
+        ReducedBefore = yylloc.begin;                                   \
+    } while(0)
+
+/* what the last rule matched, and the token read when it was reduced: an
+   error from a rule's action is about its text, but a syntax error, found
+   after reading a token, is about that token */
+YYLTYPE Reduced;
+long ReducedBefore = -1;
+
  /* utilities function */
 void yyerror(string msg);
 void InsertSymbolTable(Symbol* s);
-void SymbolNotFound(string symbol_name);
+void SymbolNotFound(Atom symbol_name);
 void VariablTypeInconsistant();
+SingleValue Operate(Operator op, const SingleValue& lhs, const SingleValue& rhs);
+void ArgumentsDontMatch(Symbol* func, SingleValue* args, int n);
+void ArrayIndexInRange(Symbol* array, const SingleValue& index);
 %}
 
+%code requires {
+/* where a token, or the text a rule matched, is: its lines, and its bytes
+   in the source, from begin up to end (see my_scanner.l) */
+typedef struct YYLTYPE{
+    int first_line;
+    int last_line;
+    long begin;
+    long end;
+} YYLTYPE;
+#define YYLTYPE_IS_DECLARED 1
+#define YYLTYPE_IS_TRIVIAL 1     /* or bison won't grow its stacks */
+}
+
 %union {
     float 	fval;
     int 	ival;
     bool    bval;
     char    cval;
-    string *sval;
-    SingleValue* single_value;
+    Atom    atom;
+    SingleValue single_value;
 
-    VarSymbol* func_dec_arg;
-    vector<VarSymbol*>* func_dec_args;
-    vector<SingleValue*>* func_call_args;
+    Symbol* func_dec_arg;
+    int func_dec_args;      /* where they start in MethodArgs */
+    int func_call_args;     /* where they start in CallArgs */
     VarType type;
 }
 
@@ -40,11 +93,11 @@ void VariablTypeInconsistant();
 %token  BOOLEAN BREAK CHAR CASE CLASS CONTINUE DEF DO ELSE EXIT FALSE FLOAT FOR IF INT OBJECT PRINT PRINTLN REPEAT RETURN STRING TO TRUE TYPE VAL VAR WHILE READ
 
 // define Constant and identifier type
-%token  <sval>  ID
+%token  <atom>  ID
 %token  <bval>  CONST_BOOL
 %token  <ival>  CONST_INT
 %token  <fval>  CONST_FLOAT
-%token  <sval>  CONST_STR
+%token  <atom>  CONST_STR
 %token  <cval>  CONST_CHAR
 
 // define return type of non-terminal
@@ -63,19 +116,23 @@ void VariablTypeInconsistant();
 %left '*' '/'
 %nonassoc UMINUS
 
+%locations
 %start program
 %%
 
 program: 
     OBJECT ID 
     {
-        InsertSymbolTable(new Symbol(*$2, Object));
+        InsertSymbolTable(Symbols.object($2));
 
         CG.program_start();
 
     } '{' const_var_decs  method_decs '}'
     {
         Trace("Reducing to program");
+        if(!WriteSymbolFile(CG.get_file_name(), ST)){
+            cout << "can't write " << CG.get_file_name() << ".sym" << endl;
+        }
         ST.pop();
 
         CG.program_end();
@@ -89,50 +146,56 @@ const_var_decs:
 const_dec:
     VAL ID '=' expression
     {
-        InsertSymbolTable(new VarSymbol(*$2, Constant, *$4));
+        InsertSymbolTable(Symbols.variable($2, Constant, $4));
     } |
     VAL ID ':' var_type '=' expression
     {
-        if($4 != $6->type) VariablTypeInconsistant();
-        InsertSymbolTable(new VarSymbol(*$2, Constant, *$6));
+        if($4 != $6.type) VariablTypeInconsistant();
+        InsertSymbolTable(Symbols.variable($2, Constant, $6));
     };
 
 var_dec:
     VAR ID ':' var_type '[' CONST_INT ']'
     {
         if($6 < 1) yyerror("Array length cannot less than 1");
-        InsertSymbolTable(new ArraySymbol(*$2, $4, $6));
+        if($6 > MaxArrayLength) yyerror("Array length cannot more than " + to_string(MaxArrayLength));
+        InsertSymbolTable(Symbols.array($2, $4, $6));
     }|
     VAR ID ':' var_type '=' expression
     {
-        if($4 != $6->type) VariablTypeInconsistant();
-        InsertSymbolTable(new VarSymbol(*$2, Variable, *$6));
+        if($4 != $6.type) VariablTypeInconsistant();
+        InsertSymbolTable(Symbols.variable($2, Variable, $6));
 
         if(ST.get_top() == 0){
-            CG.dec_global_var_with_value(*$2, $6->ival);
+            CG.dec_global_var_with_value($2, $6.ival);
         }
         else{
-            CG.assign_local_var(ST.get_index(*$2));
+            CG.assign_local_var(ST.get_index($2));
+            CG.local_var($2, $4, ST.get_index($2));
         }
     }|
     VAR ID '=' expression
     {   
-        InsertSymbolTable(new VarSymbol(*$2, Variable, *$4));
+        InsertSymbolTable(Symbols.variable($2, Variable, $4));
 
         if(ST.get_top() == 0){
-            CG.dec_global_var_with_value(*$2, $4->ival);
+            CG.dec_global_var_with_value($2, $4.ival);
         }
         else{
-            CG.assign_local_var(ST.get_index(*$2));
+            CG.assign_local_var(ST.get_index($2));
+            CG.local_var($2, $4.get_type(), ST.get_index($2));
         }
 
     }|
     VAR ID ':' var_type
     {
-        InsertSymbolTable(new VarSymbol(*$2, Variable, $4));
+        InsertSymbolTable(Symbols.variable($2, Variable, $4));
 
         if(ST.get_top() == 0){
-            CG.dec_global_var(*$2);
+            CG.dec_global_var($2);
+        }
+        else{
+            CG.local_var($2, $4, ST.get_index($2));
         }
     };
 
@@ -161,33 +224,28 @@ var_type:
 const_val: 
     CONST_BOOL
     {
-        SingleValue* s = new SingleValue(Boolean);
-        s->set_boolean($1);
-        $$ = s;
+        $$ = SingleValue(Boolean);
+        $$.set_boolean($1);
     } | 
     CONST_STR 
     {   
-        SingleValue* s = new SingleValue(String);
-        s->set_string($1);
-        $$ = s;
+        $$ = SingleValue(String);
+        $$.set_string($1);
     } | 
     CONST_INT
     {
-        SingleValue* s = new SingleValue(Integer);
-        s->set_int($1);
-        $$ = s;
+        $$ = SingleValue(Integer);
+        $$.set_int($1);
     } | 
     CONST_FLOAT 
     {
-        SingleValue* s = new SingleValue(Float);
-        s->set_float($1);
-        $$ = s;
+        $$ = SingleValue(Float);
+        $$.set_float($1);
     }|
     CONST_CHAR
     {
-        SingleValue* s = new SingleValue(Char);
-        s->set_char($1);
-        $$ = s;
+        $$ = SingleValue(Char);
+        $$.set_char($1);
     };
 
 method_decs:
@@ -198,10 +256,12 @@ method_dec:
     DEF ID '(' args ')' return_type
     {
         // start to add Function to Global SymbolTable
-        FuncSymbol* func = new FuncSymbol(*$2, Function);
-        for(int i = 0; i < $4->size(); ++i)
+        Symbol** args = MethodArgs.data() + $4;
+        int count = MethodArgs.size() - $4;
+        Symbol* func = Symbols.function($2, count);
+        for(int i = 0; i < count; ++i)
         {
-            func->add_input_type((*$4)[i]->get_type());
+            func->set_input_type(i, args[i]->get_type());
         }
         if($6 != None)
         {
@@ -212,42 +272,47 @@ method_dec:
 
         // add local SymbolTable
         ST.push();
-        for(int i = 0; i < $4->size(); ++i)
+        for(int i = 0; i < count; ++i)
         {
-            InsertSymbolTable((*$4)[i]);
+            InsertSymbolTable(args[i]);
         }
 
-        if(*$2 == "main") CG.def_main_start();
+        if(Atoms.name($2) == "main") CG.def_main_start();
         else CG.dec_func_start(func);
+        for(int i = 0; i < count; ++i)
+        {
+            CG.local_var(args[i]->get_id(), args[i]->get_type(), ST.get_index(args[i]->get_id()));
+        }
+        MethodArgs.resize($4);
 
     } '{' const_var_decs empty_or_more_statements '}'
     {
         Trace("Reducing to method_dec");
         ST.pop();
 
+        CG.set_line(@11.first_line);  /* the return goes with the closing brace */
         CG.def_func_end($6);
     }
     ;
 
 args:
     arg{
-        vector<VarSymbol*>* vvs = new vector<VarSymbol*>();
-        vvs->push_back($1);
-        $$ = vvs;
+        $$ = MethodArgs.size();
+        MethodArgs.push_back($1);
     } |
     args ',' arg{
-        $1->push_back($3);
+        MethodArgs.push_back($3);
         $$ = $1;
     } |
     /* empty */
     {
-        $$ = new vector<VarSymbol*>();
+        $$ = MethodArgs.size();
     };
 
 arg:
     ID ':' var_type
     {
-        $$ = new VarSymbol(*$1, Variable, $3);
+        $$ = Symbols.variable($1, Variable, $3);
     };
 
 return_type:
@@ -277,37 +342,39 @@ statements:
 simple_statement:
     ID '=' expression
     {
-        Symbol* id = ST.lookup(*$1);
-        if(id == NULL) SymbolNotFound(*$1);
+        const Binding* b = ST.resolve($1);
+        if(b == NULL) SymbolNotFound($1);
+        Symbol* id = b->symbol;
         if(id->get_declaration() != Variable){ yyerror(string("Symbol:") + id->get_id_name() + " is not an varaible");}
-        if(id->get_type() != $3->get_type()) VariablTypeInconsistant();
-        id->set_value(*$3);
+        if(id->get_type() != $3.get_type()) VariablTypeInconsistant();
+        id->set_value($3);
 
 
-        int get_index = ST.get_index(*$1);
-        if(get_index == -2){
-            CG.assign_global_var(*$1);
+        if(b->depth == 0){
+            CG.assign_global_var(id);
         }
         else{
-            CG.assign_local_var(get_index);
+            CG.assign_local_var(b->slot);
         }
     }|
     ID '[' expression ']' '=' expression
     {
-        if($3->get_type() != Integer) yyerror("Array Index must be integer");
-        Symbol* id = ST.lookup(*$1);
-        if(id == NULL) SymbolNotFound(*$1);
-        if(id->get_type() != $3->get_type()) VariablTypeInconsistant();
+        if($3.get_type() != Integer) yyerror("Array Index must be integer");
+        Symbol* id = ST.lookup($1);
+        if(id == NULL) SymbolNotFound($1);
+        if(id->get_declaration() != Array){ yyerror(string("Symbol:") + id->get_id_name() + " is not an array");}
+        if(id->get_type() != $6.get_type()) VariablTypeInconsistant();
+        ArrayIndexInRange(id, $3);
 
-        if($6->dirty == true){
-            id->assign_value(*$6, $3->ival);
+        if($6.dirty == true){
+            id->assign_value($6, $3.ival);
         }
         
     }|
     PRINT {
         CG.print_start();
     } '(' expression ')' {
-        if($4->get_type() == String){
+        if($4.get_type() == String){
             CG.print_str_end();
         }
         else{
@@ -317,7 +384,7 @@ simple_statement:
     | PRINTLN {
         CG.print_start();
     }'(' expression ')'{
-        if($4->get_type() == String){
+        if($4.get_type() == String){
             CG.println_str_end();
         }
         else{
@@ -326,8 +393,8 @@ simple_statement:
     }
     | READ ID
     {
-        Symbol* id = ST.lookup(*$2);
-        if(id == NULL) SymbolNotFound(*$2);
+        Symbol* id = ST.lookup($2);
+        if(id == NULL) SymbolNotFound($2);
     }
     | RETURN
     | RETURN expression;
@@ -338,277 +405,175 @@ expression:
         $$ = $1;
 
         if(ST.get_top() != 0){
-            if($1->get_type() == String){
-                CG.load_const_str(*($1->sval));
+            if($1.get_type() == String){
+                CG.load_const_str(Strings.name($1.sval));
             }
             else{
-                CG.load_const_int($1->ival);
+                CG.load_const_int($1.ival);
             }
         }
     }|
     ID
     {
-        Symbol* id = ST.lookup(*$1);
-        if(id == NULL) {SymbolNotFound(*$1);}
-        $$ = id->get_value();
-
-        if(ST.get_top() != 0 && id->get_declaration() == Constant){
-            if(id->get_type() == String){
-                CG.load_const_str(*(id->get_value()->sval));
-            }
-            else{
-                CG.load_const_int(id->get_value()->ival);
+        const Binding* b = ST.resolve($1);
+        if(b == NULL) {SymbolNotFound($1);}
+        Symbol* id = b->symbol;
+        if(id->get_value() == NULL){ yyerror(string("Symbol:") + id->get_id_name() + " is not a value");}
+        $$ = *id->get_value();
+
+        if(id->get_declaration() == Constant){
+            /* a constant has no variable to load; its value is put in the
+               code instead, and outside a method, like a const_val, it is
+               only worked out */
+            if(ST.get_top() != 0){
+                if(id->get_type() == String){
+                    CG.load_const_str(Strings.name(id->get_value()->sval));
+                }
+                else{
+                    CG.load_const_int(id->get_value()->ival);
+                }
             }
         }
+        else if(b->depth == 0){
+            CG.load_global_var(id);
+        }
         else{
-            int get_index = ST.get_index(*$1);
-            if(get_index == -2){
-                CG.load_global_var(*$1);
-            }
-            else{
-                CG.load_local_var(get_index);
-            }
+            CG.load_local_var(b->slot);
         }
     }|
     '-' expression %prec UMINUS
     {
-        VarType temp_type = $2->get_type();
-        if(temp_type == Integer)
-        {
-            $2->ival *= -1;
-            $$ = $2;
-        } 
-        else if(temp_type == Float)
-        {
-            $2->fval *= -1;
-            $$ = $2;
-        }
-        else
-        {
-            yyerror("Value after Unary operator '-' can only be Integer or Float");
-        }
+        $$ = Operate(Negate, $2, $2);
 
 
         CG.operation('n');
     }|
     '!' expression
     {
-        if($2->get_type() != Boolean)
-        {
-            yyerror("Value after operator'!' can only be Boolean");
-        }
-        $2->bval = !$2->bval;
-        $$ = $2;
+        $$ = Operate(Not, $2, $2);
 
 
         CG.operation('!');
     } |
     expression OR expression
     {
-        if($1->get_type() != Boolean || $3->get_type() != Boolean)
-        {
-            yyerror("Value between operator '||' can only be Boolean");
-        }
-        SingleValue* s = new SingleValue(Boolean);
-        s->set_boolean($1->bval || $3->bval);
-        $$ = s;
+        $$ = Operate(Or, $1, $3);
 
 
         CG.operation('|');
     } |
     expression AND expression
     {
-        if($1->get_type() != Boolean || $3->get_type() != Boolean)
-        {
-            yyerror("Value between operator '&&' can only be Boolean");
-        }
-        SingleValue* s = new SingleValue(Boolean);
-        s->set_boolean($1->bval && $3->bval);
-        $$ = s;
+        $$ = Operate(And, $1, $3);
 
 
         CG.operation('&');
     } |
     expression '+' expression
     {
-        if($1->get_type() != $3->get_type()) VariablTypeInconsistant();
-        if($1->get_type() == Integer || $1->get_type() == Float)
-        {
-            SingleValue s = *$1 + *$3;
-            $$ = &s;
-        }
-        else
-        {
-            yyerror("Values between operator '+' can only be Integer or Float");
-        }
+        $$ = Operate(Add, $1, $3);
 
 
         CG.operation('+');
     } |
     expression '-' expression
     {
-        if($1->get_type() != $3->get_type()) VariablTypeInconsistant();
-        if($1->get_type() == Integer || $1->get_type() == Float)
-        {
-            SingleValue s = *$1 - *$3;
-            $$ = &s;
-        }
-        else
-        {
-            yyerror("Values between operator '-' can only be Integer or Float");
-        }
+        $$ = Operate(Subtract, $1, $3);
 
 
         CG.operation('-');
     }|
     expression '*' expression
     {
-        if($1->get_type() != $3->get_type()) VariablTypeInconsistant();
-        if($1->get_type() == Integer || $1->get_type() == Float)
-        {
-            SingleValue s = *$1 * *$3;
-            $$ = &s;
-        }
-        else
-        {
-            yyerror("Values between operator '*' can only be Integer or Float");
-        }
+        $$ = Operate(Multiply, $1, $3);
 
 
         CG.operation('*');
     }|
     expression '/' expression
     {
-        if($1->get_type() != $3->get_type()) VariablTypeInconsistant();
-        if($1->get_type() == Integer || $1->get_type() == Float)
-        {
-            SingleValue s = *$1 / *$3;
-            $$ = &s;
-        }
-        else
-        {
-            yyerror("Values between operator '/' can only be Integer or Float");
-        }
+        $$ = Operate(Divide, $1, $3);
 
 
         CG.operation('/');
     }|
     expression '<' expression
     {
-        if($1->get_type() != $3->get_type()) VariablTypeInconsistant();
-        if($1->get_type() == Integer || $1->get_type() == Float || $1->get_type() == Boolean)
-        {
-            
-            SingleValue s = *$1 < *$3;
-            $$ = &s;
-        }
-        else
-        {
-            yyerror("Values between operator '<' can only be Integer, Float, or Boolean");
-        }
+        $$ = Operate(Less, $1, $3);
 
 
         CG.relation("<");
     }|
     expression '>' expression
     {
-        if($1->get_type() != $3->get_type()) VariablTypeInconsistant();
-        if($1->get_type() == Integer || $1->get_type() == Float || $1->get_type() == Boolean)
-        {
-            SingleValue s = *$1 > *$3;
-            $$ = &s;
-        }
-        else
-        {
-            yyerror("Values between operator '>' can only be Integer, Float, or Boolean");
-        }
+        $$ = Operate(Greater, $1, $3);
 
 
         CG.relation(">");
     }|
     expression LE expression
     {
-        if($1->get_type() != $3->get_type()) VariablTypeInconsistant();
-        if($1->get_type() == Integer || $1->get_type() == Float || $1->get_type() == Boolean)
-        {
-            SingleValue s = *$1 <= *$3;
-            $$ = &s;
-        }
-        else
-        {
-            yyerror("Values between operator '<=' can only be Integer, Float, or Boolean");
-        }
+        $$ = Operate(LessEqual, $1, $3);
 
 
         CG.relation("<=");
     }|
     expression EE expression
     {
-        if($1->get_type() != $3->get_type()) VariablTypeInconsistant();
-        SingleValue s = *$1 == *$3;
-        $$ = &s;
+        $$ = Operate(Equal, $1, $3);
 
 
         CG.relation("==");
     }|
     expression GE expression
     {
-        if($1->get_type() != $3->get_type()) VariablTypeInconsistant();
-        if($1->get_type() == Integer || $1->get_type() == Float || $1->get_type() == Boolean)
-        {
-            SingleValue s = *$1 >= *$3;
-            $$ = &s;
-        }
-        else
-        {
-             yyerror("Values between operator '>=' can only be Integer, Float, or Boolean");
-        }
+        $$ = Operate(GreaterEqual, $1, $3);
 
 
         CG.relation(">=");
     }|
     expression NE expression
     {
-        if($1->get_type() != $3->get_type()) VariablTypeInconsistant();
-        SingleValue s = *$1 != *$3;
-        $$ = &s;
+        $$ = Operate(NotEqual, $1, $3);
 
 
         CG.relation("!=");
     }|
     ID '[' expression ']'
     {
-        if($3->get_type() != Integer) yyerror("Array Index must be integer");
+        if($3.get_type() != Integer) yyerror("Array Index must be integer");
 
-        Symbol* id = ST.lookup(*$1);
-        if(id == NULL) {SymbolNotFound(*$1);}
+        Symbol* id = ST.lookup($1);
+        if(id == NULL) {SymbolNotFound($1);}
         if(id->get_declaration() != Array){ yyerror(string("Symbol:") + id->get_id_name() + " is not an array");}
+        ArrayIndexInRange(id, $3);
 
-        if($3->dirty == false){
-            $$ = id->get_value(0);
+        if($3.dirty == false){
+            $$ = *id->get_value(0);
         }
         else
         {
-            $$ = id->get_value($3->ival);
+            $$ = *id->get_value($3.ival);
         }
     } |
     func_call
     {
-        SingleValue s = SingleValue($1);
-        $$ = &s;
+        $$ = SingleValue($1);
     };
 
 func_call:
     ID '(' comma_separated_expressions ')'
     {
-        Symbol* func = ST.lookup(*$1);
+        Symbol* func = ST.lookup($1);
         
-        if(func == NULL) { SymbolNotFound(*$1);}
+        if(func == NULL) { SymbolNotFound($1);}
         
         if(func->get_declaration() != Function){ yyerror(string("Symbol:") + func->get_id_name() + " is not a function");}
 
-        if(func->check_input_types($3) == false){ yyerror("Function arguments does not match");}
-        
+        if(func->check_input_types(CallArgs.data() + $3, CallArgs.size() - $3) == false){
+            ArgumentsDontMatch(func, CallArgs.data() + $3, CallArgs.size() - $3);
+        }
+        CallArgs.resize($3);
         
         $$ = func->get_return_type();
 
@@ -618,27 +583,29 @@ func_call:
 comma_separated_expressions:
     expression
     {
-        $$ = new vector<SingleValue*>();
-        $$->push_back($1);
+        $$ = CallArgs.size();
+        CallArgs.push_back($1);
     } |
     comma_separated_expressions ',' expression{
-        $1->push_back($3);
+        CallArgs.push_back($3);
         $$ = $1;
 
     } |
     /* empty */
     {
-        $$ = new vector<SingleValue*>();
+        $$ = CallArgs.size();
     };
 
 block:
     '{' 
     {
         ST.push_block();
+        CG.scope_start();
     } const_var_decs statements empty_or_more_statements '}'
     {
         Trace("Reducing to block")
         ST.pop();
+        CG.scope_end();
     };
 
 block_or_statement:
@@ -649,7 +616,7 @@ if_condition:
     IF '(' expression ')'
     {
         CG.if_start();
-        if($3->get_type() != Boolean) yyerror("Conditional statement should be boolean value");
+        if($3.get_type() != Boolean) yyerror("Conditional statement should be boolean value");
     } block_or_statement else_condition
     {
         Trace("Reducing to IF condition");
@@ -670,7 +637,7 @@ loop:
         CG.while_start();
     } '(' expression ')'
     {
-        if($4->get_type() != Boolean) yyerror("while statement should be boolean value");
+        if($4.get_type() != Boolean) yyerror("while statement should be boolean value");
 
         CG.if_start();
     } block_or_statement
@@ -681,8 +648,8 @@ loop:
     } |
     FOR '(' ID '<' '-' CONST_INT TO CONST_INT ')'
     {
-        Symbol* id = ST.lookup(*$3);
-        if(id == NULL) {SymbolNotFound(*$3);}
+        Symbol* id = ST.lookup($3);
+        if(id == NULL) {SymbolNotFound($3);}
         if(id->get_declaration() != Variable){ yyerror(string("Symbol:") + id->get_id_name() + " is not an varaible");}
         if(id->get_type() != Integer) yyerror("Variable in for loop should be integer");
         
@@ -701,28 +668,89 @@ void InsertSymbolTable(Symbol* s)
     }
 }
 
-void SymbolNotFound(string symbol_name){
-    yyerror(string("Symbol:") + symbol_name + " not found");
+void SymbolNotFound(Atom symbol_name){
+    yyerror(string("Symbol:") + Atoms.name(symbol_name) + " not found");
 }
 
 void VariablTypeInconsistant(){
     yyerror("Variable Type inconsistant");
 }
 
+/* says how the n arguments of a call don't fit func */
+void ArgumentsDontMatch(Symbol* func, SingleValue* args, int n){
+    string why;
+    if(n != func->get_input_count()){
+        why = to_string(n) + " given, " + to_string(func->get_input_count()) + " expected";
+    }
+    for(int i = 0; why == "" && i < n; ++i){
+        if(args[i].get_type() != func->get_input_type(i)){
+            why = "argument " + to_string(i + 1) + " is " + VarTypePrint(args[i].get_type())
+                + ", " + VarTypePrint(func->get_input_type(i)) + " expected";
+        }
+    }
+    yyerror("Function arguments does not match: " + func->get_id_name() + " (" + why + ")");
+}
+
+/* an index known at compile time has to be one of the array's elements */
+void ArrayIndexInRange(Symbol* array, const SingleValue& index){
+    if(index.dirty && (index.ival < 0 || index.ival >= array->get_length())){
+        yyerror("Array index " + to_string(index.ival) + " is out of range for "
+            + array->get_id_name() + " (length " + to_string(array->get_length()) + ")");
+    }
+}
+
+/* checks the operands of op against Operators, and folds them if they are
+   both known; a unary operator gets its operand as both */
+SingleValue Operate(Operator op, const SingleValue& lhs, const SingleValue& rhs){
+    const OperatorRow& row = Operators[op];
+    if(row.types[lhs.type].fold == NULL || row.types[rhs.type].fold == NULL){
+        yyerror(string(row.unary ? "Value after operator '" : "Values between operator '")
+            + row.symbol + "' can only be " + OperatorTypes(op));
+    }
+    if(lhs.type != rhs.type) VariablTypeInconsistant();
+    return row.types[lhs.type].fold(lhs, rhs);
+}
+
 void yyerror(string msg)
 {
     cout << msg << endl;
+    if(SourceOpen()){
+        const YYLTYPE& at = (ReducedBefore == yylloc.begin) ? Reduced : yylloc;
+        cout << at.first_line << ": " << SourceLine(at.begin) << endl;
+    }
     exit(1);
 }
 
 
 int main(int argc, char **argv) {
-  yyin = fopen(argv[1], "r");
-  string source = string(argv[1]);
+  /* -g adds a LineNumberTable and a LocalVariableTable to every method,
+     --stats and --dump show what went into the symbol table (on stderr),
+     and -i Other.sym lets the program use Other's globals */
+  bool debug_info = false;
+  bool symbol_stats = false;
+  vector<string> imports;
+  int arg = 1;
+  while(arg < argc - 1 && argv[arg][0] == '-'){
+    string option = string(argv[arg]);
+    if(option == "-g") debug_info = true;
+    else if(option == "--stats") symbol_stats = true;
+    else if(option == "--dump") ST.set_dump(true);
+    else if(option == "-i" && arg < argc - 2) imports.push_back(string(argv[++arg]));
+    else break;
+    ++arg;
+  }
+  for(size_t i = 0; i < imports.size(); ++i){
+    string problem = ReadSymbolFile(imports[i], ST);
+    if(problem != "") yyerror(problem);
+  }
+  ST.set_stats(symbol_stats);
+  if(!OpenSource(argv[arg])) yyerror("can't read " + string(argv[arg]));
+  string source = string(argv[arg]);
   int dot = source.find(".");
   string filename = source.substr(0, dot);
-  CG = CodeGenerator(filename);
+  CG = CodeGenerator(filename, debug_info);
 
   yyparse();
+  if(symbol_stats) ST.print_stats(cerr);
   return 0;
 }
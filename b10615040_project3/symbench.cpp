@@ -0,0 +1,69 @@
+/*
+symbench: times the symbol table on its own, the way the parser uses it.
+A global scope holds the functions and some globals, and each function
+body pushes a block or two of locals; then every name is looked up over
+and over, locals more often than globals, and the time per lookup is
+printed.  Run as "symbench [names] [rounds]".
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include "SymbolTable.hpp"
+
+AtomTable Atoms;
+AtomTable Strings;
+SymbolArena Symbols;
+
+int main(int argc, char* argv[]){
+	int names = (argc > 1) ? atoi(argv[1]) : 200;
+	int rounds = (argc > 2) ? atoi(argv[2]) : 20000;
+	if(names < 4 || rounds < 1){
+		cout << "Usage: symbench [names] [rounds]" << endl;
+		return 1;
+	}
+
+	// globals at the bottom, then two blocks of locals on top
+	SymbolTableList ST;
+	vector<Atom> ids;
+	for(int i = 0; i < names; ++i){
+		string name = "identifier_" + to_string(i);
+		ids.push_back(Atoms.intern(name.c_str(), name.size()));
+	}
+	int level = 0;
+	for(int i = 0; i < names; ++i){
+		if(i == names / 2 || i == names * 3 / 4){
+			ST.push_block();
+			++level;
+		}
+		if(level == 0 && i % 4 == 0){
+			ST.insert(Symbols.function(ids[i], 0));
+		}
+		else{
+			ST.insert(Symbols.variable(ids[i], Variable, Integer));
+		}
+	}
+
+	// the locals, in the top half, are used three times as often
+	vector<Atom> uses;
+	for(int i = 0; i < names; ++i){
+		uses.push_back(ids[i]);
+		if(i >= names / 2){
+			uses.push_back(ids[i]);
+			uses.push_back(ids[i]);
+		}
+	}
+
+	long found = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for(int r = 0; r < rounds; ++r){
+		for(size_t u = 0; u < uses.size(); ++u){
+			if(ST.lookup(uses[u]) != NULL) ++found;
+			found += ST.get_index(uses[u]);
+		}
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	long lookups = 2L * rounds * uses.size();
+	cout << lookups << " lookups of " << names << " names in " << seconds << " s, "
+		 << seconds * 1e9 / lookups << " ns each (" << found << ")" << endl;
+	return 0;
+}